@@ -0,0 +1,186 @@
+/**
+ * depth_rasterizer.h
+ *
+ * Depth-only software rasterizer used as a drop-in replacement for the
+ * OpenGL render path of RangeLikelihood on machines without a GPU.
+ *
+ * The rasterizer follows the OpenGL conventions used by RangeLikelihood:
+ * geometry is transformed by a caller-supplied model-view-projection matrix,
+ * clipped against the near plane, snapped to a fixed-point grid with 8 bits of
+ * sub-pixel precision and scan-converted with the top-left fill rule at pixel
+ * centers. Window depth is interpolated linearly in screen space and resolved
+ * with GL_LESS, so that the float depth buffer matches what glReadPixels
+ * would return. The frame is processed in independent tiles, in parallel,
+ * with SSE2 used for the inner coverage/depth loop when available.
+ */
+
+#ifndef PCL_SIMULATION_DEPTH_RASTERIZER_HPP_
+#define PCL_SIMULATION_DEPTH_RASTERIZER_HPP_
+
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+#include <pcl/pcl_macros.h>
+
+namespace pcl
+{
+  namespace simulation
+  {
+    class PCL_EXPORTS DepthRasterizer
+    {
+      public:
+        typedef boost::shared_ptr<DepthRasterizer> Ptr;
+        typedef boost::shared_ptr<const DepthRasterizer> ConstPtr;
+
+        /**
+         * @param width - width of the full framebuffer in pixels.
+         * @param height - height of the full framebuffer in pixels.
+         * @param z_near - near clip plane distance (meters).
+         * @param z_far - far clip plane distance (meters).
+         */
+        DepthRasterizer (int width, int height, float z_near, float z_far);
+
+        /**
+         * Reset the depth buffer to the far plane and drop queued geometry.
+         */
+        void
+        clear ();
+
+        /**
+         * Set the viewport (in GL window coordinates, origin at the bottom
+         * left) that subsequently added geometry is mapped to. Fragments are
+         * restricted to the viewport, as with the GL frustum clip.
+         */
+        void
+        setViewport (int x, int y, int width, int height);
+
+        /**
+         * Restrict clear and rasterize to a rectangle (GL window coordinates),
+         * as glScissor does. Pixels outside it keep their previous values.
+         * Defaults to the full framebuffer.
+         */
+        void
+        setScissor (int x, int y, int width, int height);
+
+        /**
+         * Set the model-view-projection matrix for subsequently added geometry.
+         */
+        void
+        setTransform (const Eigen::Matrix4f &mvp);
+
+        /**
+         * Queue a convex polygon (triangulated as a fan, as GL_POLYGON).
+         *
+         * @param vertices - xyz triples.
+         * @param num_vertices - number of vertices in the polygon.
+         */
+        void
+        addPolygon (const float *vertices, int num_vertices);
+
+        /**
+         * Queue an indexed triangle list placed in the scene by a model
+         * matrix, which is applied on top of the current transform.
+         *
+         * @param vertices - interleaved vertex data, xyz first.
+         * @param stride - distance between consecutive vertices, in floats.
+         * @param num_vertices - number of vertices.
+         * @param indices - three indices per triangle.
+         * @param num_indices - number of indices.
+         * @param model - model matrix.
+         */
+        void
+        addTriangles (const float *vertices, size_t stride, size_t num_vertices,
+                      const unsigned int *indices, size_t num_indices,
+                      const Eigen::Matrix4f &model);
+
+        /**
+         * Scan-convert all queued geometry and resolve the millimeter depth
+         * image.
+         */
+        void
+        rasterize ();
+
+        /**
+         * Window depth in [0, 1], laid out as glReadPixels would return it
+         * (row 0 is the bottom row of the framebuffer).
+         */
+        const float *
+        getDepthBuffer () const
+        {
+          return (&depth_buffer_[0]);
+        }
+
+        /**
+         * Linear depth in millimeters, row 0 is the top row of the image.
+         * Identical to SimExample::get_depth_image_uint on the float buffer.
+         */
+        const std::vector<unsigned short> &
+        getDepthImage () const
+        {
+          return (depth_image_);
+        }
+
+        int getWidth () const { return (width_); }
+        int getHeight () const { return (height_); }
+
+      private:
+        struct Viewport
+        {
+          int x, y, width, height;
+        };
+
+        struct Triangle
+        {
+          // Fixed-point window coordinates of the vertices.
+          int x[3];
+          int y[3];
+          // Window depth plane: z = z0 + dzdx * (px - x[0]) + dzdy * (py - y[0])
+          // in pixel units.
+          float z0, dzdx, dzdy;
+          // Pixel bounds, inclusive, already clamped to the viewport.
+          int min_x, min_y, max_x, max_y;
+        };
+
+        void
+        addClipPolygon (const Eigen::Vector4f *clip_vertices, int num_vertices);
+
+        void
+        setupTriangle (const Eigen::Vector4f &c0, const Eigen::Vector4f &c1,
+                       const Eigen::Vector4f &c2);
+
+        void
+        rasterizeTile (int tile_x, int tile_y);
+
+        void
+        rasterizeTriangle (const Triangle &tri, int x0, int y0, int x1, int y1);
+
+        int width_;
+        int height_;
+        float z_near_;
+        float z_far_;
+
+        Viewport viewport_;
+        Viewport scissor_;
+        Eigen::Matrix4f mvp_;
+
+        int tiles_x_;
+        int tiles_y_;
+
+        std::vector<Triangle> triangles_;
+        std::vector<std::vector<int> > tile_bins_;
+        // Clip-space vertices of the mesh being added, reused across calls.
+        std::vector<Eigen::Vector4f, Eigen::aligned_allocator<Eigen::Vector4f> > clip_vertices_;
+
+        std::vector<float> depth_buffer_;
+        std::vector<unsigned short> depth_image_;
+
+      public:
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    };
+  } // namespace - simulation
+} // namespace - pcl
+
+#endif
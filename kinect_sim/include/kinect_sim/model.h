@@ -24,10 +24,15 @@
 #include <pcl/PolygonMesh.h>
 #include <kinect_sim/glsl_shader.h>
 
+#include <map>
+#include <mutex>
+
 namespace pcl
 {
   namespace simulation
   {
+    class DepthRasterizer;
+
     typedef struct _SinglePoly
     {
       float* vertices_;
@@ -65,6 +70,19 @@ namespace pcl
       public:
         virtual void draw () = 0;
 
+        /**
+         * Submit the model geometry to the software depth rasterizer. Models
+         * that do not override this are invisible to the software backend.
+         */
+        virtual void rasterize (DepthRasterizer &rasterizer) {}
+
+        /**
+         * Append the scene-frame corners of a box enclosing the model to
+         * corners. Returns false if the model's extent is not known.
+         */
+        virtual bool
+        getBoundingCorners (std::vector<Eigen::Vector3f> *corners) const { return (false); }
+
         typedef boost::shared_ptr<Model> Ptr;
         typedef boost::shared_ptr<const Model> ConstPtr;
     };
@@ -97,6 +115,7 @@ namespace pcl
         PolygonMeshModel(GLenum mode, pcl::PolygonMesh::Ptr plg);
         virtual ~PolygonMeshModel();
         virtual void draw();
+        virtual void rasterize (DepthRasterizer &rasterizer);
 
         typedef boost::shared_ptr<PolygonMeshModel> Ptr;
         typedef boost::shared_ptr<const PolygonMeshModel> ConstPtr;
@@ -118,6 +137,95 @@ namespace pcl
         GLenum mode_;
     };
 
+    /**
+     * A mesh packed once into an interleaved vertex array and a triangle
+     * index array (polygons are triangulated as fans). The GL buffer objects
+     * are created on the first draw in each GL context, so a MeshBuffer can be
+     * built before a context exists and shared by any number of
+     * MeshInstanceModels, including ones drawn by simulators in different
+     * (unshared) contexts or threads.
+     */
+    class PCL_EXPORTS MeshBuffer
+    {
+      public:
+        typedef boost::shared_ptr<MeshBuffer> Ptr;
+        typedef boost::shared_ptr<const MeshBuffer> ConstPtr;
+
+        explicit MeshBuffer (const pcl::PolygonMesh &mesh);
+        ~MeshBuffer ();
+
+        // Draw with the current modelview matrix.
+        void
+        draw ();
+
+        const Vertices &
+        vertices () const { return (vertices_); }
+
+        const std::vector<GLuint> &
+        indices () const { return (indices_); }
+
+        // Axis-aligned bounds of the vertices, in the mesh frame.
+        const Eigen::Vector3f &
+        minPoint () const { return (min_point_); }
+
+        const Eigen::Vector3f &
+        maxPoint () const { return (max_point_); }
+
+      private:
+        // Not copyable, owns GL buffers.
+        MeshBuffer (const MeshBuffer &);
+        MeshBuffer &operator= (const MeshBuffer &);
+
+        // Vertex and index buffer names, valid only in the context that
+        // created them.
+        struct Buffers
+        {
+          GLuint vbo;
+          GLuint ibo;
+        };
+
+        // The buffers for the current context, uploaded if it has none yet.
+        Buffers
+        currentBuffers ();
+
+        Vertices vertices_;
+        std::vector<GLuint> indices_;
+        Eigen::Vector3f min_point_;
+        Eigen::Vector3f max_point_;
+        // Keyed by the native handle of the context.
+        std::map<const void *, Buffers> buffers_;
+        std::mutex buffers_mutex_;
+    };
+
+    /**
+     * A MeshBuffer placed in the scene by a model matrix. Cheap to create per
+     * render, since the vertex data is shared.
+     */
+    class PCL_EXPORTS MeshInstanceModel : public Model
+    {
+      public:
+        typedef boost::shared_ptr<MeshInstanceModel> Ptr;
+        typedef boost::shared_ptr<const MeshInstanceModel> ConstPtr;
+
+        MeshInstanceModel (MeshBuffer::Ptr mesh, const Eigen::Matrix4f &transform);
+
+        virtual void
+        draw ();
+
+        virtual void
+        rasterize (DepthRasterizer &rasterizer);
+
+        virtual bool
+        getBoundingCorners (std::vector<Eigen::Vector3f> *corners) const;
+
+      private:
+        MeshBuffer::Ptr mesh_;
+        Eigen::Matrix4f transform_;
+
+      public:
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    };
+
     class PCL_EXPORTS PointCloudModel : public Model
     {
       public:
@@ -25,6 +25,7 @@
 #include <pcl/range_image/range_image_planar.h>
 #include <pcl/common/transforms.h>
 #include <kinect_sim/camera.h>
+#include <kinect_sim/depth_rasterizer.h>
 #include <kinect_sim/scene.h>
 #include <kinect_sim/glsl_shader.h>
 #include <kinect_sim/sum_reduce.h>
@@ -50,13 +51,18 @@ class PCL_EXPORTS RangeLikelihood {
    * @param col_width  - width of the image for a single particle.
    * @param scene - a pointer to the scene that should be rendered when
    *                computing likelihoods.
+   * @param use_opengl - if false, no OpenGL resources are created and the
+   *                     software rasterizer is always used. Such an object
+   *                     does not need a GL context, so any number of them can
+   *                     render concurrently from different threads.
    *
    */
   RangeLikelihood (int rows,
                    int cols,
                    int row_height,
                    int col_width,
-                   Scene::Ptr scene);
+                   Scene::Ptr scene,
+                   bool use_opengl = true);
 
   /**
    * Destroy the RangeLikelihood object and release any memory allocated.
@@ -77,6 +83,72 @@ class PCL_EXPORTS RangeLikelihood {
                       poses,
                       std::vector<float> &scores);
 
+  /**
+   * Renders a different scene into each tile of the rows x cols render
+   * buffer in a single pass, all seen from the same camera pose. Tile n is
+   * at row n / cols, column n % cols. Tiles beyond scenes.size() are empty.
+   *
+   * @param scenes - at most rows * cols scenes.
+   * @param pose - camera pose shared by all tiles.
+   */
+  void
+  renderScenes (const std::vector<Scene::Ptr> &scenes,
+                const Eigen::Isometry3d &pose);
+
+  /**
+   * Millimeter depth image (row 0 at the top) of a single tile of the last
+   * render, with the same conversion as SimExample::get_depth_image_uint.
+   */
+  void
+  getTileDepthImage (int tile, std::vector<unsigned short> *depth_image);
+
+  /**
+   * Renders scene_ (1 x 1 objects only) from pose, with clearing,
+   * rasterization and readback restricted to the image rectangle covered by
+   * the projection of the scene's bounding boxes. Returns the rectangle's top
+   * left corner (row 0 at the top) and size, and its millimeter depths in
+   * row-major order. The rest of the framebuffer keeps stale contents until
+   * the next full render.
+   *
+   * Falls back to the full frame if some model's extent is not known or the
+   * scene crosses the near plane. Returns false, with an empty rectangle, if
+   * the scene is out of view.
+   */
+  bool
+  renderCropped (const Eigen::Isometry3d &pose, int *x_min, int *y_min,
+                 int *width, int *height, std::vector<unsigned short> *depth_patch);
+
+  /**
+   * Asynchronous depth readback, so that the readback of one render overlaps
+   * the next render. submitDepthReadback queues a copy of the depth buffer of
+   * the last render into one of a ring of pixel buffer objects, followed by a
+   * fence, and returns a ticket without waiting for the copy. The next render
+   * can be issued right away. retrieveDepthImage waits for that copy only,
+   * and converts it as getTileDepthImage does.
+   *
+   * Only for single-tile (1 x 1) objects. Every ticket must be retrieved, and
+   * at most getNumReadbackBuffers () readbacks can be pending at a time.
+   * With the software rasterizer, or without sync object support, the copy
+   * is made when submitting.
+   */
+  int
+  submitDepthReadback ();
+
+  void
+  retrieveDepthImage (int ticket, std::vector<unsigned short> *depth_image);
+
+  /**
+   * Size of the readback ring (2 by default). Only change it when no
+   * readback is pending.
+   */
+  void
+  setNumReadbackBuffers (int num_buffers);
+
+  int
+  getNumReadbackBuffers () const {
+    return static_cast<int> (readback_slots_.size ());
+  }
+
   /**
    * Set the basic camera intrinsic parameters
    */
@@ -170,6 +242,56 @@ class PCL_EXPORTS RangeLikelihood {
     use_color_ = use_color;
   }
 
+  /**
+   * Render depth with the CPU rasterizer instead of OpenGL. Only depth is
+   * produced in this mode: the color buffer is black and likelihoods are
+   * always computed on the CPU.
+   */
+  void
+  setUseSoftwareRasterizer (bool use_software_rasterizer);
+
+  bool
+  getUseOpenGL () const {
+    return use_opengl_;
+  }
+
+  bool
+  getUseSoftwareRasterizer () const {
+    return use_software_rasterizer_;
+  }
+
+  /**
+   * Millimeter depth image (row 0 at the top) of the last software render.
+   * Only valid when the software rasterizer is in use.
+   */
+  const std::vector<unsigned short> &
+  getSoftwareDepthImage () const {
+    return software_rasterizer_->getDepthImage ();
+  }
+
+  /**
+   * Have the OpenGL renderer also write linear millimeter depth to a 16-bit
+   * integer color attachment, flipped on the GPU so that row 0 is at the top
+   * (the layout of getSoftwareDepthImage). Depth images are then read back
+   * as they are, without a conversion pass on the CPU. No effect with the
+   * software rasterizer, which always produces such images.
+   */
+  void
+  setUseLinearDepth (bool use_linear_depth);
+
+  bool
+  getUseLinearDepth () const {
+    return use_linear_depth_;
+  }
+
+  /**
+   * Millimeter depth image of the whole buffer from the last render, in the
+   * layout of getSoftwareDepthImage. Only valid when the software rasterizer
+   * or linear depth is in use.
+   */
+  void
+  getLinearDepthImage (std::vector<unsigned short> *depth_image);
+
   const uint8_t *
   getColorBuffer ();
 
@@ -212,7 +334,56 @@ class PCL_EXPORTS RangeLikelihood {
   void
   setupProjectionMatrix ();
 
+  // Same matrices as the GL path, for the software rasterizer.
+  Eigen::Matrix4f
+  getProjectionMatrix () const;
+
+  Eigen::Matrix4f
+  getModelViewMatrix (const Eigen::Isometry3d &pose) const;
+
+  void
+  renderSoftware (const
+                  std::vector<Eigen::Isometry3d, Eigen::aligned_allocator<Eigen::Isometry3d>>
+                  &poses);
+
+  // Scene drawn into tile n (NULL for an empty tile).
+  Scene *
+  getTileScene (int n);
+
+  // Millimeter depth image of one tile of a GL depth buffer.
+  void
+  convertTileDepth (const float *depth_buffer, int tile,
+                    std::vector<unsigned short> *depth_image) const;
+
+  // Converts a width x height region of a GL depth buffer, starting at its
+  // bottom left pixel src and with rows stride floats apart, to millimeters
+  // with row 0 at the top.
+  void
+  convertDepthRegion (const float *src, int stride, int width, int height,
+                      unsigned short *depth_image) const;
+
+  // Window rectangle (GL coordinates) covered by scene_ seen from pose.
+  // Returns false if it is empty.
+  bool
+  getProjectedBounds (const Eigen::Isometry3d &pose, int *x, int *y,
+                      int *width, int *height);
+
+  void
+  deleteReadbackBuffers ();
+
+  void
+  createLinearDepthBuffers ();
+
+  // Reads a rectangle of the flipped linear depth buffer (y counted from the
+  // top) into depth_image, or into the bound pixel pack buffer if
+  // depth_image is NULL.
+  void
+  readLinearDepth (int x, int y, int width, int height,
+                   unsigned short *depth_image);
+
   Scene::Ptr scene_;
+  // Per-tile scenes while in renderScenes, NULL otherwise.
+  const std::vector<Scene::Ptr> *tile_scenes_;
   int rows_;
   int cols_;
   int row_height_;
@@ -260,13 +431,45 @@ class PCL_EXPORTS RangeLikelihood {
   bool use_instancing_;
   bool generate_color_image_;
   bool use_color_;
+  bool use_software_rasterizer_;
+  bool use_opengl_;
+  bool use_linear_depth_;
+
+  // Scissor rectangle (GL window coordinates) for the next render, while in
+  // renderCropped.
+  bool use_scissor_;
+  int scissor_x_;
+  int scissor_y_;
+  int scissor_width_;
+  int scissor_height_;
+
+  DepthRasterizer::Ptr software_rasterizer_;
 
   gllib::Program::Ptr likelihood_program_;
+  // Linear depth: a GL_R16UI attachment of fbo_, and a flipped copy of it in
+  // linear_depth_fbo_. Created on first use.
+  gllib::Program::Ptr linear_depth_program_;
+  GLuint linear_depth_render_buffer_;
+  GLuint linear_depth_flipped_buffer_;
+  GLuint linear_depth_fbo_;
   GLuint quad_vbo_;
   std::vector<Eigen::Vector3f> vertices_;
   float *score_buffer_;
-  Quad quad_;
-  SumReduce sum_reduce_;
+  // Only created when using OpenGL.
+  boost::shared_ptr<Quad> quad_;
+  boost::shared_ptr<SumReduce> sum_reduce_;
+
+  // One entry of the readback ring. A readback in flight has a fence; one
+  // that completed when it was submitted has its image in depth_image.
+  struct ReadbackSlot {
+    GLuint pbo;
+    GLsync fence;
+    // Ticket of the pending readback, -1 when the slot is free.
+    int ticket;
+    std::vector<unsigned short> depth_image;
+  };
+  std::vector<ReadbackSlot> readback_slots_;
+  int next_readback_ticket_;
 };
 
 template<class T> T
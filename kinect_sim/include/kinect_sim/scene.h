@@ -29,6 +29,16 @@ namespace pcl
       void
       draw ();
 
+      void
+      rasterize (DepthRasterizer &rasterizer);
+
+      /**
+       * Corners of boxes enclosing every model of the scene. Returns false if
+       * some model's extent is not known.
+       */
+      bool
+      getBoundingCorners (std::vector<Eigen::Vector3f> *corners) const;
+
       void
       add (Model::Ptr model);
 
@@ -44,8 +44,18 @@ namespace pcl
         typedef boost::shared_ptr<SimExample> Ptr;
         typedef boost::shared_ptr<const SimExample> ConstPtr;
     	
+        // With use_opengl false, no GL context is created and all rendering
+        // goes through the software rasterizer, so that several SimExamples
+        // can be used concurrently from different threads.
         SimExample (int argc, char** argv,
-    		int height,int width);
+    		int height,int width, bool use_opengl = true);
+        ~SimExample ();
+
+        // Creates the GL context: a hidden GLUT window, or a surfaceless EGL
+        // context that needs no X server (only if built with EGL). EGL is
+        // used when KINECT_SIM_GL_CONTEXT=egl, or when DISPLAY is unset and
+        // KINECT_SIM_GL_CONTEXT is not glut. KINECT_SIM_EGL_DEVICE picks the
+        // GPU (modulo the number of devices), e.g. one per MPI rank.
         void initializeGL (int argc, char** argv);
         
         Scene::Ptr scene_;
@@ -53,6 +63,35 @@ namespace pcl
         RangeLikelihood::Ptr rl_;  
     
         void doSim (Eigen::Isometry3d pose_in);
+        // Renders scene_ restricted to its projected bounding box and returns
+        // the depth image of just that rectangle, with its top left corner.
+        // See RangeLikelihood::renderCropped.
+        bool doSimCropped (Eigen::Isometry3d pose_in, int* x_min, int* y_min,
+                           int* width, int* height,
+                           std::vector<unsigned short>* depth_patch);
+
+        // Batched rendering: each scene is rendered into its own tile of a
+        // batch_rows x batch_cols framebuffer in a single pass. At most
+        // get_batch_size() scenes can be rendered per call.
+        void set_batch_size (int batch_rows, int batch_cols);
+        int get_batch_size () const;
+        void doSimBatch (const std::vector<Scene::Ptr> &scenes,
+                         Eigen::Isometry3d pose_in);
+        // Depth images of the first num_images tiles of the last doSimBatch.
+        void get_depth_images_uint (int num_images,
+                                    std::vector<std::vector<unsigned short>> *depth_images);
+        RangeLikelihood::Ptr batch_rl_;
+
+        // Pipelined rendering: submitSim renders scene_ and queues an
+        // asynchronous readback of its depth image, returning a ticket for
+        // retrieve_depth_image_uint. scene_ can be changed and the next
+        // submitSim issued right away; at most get_num_readback_buffers()
+        // tickets can be outstanding.
+        int submitSim (Eigen::Isometry3d pose_in);
+        void retrieve_depth_image_uint (int ticket,
+                                        std::vector<unsigned short>* depth_img_uint);
+        void set_num_readback_buffers (int num_buffers);
+        int get_num_readback_buffers () const;
     
         void write_score_image(const float* score_buffer,std::string fname);
         void write_depth_image(const float* depth_buffer,std::string fname);
@@ -60,6 +99,10 @@ namespace pcl
         void write_rgb_image(const uint8_t* rgb_buffer,std::string fname);
 
         void get_depth_image_uint(const float* depth_buffer, std::vector<unsigned short>* depth_img_uint);
+        // Depth image of the last doSim, from whichever backend rl_ uses.
+        // With linear depth (see RangeLikelihood::setUseLinearDepth) this is a
+        // plain copy of the rendered image.
+        void get_depth_image_uint(std::vector<unsigned short>* depth_img_uint);
         void get_depth_image_cv(const float* depth_buffer, cv::Mat &depth_image);
     
       private:
@@ -68,6 +111,16 @@ namespace pcl
         // of platter, usually 640x480
         int width_;
         int height_;
+
+        int batch_rows_;
+        int batch_cols_;
+        bool use_opengl_;
+
+        // Returns false if no EGL context could be made current.
+        bool initializeEGL ();
+        // EGLDisplay and EGLContext, when initializeGL used EGL.
+        void *egl_display_;
+        void *egl_context_;
     };
   }
 }
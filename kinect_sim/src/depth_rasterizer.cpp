@@ -0,0 +1,456 @@
+#include <kinect_sim/depth_rasterizer.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace pcl::simulation;
+
+namespace
+{
+  // Tile size, chosen so that a tile of float depth fits comfortably in L1.
+  const int kTileWidth = 64;
+  const int kTileHeight = 32;
+
+  // Sub-pixel precision of the snapped vertex positions (same as Mesa).
+  const int kSubPixelBits = 8;
+  const int kSubPixelOne = 1 << kSubPixelBits;
+  const int kSubPixelHalf = kSubPixelOne / 2;
+
+  // Geometry is clipped against the near plane exactly, and against a guard
+  // band of kGuardBand times the viewport in x and y, which keeps the
+  // fixed-point edge functions well within 64 bits. Anything outside the
+  // viewport proper is discarded by the per-pixel viewport bounds.
+  const float kGuardBand = 16.0f;
+
+  // Edge function magnitude below which the 32-bit SIMD path is safe.
+  const long long kMaxSimdEdgeValue = 1LL << 30;
+
+  const int kMaxClippedVertices = 16;
+
+  // Integer floor division by kSubPixelOne for possibly negative values.
+  inline int
+  floorToPixel (int v)
+  {
+    return (v >> kSubPixelBits);
+  }
+
+  inline bool
+  isTopLeft (int dx, int dy)
+  {
+    // Window coordinates are y-up and triangles are made counter-clockwise,
+    // so left edges point down and top edges point left.
+    return (dy < 0 || (dy == 0 && dx < 0));
+  }
+
+  // Clips a convex polygon in homogeneous coordinates against the plane
+  // dot(plane, v) >= 0.
+  int
+  clipPolygon (const Eigen::Vector4f *in, int num_in, const Eigen::Vector4f &plane,
+               Eigen::Vector4f *out)
+  {
+    int num_out = 0;
+    for (int i = 0; i < num_in; ++i)
+    {
+      const Eigen::Vector4f &a = in[i];
+      const Eigen::Vector4f &b = in[(i + 1) % num_in];
+      float da = plane.dot (a);
+      float db = plane.dot (b);
+      if (da >= 0.0f)
+        out[num_out++] = a;
+      if ((da >= 0.0f) != (db >= 0.0f) && num_out < kMaxClippedVertices)
+      {
+        float t = da / (da - db);
+        out[num_out++] = a + t * (b - a);
+      }
+      if (num_out >= kMaxClippedVertices)
+        break;
+    }
+    return (num_out);
+  }
+} // namespace
+
+pcl::simulation::DepthRasterizer::DepthRasterizer (int width, int height,
+                                                   float z_near, float z_far) :
+  width_ (width), height_ (height), z_near_ (z_near), z_far_ (z_far)
+{
+  viewport_.x = 0;
+  viewport_.y = 0;
+  viewport_.width = width_;
+  viewport_.height = height_;
+  scissor_ = viewport_;
+  mvp_.setIdentity ();
+
+  tiles_x_ = (width_ + kTileWidth - 1) / kTileWidth;
+  tiles_y_ = (height_ + kTileHeight - 1) / kTileHeight;
+  tile_bins_.resize (tiles_x_ * tiles_y_);
+
+  depth_buffer_.resize (width_ * height_, 1.0f);
+  depth_image_.resize (width_ * height_, 0);
+}
+
+void
+pcl::simulation::DepthRasterizer::clear ()
+{
+  for (int y = scissor_.y; y < scissor_.y + scissor_.height; ++y)
+  {
+    float *depth_row = &depth_buffer_[y * width_ + scissor_.x];
+    std::fill (depth_row, depth_row + scissor_.width, 1.0f);
+  }
+  triangles_.clear ();
+  for (size_t i = 0; i < tile_bins_.size (); ++i)
+    tile_bins_[i].clear ();
+}
+
+void
+pcl::simulation::DepthRasterizer::setViewport (int x, int y, int width,
+                                               int height)
+{
+  viewport_.x = x;
+  viewport_.y = y;
+  viewport_.width = width;
+  viewport_.height = height;
+}
+
+void
+pcl::simulation::DepthRasterizer::setScissor (int x, int y, int width,
+                                              int height)
+{
+  scissor_.x = std::max (x, 0);
+  scissor_.y = std::max (y, 0);
+  scissor_.width = std::max (std::min (x + width, width_) - scissor_.x, 0);
+  scissor_.height = std::max (std::min (y + height, height_) - scissor_.y, 0);
+}
+
+void
+pcl::simulation::DepthRasterizer::setTransform (const Eigen::Matrix4f &mvp)
+{
+  mvp_ = mvp;
+}
+
+void
+pcl::simulation::DepthRasterizer::addPolygon (const float *vertices,
+                                              int num_vertices)
+{
+  if (num_vertices < 3)
+    return;
+
+  Eigen::Vector4f clip[kMaxClippedVertices];
+  int num_clip = std::min (num_vertices, kMaxClippedVertices);
+
+  for (int i = 0; i < num_clip; ++i)
+    clip[i] = mvp_ * Eigen::Vector4f (vertices[3 * i + 0], vertices[3 * i + 1],
+                                      vertices[3 * i + 2], 1.0f);
+
+  addClipPolygon (clip, num_clip);
+}
+
+void
+pcl::simulation::DepthRasterizer::addTriangles (const float *vertices,
+                                                size_t stride,
+                                                size_t num_vertices,
+                                                const unsigned int *indices,
+                                                size_t num_indices,
+                                                const Eigen::Matrix4f &model)
+{
+  const Eigen::Matrix4f mvp = mvp_ * model;
+
+  clip_vertices_.resize (num_vertices);
+  for (size_t i = 0; i < num_vertices; ++i)
+  {
+    const float *v = vertices + i * stride;
+    clip_vertices_[i] = mvp * Eigen::Vector4f (v[0], v[1], v[2], 1.0f);
+  }
+
+  Eigen::Vector4f clip[3];
+  for (size_t i = 0; i + 2 < num_indices; i += 3)
+  {
+    clip[0] = clip_vertices_[indices[i + 0]];
+    clip[1] = clip_vertices_[indices[i + 1]];
+    clip[2] = clip_vertices_[indices[i + 2]];
+    addClipPolygon (clip, 3);
+  }
+}
+
+void
+pcl::simulation::DepthRasterizer::addClipPolygon (const Eigen::Vector4f *clip_vertices,
+                                                  int num_vertices)
+{
+  bool inside = true;
+  for (int i = 0; i < num_vertices && inside; ++i)
+  {
+    const Eigen::Vector4f &c = clip_vertices[i];
+    inside = (c[2] + c[3] >= 0.0f) &&
+             std::abs (c[0]) <= kGuardBand * c[3] &&
+             std::abs (c[1]) <= kGuardBand * c[3];
+  }
+
+  if (inside)
+  {
+    for (int i = 1; i + 1 < num_vertices; ++i)
+      setupTriangle (clip_vertices[0], clip_vertices[i], clip_vertices[i + 1]);
+    return;
+  }
+
+  const Eigen::Vector4f planes[5] = {
+    Eigen::Vector4f (0.0f, 0.0f, 1.0f, 1.0f),
+    Eigen::Vector4f (-1.0f, 0.0f, 0.0f, kGuardBand),
+    Eigen::Vector4f (1.0f, 0.0f, 0.0f, kGuardBand),
+    Eigen::Vector4f (0.0f, -1.0f, 0.0f, kGuardBand),
+    Eigen::Vector4f (0.0f, 1.0f, 0.0f, kGuardBand)
+  };
+  Eigen::Vector4f clip_a[kMaxClippedVertices];
+  Eigen::Vector4f clip_b[kMaxClippedVertices];
+  int num_clipped = num_vertices;
+  std::copy (clip_vertices, clip_vertices + num_vertices, clip_a);
+
+  Eigen::Vector4f *src = clip_a;
+  Eigen::Vector4f *dst = clip_b;
+  for (int p = 0; p < 5 && num_clipped >= 3; ++p)
+  {
+    num_clipped = clipPolygon (src, num_clipped, planes[p], dst);
+    std::swap (src, dst);
+  }
+
+  for (int i = 1; i + 1 < num_clipped; ++i)
+    setupTriangle (src[0], src[i], src[i + 1]);
+}
+
+void
+pcl::simulation::DepthRasterizer::setupTriangle (const Eigen::Vector4f &c0,
+                                                 const Eigen::Vector4f &c1,
+                                                 const Eigen::Vector4f &c2)
+{
+  const Eigen::Vector4f *c[3] = {&c0, &c1, &c2};
+  Triangle tri;
+  float wz[3];
+
+  for (int i = 0; i < 3; ++i)
+  {
+    const Eigen::Vector4f &v = *c[i];
+    float inv_w = 1.0f / v[3];
+    float xw = (v[0] * inv_w * 0.5f + 0.5f) * viewport_.width + viewport_.x;
+    float yw = (v[1] * inv_w * 0.5f + 0.5f) * viewport_.height + viewport_.y;
+    tri.x[i] = static_cast<int> (std::floor (xw * kSubPixelOne + 0.5f));
+    tri.y[i] = static_cast<int> (std::floor (yw * kSubPixelOne + 0.5f));
+    wz[i] = v[2] * inv_w * 0.5f + 0.5f;
+  }
+
+  long long area = static_cast<long long> (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) -
+                   static_cast<long long> (tri.x[2] - tri.x[0]) * (tri.y[1] - tri.y[0]);
+  if (area == 0)
+    return;
+
+  // Both faces are drawn (no culling in RangeLikelihood), so make every
+  // triangle counter-clockwise.
+  if (area < 0)
+  {
+    std::swap (tri.x[1], tri.x[2]);
+    std::swap (tri.y[1], tri.y[2]);
+    std::swap (wz[1], wz[2]);
+    area = -area;
+  }
+
+  const double inv_scale = 1.0 / kSubPixelOne;
+  double x10 = (tri.x[1] - tri.x[0]) * inv_scale;
+  double y10 = (tri.y[1] - tri.y[0]) * inv_scale;
+  double x20 = (tri.x[2] - tri.x[0]) * inv_scale;
+  double y20 = (tri.y[2] - tri.y[0]) * inv_scale;
+  double z10 = wz[1] - wz[0];
+  double z20 = wz[2] - wz[0];
+  double inv_area = 1.0 / (x10 * y20 - x20 * y10);
+  tri.z0 = wz[0];
+  tri.dzdx = static_cast<float> ((z10 * y20 - z20 * y10) * inv_area);
+  tri.dzdy = static_cast<float> ((z20 * x10 - z10 * x20) * inv_area);
+
+  int min_xf = std::min (tri.x[0], std::min (tri.x[1], tri.x[2]));
+  int max_xf = std::max (tri.x[0], std::max (tri.x[1], tri.x[2]));
+  int min_yf = std::min (tri.y[0], std::min (tri.y[1], tri.y[2]));
+  int max_yf = std::max (tri.y[0], std::max (tri.y[1], tri.y[2]));
+
+  tri.min_x = std::max (floorToPixel (min_xf), viewport_.x);
+  tri.max_x = std::min (floorToPixel (max_xf), viewport_.x + viewport_.width - 1);
+  tri.min_y = std::max (floorToPixel (min_yf), viewport_.y);
+  tri.max_y = std::min (floorToPixel (max_yf), viewport_.y + viewport_.height - 1);
+  tri.max_x = std::min (tri.max_x, width_ - 1);
+  tri.max_y = std::min (tri.max_y, height_ - 1);
+  tri.min_x = std::max (tri.min_x, 0);
+  tri.min_y = std::max (tri.min_y, 0);
+
+  if (tri.min_x > tri.max_x || tri.min_y > tri.max_y)
+    return;
+
+  // Bin in submission order, so that equal depths resolve like GL_LESS.
+  int index = static_cast<int> (triangles_.size ());
+  triangles_.push_back (tri);
+
+  for (int ty = tri.min_y / kTileHeight; ty <= tri.max_y / kTileHeight; ++ty)
+    for (int tx = tri.min_x / kTileWidth; tx <= tri.max_x / kTileWidth; ++tx)
+      tile_bins_[ty * tiles_x_ + tx].push_back (index);
+}
+
+void
+pcl::simulation::DepthRasterizer::rasterize ()
+{
+  const int num_tiles = tiles_x_ * tiles_y_;
+
+  #pragma omp parallel for schedule(dynamic)
+  for (int tile = 0; tile < num_tiles; ++tile)
+    rasterizeTile (tile % tiles_x_, tile / tiles_x_);
+
+  triangles_.clear ();
+  for (size_t i = 0; i < tile_bins_.size (); ++i)
+    tile_bins_[i].clear ();
+}
+
+void
+pcl::simulation::DepthRasterizer::rasterizeTile (int tile_x, int tile_y)
+{
+  const int x0 = std::max (tile_x * kTileWidth, scissor_.x);
+  const int y0 = std::max (tile_y * kTileHeight, scissor_.y);
+  const int x1 = std::min (std::min ((tile_x + 1) * kTileWidth, width_),
+                           scissor_.x + scissor_.width) - 1;
+  const int y1 = std::min (std::min ((tile_y + 1) * kTileHeight, height_),
+                           scissor_.y + scissor_.height) - 1;
+
+  // Tiles outside the scissor rectangle are left alone.
+  if (x0 > x1 || y0 > y1)
+    return;
+
+  const std::vector<int> &bin = tile_bins_[tile_y * tiles_x_ + tile_x];
+  for (size_t i = 0; i < bin.size (); ++i)
+    rasterizeTriangle (triangles_[bin[i]], x0, y0, x1, y1);
+
+  // Resolve to millimeters, flipping rows the same way as
+  // SimExample::get_depth_image_uint.
+  const float zn = z_near_;
+  const float zf = z_far_;
+  for (int y = y0; y <= y1; ++y)
+  {
+    const float *depth_row = &depth_buffer_[y * width_];
+    unsigned short *image_row = &depth_image_[(height_ - 1 - y) * width_];
+    for (int x = x0; x <= x1; ++x)
+    {
+      float d = depth_row[x];
+      image_row[x] = static_cast<unsigned short> (round (1000 * (-zf * zn /
+                                                  ((zf - zn) * (d - zf / (zf - zn))))));
+    }
+  }
+}
+
+void
+pcl::simulation::DepthRasterizer::rasterizeTriangle (const Triangle &tri,
+                                                     int x0, int y0,
+                                                     int x1, int y1)
+{
+  int min_x = std::max (tri.min_x, x0);
+  int max_x = std::min (tri.max_x, x1);
+  int min_y = std::max (tri.min_y, y0);
+  int max_y = std::min (tri.max_y, y1);
+
+  if (min_x > max_x || min_y > max_y)
+    return;
+
+  // Edge functions E_i(p) = dx_i * (p_y - y_a) - dy_i * (p_x - x_a) for the
+  // edges a -> b, evaluated at pixel centers in fixed point.
+  long long dx[3], dy[3], e_row[3];
+  int bias[3];
+  const long long px0 = (static_cast<long long> (min_x) << kSubPixelBits) + kSubPixelHalf;
+  const long long py0 = (static_cast<long long> (min_y) << kSubPixelBits) + kSubPixelHalf;
+  long long max_edge = 0;
+
+  for (int i = 0; i < 3; ++i)
+  {
+    int a = i;
+    int b = (i + 1) % 3;
+    dx[i] = tri.x[b] - tri.x[a];
+    dy[i] = tri.y[b] - tri.y[a];
+    bias[i] = isTopLeft (static_cast<int> (dx[i]), static_cast<int> (dy[i])) ? 0 : -1;
+    e_row[i] = dx[i] * (py0 - tri.y[a]) - dy[i] * (px0 - tri.x[a]) + bias[i];
+
+    long long span_x = static_cast<long long> (max_x - min_x + 4) << kSubPixelBits;
+    long long span_y = static_cast<long long> (max_y - min_y + 1) << kSubPixelBits;
+    max_edge = std::max (max_edge, std::abs (e_row[i]) + std::abs (dx[i]) * span_y +
+                         std::abs (dy[i]) * span_x);
+  }
+
+  const long long step_x[3] = {-dy[0] * kSubPixelOne, -dy[1] * kSubPixelOne, -dy[2] * kSubPixelOne};
+  const long long step_y[3] = {dx[0] * kSubPixelOne, dx[1] * kSubPixelOne, dx[2] * kSubPixelOne};
+
+  const float x_ref = tri.x[0] / static_cast<float> (kSubPixelOne);
+  const float y_ref = tri.y[0] / static_cast<float> (kSubPixelOne);
+
+#ifdef __SSE2__
+  const bool use_simd = max_edge < kMaxSimdEdgeValue;
+#endif
+
+  for (int y = min_y; y <= max_y; ++y)
+  {
+    float *depth_row = &depth_buffer_[y * width_];
+    const float z_row = tri.z0 + tri.dzdx * (min_x + 0.5f - x_ref) +
+                        tri.dzdy * (y + 0.5f - y_ref);
+    long long e[3] = {e_row[0], e_row[1], e_row[2]};
+    int x = min_x;
+
+#ifdef __SSE2__
+    if (use_simd)
+    {
+      const __m128i minus_one = _mm_set1_epi32 (-1);
+      __m128i ev[3], sv[3];
+      for (int i = 0; i < 3; ++i)
+      {
+        int e32 = static_cast<int> (e[i]);
+        int s32 = static_cast<int> (step_x[i]);
+        ev[i] = _mm_setr_epi32 (e32, e32 + s32, e32 + 2 * s32, e32 + 3 * s32);
+        sv[i] = _mm_set1_epi32 (4 * s32);
+      }
+      const __m128 dzdx = _mm_set1_ps (tri.dzdx);
+      const __m128 zr = _mm_set1_ps (z_row);
+      __m128 offsets = _mm_setr_ps (0.0f, 1.0f, 2.0f, 3.0f);
+      const __m128 four = _mm_set1_ps (4.0f);
+
+      for (; x + 3 <= max_x; x += 4)
+      {
+        __m128i inside = _mm_and_si128 (_mm_cmpgt_epi32 (ev[0], minus_one),
+                                        _mm_and_si128 (_mm_cmpgt_epi32 (ev[1], minus_one),
+                                                       _mm_cmpgt_epi32 (ev[2], minus_one)));
+        if (_mm_movemask_epi8 (inside) != 0)
+        {
+          __m128 z = _mm_add_ps (zr, _mm_mul_ps (dzdx, offsets));
+          __m128 old_z = _mm_loadu_ps (depth_row + x);
+          __m128 mask = _mm_and_ps (_mm_castsi128_ps (inside), _mm_cmplt_ps (z, old_z));
+          _mm_storeu_ps (depth_row + x, _mm_or_ps (_mm_and_ps (mask, z),
+                                                   _mm_andnot_ps (mask, old_z)));
+        }
+        for (int i = 0; i < 3; ++i)
+          ev[i] = _mm_add_epi32 (ev[i], sv[i]);
+        offsets = _mm_add_ps (offsets, four);
+      }
+
+      for (int i = 0; i < 3; ++i)
+        e[i] += step_x[i] * (x - min_x);
+    }
+#endif
+
+    for (; x <= max_x; ++x)
+    {
+      if ((e[0] | e[1] | e[2]) >= 0)
+      {
+        float z = z_row + tri.dzdx * static_cast<float> (x - min_x);
+        if (z < depth_row[x])
+          depth_row[x] = z;
+      }
+      e[0] += step_x[0];
+      e[1] += step_x[1];
+      e[2] += step_x[2];
+    }
+
+    e_row[0] += step_y[0];
+    e_row[1] += step_y[1];
+    e_row[2] += step_y[2];
+  }
+}
@@ -0,0 +1,15 @@
+#version 130
+#extension GL_ARB_explicit_attrib_location : enable
+
+in float EyeDepth;
+
+layout(location = 0) out vec4 FragColor;
+// Depth in millimeters, rounded as SimExample::get_depth_image_uint does.
+layout(location = 1) out uvec4 DepthMillimeters;
+
+void main()
+{
+  FragColor = gl_Color;
+  float depth_mm = clamp(floor(1000.0 * EyeDepth + 0.5), 0.0, 65535.0);
+  DepthMillimeters = uvec4(uint(depth_mm), 0u, 0u, 0u);
+}
@@ -0,0 +1,11 @@
+#version 130
+
+// Distance along the optical axis (eye space -z), in meters.
+out float EyeDepth;
+
+void main()
+{
+  gl_FrontColor = gl_Color;
+  gl_Position = ftransform();
+  EyeDepth = -(gl_ModelViewMatrix * gl_Vertex).z;
+}
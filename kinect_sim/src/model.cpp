@@ -1,6 +1,38 @@
 #include <kinect_sim/model.h>
+#include <kinect_sim/depth_rasterizer.h>
+
+#ifdef KINECT_SIM_HAVE_EGL
+#include <EGL/egl.h>
+#endif
+#if defined(OPENGL_IS_A_FRAMEWORK)
+# include <OpenGL/OpenGL.h>
+#elif !defined(_WIN32)
+# include <GL/glx.h>
+#endif
+
 using namespace pcl::simulation;
 
+namespace
+{
+  // Native handle of the context current on this thread, or NULL.
+  const void *
+  currentContext ()
+  {
+#ifdef KINECT_SIM_HAVE_EGL
+    EGLContext egl_context = eglGetCurrentContext ();
+    if (egl_context != EGL_NO_CONTEXT)
+      return (egl_context);
+#endif
+#if defined(OPENGL_IS_A_FRAMEWORK)
+    return (CGLGetCurrentContext ());
+#elif defined(_WIN32)
+    return (wglGetCurrentContext ());
+#else
+    return (glXGetCurrentContext ());
+#endif
+  }
+}
+
 pcl::simulation::TriangleMeshModel::TriangleMeshModel (pcl::PolygonMesh::Ptr plg)
 {
   Vertices vertices;
@@ -210,6 +242,178 @@ pcl::simulation::PolygonMeshModel::draw ()
   glDisableClientState (GL_VERTEX_ARRAY);
 }
 
+void
+pcl::simulation::PolygonMeshModel::rasterize (DepthRasterizer &rasterizer)
+{
+  for (size_t i = 0; i < polygons.size (); i++)
+    rasterizer.addPolygon (polygons[i].vertices_, polygons[i].nvertices_);
+}
+
+pcl::simulation::MeshBuffer::MeshBuffer (const pcl::PolygonMesh &mesh)
+{
+  bool found_rgb = false;
+  for (size_t i = 0; i < mesh.cloud.fields.size (); ++i)
+    if (mesh.cloud.fields[i].name.compare ("rgb") == 0)
+      found_rgb = true;
+
+  // Vertices are shared between polygons, exactly as in the mesh cloud.
+  if (found_rgb)
+  {
+    pcl::PointCloud<pcl::PointXYZRGB> newcloud;
+    pcl::fromPCLPointCloud2 (mesh.cloud, newcloud);
+    vertices_.reserve (newcloud.points.size ());
+    for (size_t i = 0; i < newcloud.points.size (); ++i)
+      vertices_.push_back (Vertex (newcloud.points[i].getVector3fMap (),
+                                   Eigen::Vector3f (newcloud.points[i].r / 255.0f,
+                                                    newcloud.points[i].g / 255.0f,
+                                                    newcloud.points[i].b / 255.0f)));
+  }
+  else
+  {
+    // Same color as PolygonMeshModel uses for uncolored meshes.
+    pcl::PointCloud<pcl::PointXYZ> newcloud;
+    pcl::fromPCLPointCloud2 (mesh.cloud, newcloud);
+    vertices_.reserve (newcloud.points.size ());
+    for (size_t i = 0; i < newcloud.points.size (); ++i)
+      vertices_.push_back (Vertex (newcloud.points[i].getVector3fMap (),
+                                   Eigen::Vector3f (1.0f, 0.0f, 0.0f)));
+  }
+
+  for (size_t i = 0; i < mesh.polygons.size (); ++i)
+  {
+    const std::vector<uint32_t> &poly = mesh.polygons[i].vertices;
+    for (size_t j = 1; j + 1 < poly.size (); ++j)
+    {
+      indices_.push_back (poly[0]);
+      indices_.push_back (poly[j]);
+      indices_.push_back (poly[j + 1]);
+    }
+  }
+
+  min_point_.setZero ();
+  max_point_.setZero ();
+  if (!vertices_.empty ())
+  {
+    min_point_ = max_point_ = vertices_[0].pos;
+    for (size_t i = 1; i < vertices_.size (); ++i)
+    {
+      min_point_ = min_point_.cwiseMin (vertices_[i].pos);
+      max_point_ = max_point_.cwiseMax (vertices_[i].pos);
+    }
+  }
+}
+
+pcl::simulation::MeshBuffer::~MeshBuffer ()
+{
+  // Buffers of other contexts are freed when those contexts are destroyed.
+  std::map<const void *, Buffers>::iterator it = buffers_.find (currentContext ());
+  if (it == buffers_.end ())
+    return;
+
+  if (glIsBuffer (it->second.vbo) == GL_TRUE)
+    glDeleteBuffers (1, &it->second.vbo);
+
+  if (glIsBuffer (it->second.ibo) == GL_TRUE)
+    glDeleteBuffers (1, &it->second.ibo);
+}
+
+pcl::simulation::MeshBuffer::Buffers
+pcl::simulation::MeshBuffer::currentBuffers ()
+{
+  std::lock_guard<std::mutex> lock (buffers_mutex_);
+  const void *context = currentContext ();
+  std::map<const void *, Buffers>::iterator it = buffers_.find (context);
+
+  // A new context may reuse the handle of a destroyed one, whose names are
+  // then no longer buffers.
+  if (it != buffers_.end () && glIsBuffer (it->second.vbo) == GL_TRUE)
+    return (it->second);
+
+  Buffers buffers;
+  glGenBuffers (1, &buffers.vbo);
+  glBindBuffer (GL_ARRAY_BUFFER, buffers.vbo);
+  glBufferData (GL_ARRAY_BUFFER, vertices_.size () * sizeof (vertices_[0]), &(vertices_[0]), GL_STATIC_DRAW);
+  glBindBuffer (GL_ARRAY_BUFFER, 0);
+
+  glGenBuffers (1, &buffers.ibo);
+  glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, buffers.ibo);
+  glBufferData (GL_ELEMENT_ARRAY_BUFFER, indices_.size () * sizeof (indices_[0]), &(indices_[0]), GL_STATIC_DRAW);
+  glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, 0);
+
+  buffers_[context] = buffers;
+  return (buffers);
+}
+
+void
+pcl::simulation::MeshBuffer::draw ()
+{
+  if (vertices_.empty () || indices_.empty ())
+    return;
+
+  const Buffers buffers = currentBuffers ();
+
+  glEnable (GL_DEPTH_TEST);
+
+  glEnableClientState (GL_VERTEX_ARRAY);
+  glEnableClientState (GL_COLOR_ARRAY);
+  glBindBuffer (GL_ARRAY_BUFFER, buffers.vbo);
+  glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, buffers.ibo);
+
+  glVertexPointer (3, GL_FLOAT, sizeof (Vertex), 0);
+  glColorPointer (3, GL_FLOAT, sizeof (Vertex), reinterpret_cast<GLvoid*> (sizeof (Eigen::Vector3f)));
+  glDrawElements (GL_TRIANGLES, static_cast<GLsizei> (indices_.size ()), GL_UNSIGNED_INT, 0);
+
+  glDisableClientState (GL_VERTEX_ARRAY);
+  glDisableClientState (GL_COLOR_ARRAY);
+  glBindBuffer (GL_ARRAY_BUFFER, 0);
+  glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+pcl::simulation::MeshInstanceModel::MeshInstanceModel (MeshBuffer::Ptr mesh,
+                                                       const Eigen::Matrix4f &transform) :
+  mesh_ (mesh), transform_ (transform)
+{
+}
+
+void
+pcl::simulation::MeshInstanceModel::draw ()
+{
+  glMatrixMode (GL_MODELVIEW);
+  glPushMatrix ();
+  glMultMatrixf (transform_.data ());
+  mesh_->draw ();
+  glPopMatrix ();
+}
+
+bool
+pcl::simulation::MeshInstanceModel::getBoundingCorners (std::vector<Eigen::Vector3f> *corners) const
+{
+  const Eigen::Vector3f &min_point = mesh_->minPoint ();
+  const Eigen::Vector3f &max_point = mesh_->maxPoint ();
+  for (int i = 0; i < 8; ++i)
+  {
+    const Eigen::Vector4f corner ((i & 1) ? max_point[0] : min_point[0],
+                                  (i & 2) ? max_point[1] : min_point[1],
+                                  (i & 4) ? max_point[2] : min_point[2], 1.0f);
+    corners->push_back ((transform_ * corner).head<3> ());
+  }
+  return (true);
+}
+
+void
+pcl::simulation::MeshInstanceModel::rasterize (DepthRasterizer &rasterizer)
+{
+  const Vertices &vertices = mesh_->vertices ();
+  const std::vector<GLuint> &indices = mesh_->indices ();
+
+  if (vertices.empty () || indices.empty ())
+    return;
+
+  rasterizer.addTriangles (vertices[0].pos.data (), sizeof (Vertex) / sizeof (float),
+                           vertices.size (), &indices[0], indices.size (),
+                           transform_);
+}
+
 pcl::simulation::PointCloudModel::PointCloudModel (GLenum mode, pcl::PointCloud<pcl::PointXYZRGB>::Ptr pc) : mode_ (mode)
 {
   nvertices_ = pc->points.size ();
@@ -1,4 +1,5 @@
 #include <GL/glew.h>
+#include <string.h>
 #include <time.h>
 
 #include <pcl/pcl_config.h>
@@ -29,6 +30,10 @@ const string kComputeScoreVertFile =  ros::package::getPath("kinect_sim") +
                                       "/src/compute_score.vert";
 const string kComputeScoreFragFile =  ros::package::getPath("kinect_sim") +
                                       "/src/compute_score.frag";
+const string kLinearDepthVertFile =  ros::package::getPath("kinect_sim") +
+                                     "/src/linear_depth.vert";
+const string kLinearDepthFragFile =  ros::package::getPath("kinect_sim") +
+                                     "/src/linear_depth.frag";
 
 // 301 values, 0.0 uniform  1.0 normal. properly truncated/normalized
 float normal_sigma0x5_normal1x0_range0to3_step0x01[] = {1.59576912f, 1.59545000f, 1.59449302f, 1.59289932f, 1.59067083f,
@@ -155,8 +160,10 @@ display_tic_toc (vector<double> &tic_toc, const string &fun_name) {
 }
 
 pcl::simulation::RangeLikelihood::RangeLikelihood (int rows, int cols,
-                                                   int row_height, int col_width, Scene::Ptr scene) :
-  scene_(scene), rows_(rows), cols_(cols), row_height_(row_height),
+                                                   int row_height, int col_width, Scene::Ptr scene,
+                                                   bool use_opengl) :
+  scene_(scene), tile_scenes_(NULL), rows_(rows), cols_(cols),
+  row_height_(row_height),
   col_width_(col_width),
   depth_buffer_dirty_(true),
   color_buffer_dirty_(true),
@@ -173,13 +180,24 @@ pcl::simulation::RangeLikelihood::RangeLikelihood (int rows, int cols,
   aggregate_on_cpu_ (false),
   use_instancing_ (false),
   use_color_ (true),
-  sum_reduce_ (cols *col_width, rows *row_height, max_level (col_width,
-                                                             row_height)) {
+  use_software_rasterizer_ (false),
+  use_opengl_ (use_opengl),
+  use_linear_depth_ (false),
+  use_scissor_ (false),
+  scissor_x_ (0),
+  scissor_y_ (0),
+  scissor_width_ (0),
+  scissor_height_ (0),
+  linear_depth_render_buffer_ (0),
+  linear_depth_flipped_buffer_ (0),
+  linear_depth_fbo_ (0),
+  next_readback_ticket_ (0) {
   height_ = rows_ * row_height;
   width_ = cols_ * col_width;
 
   depth_buffer_ = new float[width_ * height_];
   color_buffer_ = new uint8_t[width_ * height_ * 3];
+  setNumReadbackBuffers (2);
 
   // Set Default Camera Intrinstic Parameters. techquad
   // Correspond closely to those stated here:
@@ -208,6 +226,17 @@ pcl::simulation::RangeLikelihood::RangeLikelihood (int rows, int cols,
   assert (height > 0 && height <= 8192 && width > 0 && width <= 8192);
   // throw std::runtime_error "
 
+  score_buffer_ = new float[width_ * height_];
+
+  if (!use_opengl_) {
+    setUseSoftwareRasterizer (true);
+    return;
+  }
+
+  quad_.reset (new Quad);
+  sum_reduce_.reset (new SumReduce (width, height, max_level (col_width,
+                                                              row_height)));
+
   // Allocate framebuffer
   glGenRenderbuffers (1, &depth_render_buffer_);
   glBindRenderbuffer (GL_RENDERBUFFER, depth_render_buffer_);
@@ -345,12 +374,18 @@ pcl::simulation::RangeLikelihood::RangeLikelihood (int rows, int cols,
 
   // Go back to the default pipeline
   glUseProgram (0);
-
-  score_buffer_ = new float[width_ * height_];
-
 }
 
 pcl::simulation::RangeLikelihood::~RangeLikelihood () {
+  delete [] depth_buffer_;
+  delete [] color_buffer_;
+  delete [] score_buffer_;
+
+  if (!use_opengl_) {
+    return;
+  }
+
+  deleteReadbackBuffers ();
   glDeleteBuffers (1, &quad_vbo_);
   glDeleteTextures (1, &depth_texture_);
   glDeleteTextures (1, &color_texture_);
@@ -362,10 +397,9 @@ pcl::simulation::RangeLikelihood::~RangeLikelihood () {
   glDeleteFramebuffers (1, &score_fbo_);
   glDeleteRenderbuffers (1, &depth_render_buffer_);
   glDeleteRenderbuffers (1, &color_render_buffer_);
-
-  delete [] depth_buffer_;
-  delete [] color_buffer_;
-  delete [] score_buffer_;
+  glDeleteFramebuffers (1, &linear_depth_fbo_);
+  glDeleteRenderbuffers (1, &linear_depth_render_buffer_);
+  glDeleteRenderbuffers (1, &linear_depth_flipped_buffer_);
 }
 
 double
@@ -381,6 +415,12 @@ pcl::simulation::RangeLikelihood::setupProjectionMatrix () {
   glMatrixMode (GL_PROJECTION);
   glLoadIdentity ();
 
+  Eigen::Matrix4f m = getProjectionMatrix ();
+  glMultMatrixf (m.data ());
+}
+
+Eigen::Matrix4f
+pcl::simulation::RangeLikelihood::getProjectionMatrix () const {
   // Prepare scaled simulated camera projection matrix
   float sx = static_cast<float> (camera_width_) / static_cast<float>
              (col_width_);
@@ -393,26 +433,31 @@ pcl::simulation::RangeLikelihood::setupProjectionMatrix () {
   float fy = camera_fy_ / sy;
   float cx = camera_cx_ / sx;
   float cy = camera_cy_ / sy;
-  float m[16];
   float z_nf = (z_near_ - z_far_);
 
-  m[0] = 2.0f * fx / width;
-  m[4] = 0;
-  m[ 8] = 1.0f - (2 * cx / width);
-  m[12] = 0;
-  m[1] = 0;
-  m[5] = 2.0f * fy / height;
-  m[ 9] = 1.0f - (2 * cy / height);
-  m[13] = 0;
-  m[2] = 0;
-  m[6] = 0;
-  m[10] = (z_far_ + z_near_) / z_nf;
-  m[14] = 2.0f * z_near_ * z_far_ / z_nf;
-  m[3] = 0;
-  m[7] = 0;
-  m[11] = -1.0f;
-  m[15] = 0;
-  glMultMatrixf (m);
+  // Column-major, as expected by glMultMatrixf.
+  Eigen::Matrix4f m = Eigen::Matrix4f::Zero ();
+  m(0, 0) = 2.0f * fx / width;
+  m(0, 2) = 1.0f - (2 * cx / width);
+  m(1, 1) = 2.0f * fy / height;
+  m(1, 2) = 1.0f - (2 * cy / height);
+  m(2, 2) = (z_far_ + z_near_) / z_nf;
+  m(2, 3) = 2.0f * z_near_ * z_far_ / z_nf;
+  m(3, 2) = -1.0f;
+  return m;
+}
+
+Eigen::Matrix4f
+pcl::simulation::RangeLikelihood::getModelViewMatrix (
+  const Eigen::Isometry3d &pose) const {
+  // Z-up, X-forward to OpenGL Z-out, Y-up, followed by the inverse camera
+  // pose, exactly as drawParticles and applyCameraTransform do.
+  Eigen::Matrix4f T;
+  T <<  0, -1, 0, 0,
+  0,  0, 1, 0,
+  -1, 0, 0, 0,
+  0,  0, 0, 1;
+  return T * (pose.matrix ().inverse ()).cast<float> ();
 }
 
 void
@@ -474,10 +519,13 @@ pcl::simulation::RangeLikelihood::drawParticles (
       glMultMatrixf (T);
 
       // Apply camera transformation
+      Scene *scene = getTileScene (n);
       applyCameraTransform (poses[n++]);
 
       // Draw the planes in each location:
-      scene_->draw ();
+      if (scene != NULL) {
+        scene->draw ();
+      }
     }
   }
 }
@@ -1236,8 +1284,9 @@ RangeLikelihood::computeLikelihoods (float *reference,
 #endif
   // The depth image is now in depth_texture_
 
-  // Compute likelihoods
-  if (compute_likelihood_on_cpu_) {
+  // Compute likelihoods. The software rasterizer leaves no depth texture for
+  // the shader, so it always scores on the CPU.
+  if (compute_likelihood_on_cpu_ || use_software_rasterizer_) {
     computeScores (reference, scores);
   } else {
     computeScoresShader (reference);
@@ -1259,7 +1308,7 @@ RangeLikelihood::computeLikelihoods (float *reference,
     //   int reduced_row_height = row_height_ >> levels;
     //
     //   float *score_sum = new float[reduced_width * reduced_height];
-    //   sum_reduce_.sum (score_texture_, score_sum);
+    //   sum_reduce_->sum (score_texture_, score_sum);
     //
     //   for (int n = 0, row = 0; row < reduced_height; ++row) {
     //     for (int col = 0; col < reduced_width; ++col, ++n) {
@@ -1339,7 +1388,7 @@ pcl::simulation::RangeLikelihood::computeScoresShader (float *reference) {
   glActiveTexture (GL_TEXTURE2);
   glBindTexture (GL_TEXTURE_2D, likelihood_texture_);
 
-  quad_.render ();
+  quad_->render ();
   glUseProgram (0);
 
   glBindFramebuffer (GL_FRAMEBUFFER, 0);
@@ -1363,10 +1412,482 @@ pcl::simulation::RangeLikelihood::computeScoresShader (float *reference) {
 
 }
 
+Scene *
+RangeLikelihood::getTileScene (int n) {
+  if (tile_scenes_ == NULL) {
+    return scene_.get ();
+  }
+
+  if (n < static_cast<int> (tile_scenes_->size ())) {
+    return (*tile_scenes_)[n].get ();
+  }
+
+  return NULL;
+}
+
+void
+RangeLikelihood::renderScenes (const std::vector<Scene::Ptr> &scenes,
+                               const Eigen::Isometry3d &pose) {
+  assert (static_cast<int> (scenes.size ()) <= rows_ * cols_);
+
+  std::vector<Eigen::Isometry3d, Eigen::aligned_allocator<Eigen::Isometry3d>>
+                                                                           poses (rows_ * cols_, pose);
+  tile_scenes_ = &scenes;
+  render (poses);
+  tile_scenes_ = NULL;
+}
+
+void
+RangeLikelihood::getTileDepthImage (int tile,
+                                    std::vector<unsigned short> *depth_image) {
+  assert (tile >= 0 && tile < rows_ * cols_);
+  depth_image->resize (row_height_ * col_width_);
+
+  // Tile rows are counted from the bottom of the framebuffer, image rows
+  // from the top.
+  const int tile_row = tile / cols_;
+  const int tile_col = tile % cols_;
+
+  if (use_software_rasterizer_) {
+    const std::vector<unsigned short> &image = software_rasterizer_->getDepthImage ();
+    const int first_row = (rows_ - 1 - tile_row) * row_height_;
+
+    for (int y = 0; y < row_height_; ++y) {
+      const unsigned short *src = &image[(first_row + y) * width_ + tile_col *
+                                                                     col_width_];
+      std::copy (src, src + col_width_, depth_image->begin () + y * col_width_);
+    }
+
+    return;
+  }
+
+  if (use_linear_depth_) {
+    readLinearDepth (tile_col * col_width_, (rows_ - 1 - tile_row) * row_height_,
+                     col_width_, row_height_, &(*depth_image)[0]);
+    return;
+  }
+
+  convertTileDepth (getDepthBuffer (), tile, depth_image);
+}
+
+void
+RangeLikelihood::setUseLinearDepth (bool use_linear_depth) {
+  use_linear_depth_ = use_linear_depth && use_opengl_;
+
+  if (use_linear_depth_ && linear_depth_fbo_ == 0) {
+    createLinearDepthBuffers ();
+  }
+}
+
+void
+RangeLikelihood::createLinearDepthBuffers () {
+  glGenRenderbuffers (1, &linear_depth_render_buffer_);
+  glBindRenderbuffer (GL_RENDERBUFFER, linear_depth_render_buffer_);
+  glRenderbufferStorage (GL_RENDERBUFFER, GL_R16UI, width_, height_);
+  glGenRenderbuffers (1, &linear_depth_flipped_buffer_);
+  glBindRenderbuffer (GL_RENDERBUFFER, linear_depth_flipped_buffer_);
+  glRenderbufferStorage (GL_RENDERBUFFER, GL_R16UI, width_, height_);
+  glBindRenderbuffer (GL_RENDERBUFFER, 0);
+
+  glBindFramebuffer (GL_FRAMEBUFFER, fbo_);
+  glFramebufferRenderbuffer (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
+                             GL_RENDERBUFFER, linear_depth_render_buffer_);
+  glGenFramebuffers (1, &linear_depth_fbo_);
+  glBindFramebuffer (GL_FRAMEBUFFER, linear_depth_fbo_);
+  glFramebufferRenderbuffer (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                             GL_RENDERBUFFER, linear_depth_flipped_buffer_);
+  glBindFramebuffer (GL_FRAMEBUFFER, 0);
+
+  if (gllib::getGLError () != GL_NO_ERROR) {
+    std::cerr <<
+              "RangeLikelihood::createLinearDepthBuffers: Failed initializing OpenGL buffers"
+              << std::endl;
+    exit (-1);
+  }
+
+  linear_depth_program_ = gllib::Program::Ptr (new gllib::Program ());
+
+  if (!linear_depth_program_->addShaderFile (kLinearDepthVertFile.c_str (),
+                                             gllib::VERTEX)) {
+    std::cout << "Failed loading linear depth vertex shader" << std::endl;
+    exit (-1);
+  }
+
+  if (!linear_depth_program_->addShaderFile (kLinearDepthFragFile.c_str (),
+                                             gllib::FRAGMENT)) {
+    std::cout << "Failed loading linear depth fragment shader" << std::endl;
+    exit (-1);
+  }
+
+  linear_depth_program_->link ();
+  glUseProgram (0);
+}
+
+void
+RangeLikelihood::readLinearDepth (int x, int y, int width, int height,
+                                  unsigned short *depth_image) {
+  GLint old_read_buffer;
+  GLint old_pack_alignment;
+  glGetIntegerv (GL_READ_BUFFER, &old_read_buffer);
+  glGetIntegerv (GL_PACK_ALIGNMENT, &old_pack_alignment);
+
+  // The flipped buffer has image row 0 at the bottom, where glReadPixels
+  // starts, so rows come out top to bottom.
+  glBindFramebuffer (GL_FRAMEBUFFER, linear_depth_fbo_);
+  glReadBuffer (GL_COLOR_ATTACHMENT0);
+  glPixelStorei (GL_PACK_ALIGNMENT, 2);
+  glReadPixels (x, y, width, height, GL_RED_INTEGER, GL_UNSIGNED_SHORT,
+                depth_image);
+  glPixelStorei (GL_PACK_ALIGNMENT, old_pack_alignment);
+  glBindFramebuffer (GL_FRAMEBUFFER, 0);
+  glReadBuffer (old_read_buffer);
+
+  if (gllib::getGLError () != GL_NO_ERROR) {
+    std::cerr << "GL Error: RangeLikelihood::readLinearDepth" << std::endl;
+  }
+}
+
+void
+RangeLikelihood::getLinearDepthImage (std::vector<unsigned short> *depth_image) {
+  if (use_software_rasterizer_) {
+    *depth_image = software_rasterizer_->getDepthImage ();
+    return;
+  }
+
+  assert (use_linear_depth_);
+  depth_image->resize (width_ * height_);
+  readLinearDepth (0, 0, width_, height_, &(*depth_image)[0]);
+}
+
+void
+RangeLikelihood::convertTileDepth (const float *depth_buffer, int tile,
+                                   std::vector<unsigned short> *depth_image) const {
+  depth_image->resize (row_height_ * col_width_);
+  const int tile_row = tile / cols_;
+  const int tile_col = tile % cols_;
+  convertDepthRegion (&depth_buffer[tile_row * row_height_ * width_ + tile_col *
+                                                                     col_width_],
+                      width_, col_width_, row_height_, &(*depth_image)[0]);
+}
+
+void
+RangeLikelihood::convertDepthRegion (const float *src, int stride, int width,
+                                     int height, unsigned short *depth_image) const {
+  const float zn = z_near_;
+  const float zf = z_far_;
+
+  #pragma omp parallel for
+  for (int y = 0; y < height; ++y) {
+    const float *src_row = &src[(height - 1 - y) * stride];
+
+    for (int x = 0; x < width; ++x) {
+      float d = src_row[x];
+      depth_image[y * width + x] = static_cast<unsigned short> (round (
+                                                                  1000 * (-zf * zn / ((zf - zn) * (d - zf / (zf - zn))))));
+    }
+  }
+}
+
+bool
+RangeLikelihood::getProjectedBounds (const Eigen::Isometry3d &pose, int *x,
+                                     int *y, int *width, int *height) {
+  std::vector<Eigen::Vector3f> corners;
+
+  if (!scene_->getBoundingCorners (&corners)) {
+    *x = 0;
+    *y = 0;
+    *width = width_;
+    *height = height_;
+    return true;
+  }
+
+  const Eigen::Matrix4f mvp = getProjectionMatrix () * getModelViewMatrix (
+                                pose);
+  float x_min = std::numeric_limits<float>::max ();
+  float y_min = std::numeric_limits<float>::max ();
+  float x_max = -std::numeric_limits<float>::max ();
+  float y_max = -std::numeric_limits<float>::max ();
+
+  for (size_t ii = 0; ii < corners.size (); ++ii) {
+    const Eigen::Vector4f clip = mvp * corners[ii].homogeneous ();
+
+    // A box crossing the near plane has no bounded projection.
+    if (clip[3] < z_near_) {
+      *x = 0;
+      *y = 0;
+      *width = width_;
+      *height = height_;
+      return true;
+    }
+
+    const float window_x = (clip[0] / clip[3] * 0.5f + 0.5f) * width_;
+    const float window_y = (clip[1] / clip[3] * 0.5f + 0.5f) * height_;
+    x_min = std::min (x_min, window_x);
+    x_max = std::max (x_max, window_x);
+    y_min = std::min (y_min, window_y);
+    y_max = std::max (y_max, window_y);
+  }
+
+  // One pixel of margin for fragments whose centers round the other way.
+  const int x_begin = std::max (static_cast<int> (floor (x_min)) - 1, 0);
+  const int y_begin = std::max (static_cast<int> (floor (y_min)) - 1, 0);
+  const int x_end = std::min (static_cast<int> (ceil (x_max)) + 1, width_);
+  const int y_end = std::min (static_cast<int> (ceil (y_max)) + 1, height_);
+  *x = x_begin;
+  *y = y_begin;
+  *width = std::max (x_end - x_begin, 0);
+  *height = std::max (y_end - y_begin, 0);
+  return *width > 0 && *height > 0;
+}
+
+bool
+RangeLikelihood::renderCropped (const Eigen::Isometry3d &pose, int *x_min,
+                                int *y_min, int *width, int *height,
+                                std::vector<unsigned short> *depth_patch) {
+  assert (rows_ == 1 && cols_ == 1);
+  int x = 0;
+  int y = 0;
+
+  if (!getProjectedBounds (pose, &x, &y, width, height)) {
+    *x_min = 0;
+    *y_min = 0;
+    *width = 0;
+    *height = 0;
+    depth_patch->clear ();
+    return false;
+  }
+
+  // Image rows are counted from the top.
+  *x_min = x;
+  *y_min = height_ - y - *height;
+  depth_patch->resize (*width * *height);
+
+  std::vector<Eigen::Isometry3d, Eigen::aligned_allocator<Eigen::Isometry3d>>
+                                                                           poses (1, pose);
+  use_scissor_ = true;
+  scissor_x_ = x;
+  scissor_y_ = y;
+  scissor_width_ = *width;
+  scissor_height_ = *height;
+  render (poses);
+  use_scissor_ = false;
+
+  if (use_software_rasterizer_) {
+    const std::vector<unsigned short> &image = software_rasterizer_->getDepthImage ();
+
+    for (int row = 0; row < *height; ++row) {
+      const unsigned short *src = &image[(*y_min + row) * width_ + x];
+      std::copy (src, src + *width, depth_patch->begin () + row * *width);
+    }
+  } else if (use_linear_depth_) {
+    readLinearDepth (x, *y_min, *width, *height, &(*depth_patch)[0]);
+  } else {
+    std::vector<float> depth_buffer (*width * *height);
+    glBindFramebuffer (GL_FRAMEBUFFER, fbo_);
+    glReadPixels (x, y, *width, *height, GL_DEPTH_COMPONENT, GL_FLOAT,
+                  &depth_buffer[0]);
+    glBindFramebuffer (GL_FRAMEBUFFER, 0);
+
+    if (gllib::getGLError () != GL_NO_ERROR) {
+      std::cerr << "GL Error: RangeLikelihood::renderCropped" << std::endl;
+    }
+
+    convertDepthRegion (&depth_buffer[0], *width, *width, *height,
+                        &(*depth_patch)[0]);
+  }
+
+  return true;
+}
+
+void
+RangeLikelihood::setNumReadbackBuffers (int num_buffers) {
+  assert (num_buffers > 0);
+
+  if (use_opengl_) {
+    deleteReadbackBuffers ();
+  }
+
+  ReadbackSlot empty_slot;
+  empty_slot.pbo = 0;
+  empty_slot.fence = 0;
+  empty_slot.ticket = -1;
+  readback_slots_.assign (num_buffers, empty_slot);
+}
+
+void
+RangeLikelihood::deleteReadbackBuffers () {
+  for (size_t ii = 0; ii < readback_slots_.size (); ++ii) {
+    ReadbackSlot &slot = readback_slots_[ii];
+
+    if (slot.fence) {
+      glDeleteSync (slot.fence);
+      slot.fence = 0;
+    }
+
+    if (slot.pbo) {
+      glDeleteBuffers (1, &slot.pbo);
+      slot.pbo = 0;
+    }
+  }
+}
+
+int
+RangeLikelihood::submitDepthReadback () {
+  assert (rows_ == 1 && cols_ == 1);
+  const int ticket = next_readback_ticket_++;
+  ReadbackSlot &slot = readback_slots_[ticket % readback_slots_.size ()];
+  // The previous readback in this slot must have been retrieved.
+  assert (slot.ticket == -1);
+  slot.ticket = ticket;
+
+  if (use_software_rasterizer_) {
+    slot.depth_image = software_rasterizer_->getDepthImage ();
+    return ticket;
+  }
+
+  if (!GLEW_ARB_sync || !GLEW_ARB_pixel_buffer_object) {
+    getTileDepthImage (0, &slot.depth_image);
+    return ticket;
+  }
+
+  if (slot.pbo == 0) {
+    glGenBuffers (1, &slot.pbo);
+    glBindBuffer (GL_PIXEL_PACK_BUFFER, slot.pbo);
+    glBufferData (GL_PIXEL_PACK_BUFFER, sizeof (float) * width_ * height_, NULL,
+                  GL_STREAM_READ);
+  } else {
+    glBindBuffer (GL_PIXEL_PACK_BUFFER, slot.pbo);
+  }
+
+  // With a pack buffer bound, glReadPixels only queues the copy. Later draws
+  // into fbo_ are ordered after it, so the framebuffer can be reused at once.
+  if (use_linear_depth_) {
+    readLinearDepth (0, 0, width_, height_, NULL);
+  } else {
+    glBindFramebuffer (GL_FRAMEBUFFER, fbo_);
+    glReadPixels (0, 0, width_, height_, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+    glBindFramebuffer (GL_FRAMEBUFFER, 0);
+  }
+
+  glBindBuffer (GL_PIXEL_PACK_BUFFER, 0);
+  slot.fence = glFenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  glFlush ();
+
+  if (gllib::getGLError () != GL_NO_ERROR) {
+    std::cerr << "GL Error: RangeLikelihood::submitDepthReadback" << std::endl;
+  }
+
+  return ticket;
+}
+
+void
+RangeLikelihood::retrieveDepthImage (int ticket,
+                                     std::vector<unsigned short> *depth_image) {
+  ReadbackSlot &slot = readback_slots_[ticket % readback_slots_.size ()];
+  assert (slot.ticket == ticket);
+  slot.ticket = -1;
+
+  if (!slot.fence) {
+    depth_image->swap (slot.depth_image);
+    return;
+  }
+
+  GLenum wait_status = GL_TIMEOUT_EXPIRED;
+
+  while (wait_status == GL_TIMEOUT_EXPIRED) {
+    wait_status = glClientWaitSync (slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                    1000000);
+  }
+
+  glDeleteSync (slot.fence);
+  slot.fence = 0;
+
+  if (wait_status == GL_WAIT_FAILED) {
+    std::cerr << "GL Error: RangeLikelihood::retrieveDepthImage - wait failed"
+              << std::endl;
+  }
+
+  glBindBuffer (GL_PIXEL_PACK_BUFFER, slot.pbo);
+  const void *buffer = glMapBuffer (GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+
+  if (buffer != NULL && use_linear_depth_) {
+    const unsigned short *linear_depth = static_cast<const unsigned short *>
+                                         (buffer);
+    depth_image->assign (linear_depth, linear_depth + width_ * height_);
+    glUnmapBuffer (GL_PIXEL_PACK_BUFFER);
+  } else if (buffer != NULL) {
+    convertTileDepth (static_cast<const float *> (buffer), 0, depth_image);
+    glUnmapBuffer (GL_PIXEL_PACK_BUFFER);
+  } else {
+    std::cerr << "GL Error: RangeLikelihood::retrieveDepthImage - map failed"
+              << std::endl;
+    depth_image->assign (row_height_ * col_width_, 0);
+  }
+
+  glBindBuffer (GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void
+RangeLikelihood::setUseSoftwareRasterizer (bool use_software_rasterizer) {
+  // Without OpenGL resources, the software rasterizer is the only backend.
+  use_software_rasterizer_ = use_software_rasterizer || !use_opengl_;
+
+  if (use_software_rasterizer_ && !software_rasterizer_) {
+    software_rasterizer_ = DepthRasterizer::Ptr (new DepthRasterizer (width_,
+                                                                      height_, z_near_, z_far_));
+  }
+
+  depth_buffer_dirty_ = true;
+  color_buffer_dirty_ = true;
+}
+
+void
+RangeLikelihood::renderSoftware (const
+                                 std::vector<Eigen::Isometry3d, Eigen::aligned_allocator<Eigen::Isometry3d>>
+                                 &poses) {
+  const Eigen::Matrix4f projection = getProjectionMatrix ();
+
+  if (use_scissor_) {
+    software_rasterizer_->setScissor (scissor_x_, scissor_y_, scissor_width_,
+                                      scissor_height_);
+  } else {
+    software_rasterizer_->setScissor (0, 0, width_, height_);
+  }
+
+  software_rasterizer_->clear ();
+
+  int n = 0;
+
+  for (int i = 0; i < rows_; ++i) {
+    for (int j = 0; j < cols_; ++j) {
+      software_rasterizer_->setViewport (j * col_width_, i * row_height_,
+                                         col_width_, row_height_);
+      Scene *scene = getTileScene (n);
+      software_rasterizer_->setTransform (projection * getModelViewMatrix (
+                                            poses[n++]));
+
+      if (scene != NULL) {
+        scene->rasterize (*software_rasterizer_);
+      }
+    }
+  }
+
+  software_rasterizer_->rasterize ();
+
+  color_buffer_dirty_ = true;
+  depth_buffer_dirty_ = true;
+  score_buffer_dirty_ = true;
+}
+
 void
 RangeLikelihood::render (const
                          std::vector<Eigen::Isometry3d, Eigen::aligned_allocator<Eigen::Isometry3d>>
                          &poses) {
+  if (use_software_rasterizer_) {
+    renderSoftware (poses);
+    return;
+  }
+
   if (gllib::getGLError () != GL_NO_ERROR) {
     std::cerr << "GL Error: RangeLikelihood::render - enter" << std::endl;
   }
@@ -1386,7 +1907,13 @@ RangeLikelihood::render (const
 
   glBindFramebuffer (GL_FRAMEBUFFER, fbo_);
 
-  if (use_color_) {
+  if (use_linear_depth_) {
+    const GLenum draw_buffers[2] = {
+      static_cast<GLenum> (use_color_ ? GL_COLOR_ATTACHMENT0 : GL_NONE),
+      GL_COLOR_ATTACHMENT1
+    };
+    glDrawBuffers (2, draw_buffers);
+  } else if (use_color_) {
     glDrawBuffer (GL_COLOR_ATTACHMENT0);
   } else {
     glDrawBuffer (GL_NONE);
@@ -1411,10 +1938,26 @@ RangeLikelihood::render (const
   // Render
   glPushAttrib (GL_ALL_ATTRIB_BITS);
   glEnable (GL_COLOR_MATERIAL);
+
+  if (use_scissor_) {
+    glEnable (GL_SCISSOR_TEST);
+    glScissor (scissor_x_, scissor_y_, scissor_width_, scissor_height_);
+  }
+
   glClearColor (0.0f, 0.0f, 0.0f, 0.0f);
   glClearDepth (1.0);
   glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+  if (use_linear_depth_) {
+    // glClear leaves integer attachments undefined. Empty pixels are at the
+    // far plane, as in the float depth conversion.
+    const GLuint far_depth[4] = {
+      static_cast<GLuint> (round (1000 * z_far_)), 0, 0, 0
+    };
+    glClearBufferuiv (GL_COLOR, 1, far_depth);
+    linear_depth_program_->use ();
+  }
+
   // Setup projection matrix
   setupProjectionMatrix ();
 
@@ -1424,6 +1967,27 @@ RangeLikelihood::render (const
   drawParticles (poses);
 
   glPopAttrib ();
+
+  if (use_linear_depth_) {
+    glUseProgram (0);
+    // Flip vertically into linear_depth_fbo_, so that readbacks need no
+    // reordering.
+    glBindFramebuffer (GL_READ_FRAMEBUFFER, fbo_);
+    glReadBuffer (GL_COLOR_ATTACHMENT1);
+    glBindFramebuffer (GL_DRAW_FRAMEBUFFER, linear_depth_fbo_);
+    glDrawBuffer (GL_COLOR_ATTACHMENT0);
+    if (use_scissor_) {
+      glBlitFramebuffer (scissor_x_, scissor_y_, scissor_x_ + scissor_width_,
+                         scissor_y_ + scissor_height_, scissor_x_,
+                         height_ - scissor_y_, scissor_x_ + scissor_width_,
+                         height_ - scissor_y_ - scissor_height_,
+                         GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    } else {
+      glBlitFramebuffer (0, 0, width_, height_, 0, height_, width_, 0,
+                         GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    }
+  }
+
   glFlush ();
 
   glBindFramebuffer (GL_FRAMEBUFFER, 0);
@@ -1451,6 +2015,13 @@ RangeLikelihood::render (const
 
 const float *
 RangeLikelihood::getDepthBuffer () {
+  if (depth_buffer_dirty_ && use_software_rasterizer_) {
+    // Copy, since addNoise and friends modify depth_buffer_ in place.
+    memcpy (depth_buffer_, software_rasterizer_->getDepthBuffer (),
+            sizeof (float) * width_ * height_);
+    depth_buffer_dirty_ = false;
+  }
+
   if (depth_buffer_dirty_) {
     // Read depth
     glBindFramebuffer (GL_FRAMEBUFFER, fbo_);
@@ -1474,6 +2045,11 @@ RangeLikelihood::getColorBuffer () {
   // was rendered in the first place.
   assert (use_color_);
 
+  if (color_buffer_dirty_ && use_software_rasterizer_) {
+    memset (color_buffer_, 0, sizeof (uint8_t) * width_ * height_ * 3);
+    color_buffer_dirty_ = false;
+  }
+
   if (color_buffer_dirty_) {
     //std::cout << "Read color buffer" << std::endl;
 
@@ -1500,7 +2076,8 @@ RangeLikelihood::getColorBuffer () {
 // The scores are in score_texture_
 const float *
 RangeLikelihood::getScoreBuffer () {
-  if (score_buffer_dirty_ && !compute_likelihood_on_cpu_) {
+  if (score_buffer_dirty_ && !compute_likelihood_on_cpu_ &&
+      !use_software_rasterizer_) {
     glActiveTexture (GL_TEXTURE0);
     glBindTexture (GL_TEXTURE_2D, score_texture_);
     glGetTexImage (GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, score_buffer_);
@@ -6,6 +6,7 @@
  */
 
 #include <kinect_sim/scene.h>
+#include <kinect_sim/depth_rasterizer.h>
 
 namespace pcl
 {
@@ -32,6 +33,22 @@ Scene::draw ()
     (*model)->draw ();
 }
 
+void
+Scene::rasterize (DepthRasterizer &rasterizer)
+{
+  for (std::vector<Model::Ptr>::iterator model = models_.begin (); model != models_.end (); ++model)
+    (*model)->rasterize (rasterizer);
+}
+
+bool
+Scene::getBoundingCorners (std::vector<Eigen::Vector3f> *corners) const
+{
+  for (std::vector<Model::Ptr>::const_iterator model = models_.begin (); model != models_.end (); ++model)
+    if (!(*model)->getBoundingCorners (corners))
+      return (false);
+  return (true);
+}
+
 void
 Scene::clear ()
 {
@@ -4,18 +4,64 @@
 
 #include <opencv2/core/core.hpp>
 
+#ifdef KINECT_SIM_HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#ifdef KINECT_SIM_HAVE_EGL
+namespace {
+// eglGetDisplay returns the same handle to every caller in the process, and
+// eglTerminate on it invalidates every context created there. Count the
+// simulators using each display, and terminate it only after the last one.
+std::mutex egl_display_mutex;
+std::map<EGLDisplay, int> egl_display_users;
+
+bool
+acquireEGLDisplay (EGLDisplay display, EGLint *major, EGLint *minor) {
+  std::lock_guard<std::mutex> lock (egl_display_mutex);
+
+  if (!eglInitialize (display, major, minor)) {
+    return false;
+  }
+
+  ++egl_display_users[display];
+  return true;
+}
+
+void
+releaseEGLDisplay (EGLDisplay display) {
+  std::lock_guard<std::mutex> lock (egl_display_mutex);
+
+  if (--egl_display_users[display] == 0) {
+    egl_display_users.erase (display);
+    eglTerminate (display);
+  }
+}
+}  // namespace
+#endif
+
 pcl::simulation::SimExample::SimExample(int argc, char **argv,
-                                        int height, int width):
-  height_(height), width_(width) {
+                                        int height, int width, bool use_opengl):
+  height_(height), width_(width), batch_rows_(4), batch_cols_(4),
+  use_opengl_(use_opengl), egl_display_(NULL), egl_context_(NULL) {
 
-  initializeGL (argc, argv);
+  if (use_opengl_) {
+    initializeGL (argc, argv);
+  }
 
   // 1. construct member elements:
   camera_ = Camera::Ptr (new Camera ());
   scene_ = Scene::Ptr (new Scene ());
 
   //rl_ = RangeLikelihoodGLSL::Ptr(new RangeLikelihoodGLSL(1, 1, height, width, scene_, 0));
-  rl_ = RangeLikelihood::Ptr (new RangeLikelihood (1, 1, height, width, scene_));
+  rl_ = RangeLikelihood::Ptr (new RangeLikelihood (1, 1, height, width, scene_,
+                                                   use_opengl_));
   // rl_ = RangeLikelihood::Ptr(new RangeLikelihood(10, 10, 96, 96, scene_));
   // rl_ = RangeLikelihood::Ptr(new RangeLikelihood(1, 1, height_, width_, scene_));
 
@@ -66,17 +112,148 @@ pcl::simulation::SimExample::SimExample(int argc, char **argv,
 
 
 
+pcl::simulation::SimExample::~SimExample () {
+#ifdef KINECT_SIM_HAVE_EGL
+
+  if (egl_context_ != NULL) {
+    // Free the renderers' GL objects while their context is still current.
+    rl_.reset ();
+    batch_rl_.reset ();
+    eglMakeCurrent (egl_display_, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                    EGL_NO_CONTEXT);
+    eglDestroyContext (egl_display_, egl_context_);
+    releaseEGLDisplay (egl_display_);
+  }
+
+#endif
+}
+
+bool
+pcl::simulation::SimExample::initializeEGL () {
+#ifdef KINECT_SIM_HAVE_EGL
+  EGLDisplay display = EGL_NO_DISPLAY;
+
+  // Prefer a GPU device display (EGL_EXT_platform_device), and fall back to
+  // the default display, which is surfaceless on Mesa without X.
+  PFNEGLQUERYDEVICESEXTPROC query_devices =
+    reinterpret_cast<PFNEGLQUERYDEVICESEXTPROC> (eglGetProcAddress (
+                                                   "eglQueryDevicesEXT"));
+  PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+    reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC> (eglGetProcAddress (
+                                                         "eglGetPlatformDisplayEXT"));
+
+  if (query_devices != NULL && get_platform_display != NULL) {
+    const EGLint kMaxDevices = 16;
+    EGLDeviceEXT devices[kMaxDevices];
+    EGLint num_devices = 0;
+
+    if (query_devices (kMaxDevices, devices, &num_devices) && num_devices > 0) {
+      const char *device_env = getenv ("KINECT_SIM_EGL_DEVICE");
+      const int device = device_env == NULL ? 0 : atoi (device_env);
+      display = get_platform_display (EGL_PLATFORM_DEVICE_EXT,
+                                      devices[std::abs (device) % num_devices], NULL);
+    }
+  }
+
+  if (display == EGL_NO_DISPLAY) {
+    display = eglGetDisplay (EGL_DEFAULT_DISPLAY);
+  }
+
+  EGLint major = 0;
+  EGLint minor = 0;
+
+  if (display == EGL_NO_DISPLAY || !acquireEGLDisplay (display, &major,
+                                                        &minor)) {
+    std::cerr << "EGL: no display" << std::endl;
+    return false;
+  }
+
+  // The renderer uses the fixed-function pipeline, so this must be a desktop
+  // OpenGL (compatibility) context.
+  const EGLint config_attribs[] = {
+    EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+    EGL_DEPTH_SIZE, 24,
+    EGL_NONE
+  };
+  EGLConfig config;
+  EGLint num_configs = 0;
+
+  if (!eglChooseConfig (display, config_attribs, &config, 1, &num_configs) ||
+      num_configs == 0 || !eglBindAPI (EGL_OPENGL_API)) {
+    std::cerr << "EGL: no OpenGL config" << std::endl;
+    releaseEGLDisplay (display);
+    return false;
+  }
+
+  EGLContext context = eglCreateContext (display, config, EGL_NO_CONTEXT,
+                                         NULL);
+
+  // RangeLikelihood draws into its own framebuffer objects, so the context
+  // needs no surface.
+  if (context == EGL_NO_CONTEXT ||
+      !eglMakeCurrent (display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+    std::cerr << "EGL: could not create a surfaceless context" << std::endl;
+
+    if (context != EGL_NO_CONTEXT) {
+      eglDestroyContext (display, context);
+    }
+
+    releaseEGLDisplay (display);
+    return false;
+  }
+
+  std::cout << "Status: Using EGL " << major << "." << minor << std::endl;
+  egl_display_ = display;
+  egl_context_ = context;
+  return true;
+#else
+  return false;
+#endif
+}
+
 void
 pcl::simulation::SimExample::initializeGL (int argc, char **argv) {
-  glutInit (&argc, argv);
-  glutInitDisplayMode (GLUT_DEPTH | GLUT_DOUBLE | GLUT_RGB);// was GLUT_RGBA
-  glutInitWindowPosition (10, 10);
-  glutInitWindowSize (10, 10);
-  //glutInitWindowSize (window_width_, window_height_);
-  glutCreateWindow ("OpenGL range likelihood");
+  const char *context_type = getenv ("KINECT_SIM_GL_CONTEXT");
+  bool use_egl = context_type != NULL ? strcmp (context_type, "egl") == 0 :
+                 getenv ("DISPLAY") == NULL;
+
+#ifndef KINECT_SIM_HAVE_EGL
+
+  if (use_egl && context_type != NULL) {
+    std::cerr << "kinect_sim was built without EGL, using GLUT" << std::endl;
+  }
+
+  use_egl = false;
+#endif
+
+  if (use_egl && !initializeEGL ()) {
+    std::cerr << "Failed creating an EGL context, using GLUT" << std::endl;
+    use_egl = false;
+  }
+
+  if (!use_egl) {
+    glutInit (&argc, argv);
+    glutInitDisplayMode (GLUT_DEPTH | GLUT_DOUBLE | GLUT_RGB);// was GLUT_RGBA
+    glutInitWindowPosition (10, 10);
+    glutInitWindowSize (10, 10);
+    //glutInitWindowSize (window_width_, window_height_);
+    glutCreateWindow ("OpenGL range likelihood");
+  }
 
   GLenum err = glewInit ();
 
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+
+  // GLEW builds for GLX report this with an EGL context, after having loaded
+  // the GL entry points.
+  if (use_egl && err == GLEW_ERROR_NO_GLX_DISPLAY) {
+    err = GLEW_OK;
+  }
+
+#endif
+
   if (GLEW_OK != err) {
     std::cerr << "Error: " << glewGetErrorString (err) << std::endl;
     exit (-1);
@@ -133,6 +310,88 @@ pcl::simulation::SimExample::doSim (Eigen::Isometry3d pose_in) {
 
 
 
+void
+pcl::simulation::SimExample::set_batch_size (int batch_rows, int batch_cols) {
+  if (batch_rows != batch_rows_ || batch_cols != batch_cols_) {
+    batch_rl_.reset ();
+  }
+
+  batch_rows_ = batch_rows;
+  batch_cols_ = batch_cols;
+}
+
+int
+pcl::simulation::SimExample::get_batch_size () const {
+  return batch_rows_ * batch_cols_;
+}
+
+void
+pcl::simulation::SimExample::doSimBatch (const std::vector<Scene::Ptr> &scenes,
+                                         Eigen::Isometry3d pose_in) {
+  // The tiled framebuffer is only allocated once batching is used.
+  if (!batch_rl_) {
+    batch_rl_ = RangeLikelihood::Ptr (new RangeLikelihood (batch_rows_,
+                                                           batch_cols_, height_, width_, scene_, use_opengl_));
+    batch_rl_->setCameraIntrinsicsParameters (width_, height_, kCameraFX,
+                                              kCameraFY, kCameraCX, kCameraCY);
+    batch_rl_->setComputeOnCPU (false);
+    batch_rl_->setSumOnCPU (true);
+    batch_rl_->setUseColor (false);
+  }
+
+  if (batch_rl_->getUseSoftwareRasterizer () !=
+      rl_->getUseSoftwareRasterizer ()) {
+    batch_rl_->setUseSoftwareRasterizer (rl_->getUseSoftwareRasterizer ());
+  }
+
+  if (batch_rl_->getUseLinearDepth () != rl_->getUseLinearDepth ()) {
+    batch_rl_->setUseLinearDepth (rl_->getUseLinearDepth ());
+  }
+
+  batch_rl_->renderScenes (scenes, pose_in);
+}
+
+bool
+pcl::simulation::SimExample::doSimCropped (Eigen::Isometry3d pose_in,
+                                           int *x_min, int *y_min, int *width, int *height,
+                                           std::vector<unsigned short> *depth_patch) {
+  return rl_->renderCropped (pose_in, x_min, y_min, width, height,
+                             depth_patch);
+}
+
+int
+pcl::simulation::SimExample::submitSim (Eigen::Isometry3d pose_in) {
+  rl_->renderScenes (std::vector<Scene::Ptr> (1, scene_), pose_in);
+  return rl_->submitDepthReadback ();
+}
+
+void
+pcl::simulation::SimExample::retrieve_depth_image_uint (int ticket,
+                                                        std::vector<unsigned short> *depth_img) {
+  rl_->retrieveDepthImage (ticket, depth_img);
+}
+
+void
+pcl::simulation::SimExample::set_num_readback_buffers (int num_buffers) {
+  rl_->setNumReadbackBuffers (num_buffers);
+}
+
+int
+pcl::simulation::SimExample::get_num_readback_buffers () const {
+  return rl_->getNumReadbackBuffers ();
+}
+
+void
+pcl::simulation::SimExample::get_depth_images_uint (int num_images,
+                                                    std::vector<std::vector<unsigned short>> *depth_images) {
+  assert (batch_rl_ && num_images <= get_batch_size ());
+  depth_images->resize (num_images);
+
+  for (int ii = 0; ii < num_images; ++ii) {
+    batch_rl_->getTileDepthImage (ii, &depth_images->at (ii));
+  }
+}
+
 void
 pcl::simulation::SimExample::write_score_image(const float *score_buffer,
                                                std::string fname) {
@@ -370,28 +629,23 @@ pcl::simulation::SimExample::get_depth_image_uint(const float *depth_buffer,
         z_new = 65535;
       }
 
-      if ( z_new < 18000) {
-        //cout << z_new << " " << d << " " << x << "\n";
-      }
-
-      float z = 1000 * ( -zf * zn / ((zf - zn) * (d - zf / (zf - zn))));
-      float b = 0.075;
-      float f = 580.0;
-      uint16_t kd = static_cast<uint16_t>(1090 - b * f / z * 8);
-
-      if (kd < 0) {
-        kd = 0;
-      } else if (kd > 2047) {
-        kd = 2047;
-      }
-
-      int pval = t_gamma[kd];
-      int lb = pval & 0xff;
       (*depth_img)[i] = z_new;
     }
   }
 }
 
+void
+pcl::simulation::SimExample::get_depth_image_uint(std::vector<unsigned short>
+                                                  *depth_img) {
+  if (rl_->getUseSoftwareRasterizer() || rl_->getUseLinearDepth()) {
+    // Already resolved to millimeters by the renderer.
+    rl_->getLinearDepthImage(depth_img);
+    return;
+  }
+
+  get_depth_image_uint(rl_->getDepthBuffer(), depth_img);
+}
+
 void pcl::simulation::SimExample::get_depth_image_cv(const float *depth_buffer,
                                                      cv::Mat &depth_image) {
   int npixels = rl_->getWidth() * rl_->getHeight();
@@ -0,0 +1,114 @@
+/**
+ * Compares the OpenGL and software depth rasterizer backends of
+ * RangeLikelihood. Renders a mesh from a ring of camera poses with both
+ * backends, reports the number of pixels that differ and the time per frame.
+ *
+ * kinect_sim_test_rasterizer <filename> [distance] [num_poses]
+ */
+
+#include <Eigen/Dense>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include <pcl/common/centroid.h>
+#include <pcl/common/time.h>
+#include <kinect_sim/camera_constants.h>
+#include <kinect_sim/simulation_io.hpp>
+
+using namespace Eigen;
+using namespace pcl;
+using namespace pcl::console;
+using namespace pcl::simulation;
+using namespace std;
+
+void printHelp (int argc, char **argv)
+{
+  print_error ("Syntax is: %s <filename> [distance] [num_poses]\n", argv[0]);
+  print_info ("acceptable filenames include vtk, obj and ply.\n");
+}
+
+// Render the current scene from the given pose and return the millimeter
+// depth image along with the time taken (in seconds).
+double
+render (SimExample::Ptr simexample, const Isometry3d &pose,
+        vector<unsigned short> *depth_image)
+{
+  double start = pcl::getTime ();
+  simexample->doSim (pose);
+  simexample->get_depth_image_uint (depth_image);
+  return (pcl::getTime () - start);
+}
+
+int
+main (int argc, char** argv)
+{
+  if (argc < 2)
+  {
+    printHelp (argc, argv);
+    return (-1);
+  }
+
+  double distance = (argc > 2) ? atof (argv[2]) : 1.0;
+  int num_poses = (argc > 3) ? atoi (argv[3]) : 16;
+
+  SimExample::Ptr simexample = SimExample::Ptr (new SimExample (0, NULL,
+                                                                kCameraHeight, kCameraWidth));
+
+  pcl::PolygonMesh::Ptr mesh (new pcl::PolygonMesh);
+  pcl::io::loadPolygonFile (argv[1], *mesh);
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  pcl::fromPCLPointCloud2 (mesh->cloud, cloud);
+  Eigen::Vector4f centroid;
+  pcl::compute3DCentroid (cloud, centroid);
+
+  PolygonMeshModel::Ptr model = PolygonMeshModel::Ptr (new PolygonMeshModel (
+                                                         GL_POLYGON, mesh));
+  simexample->scene_->add (model);
+  print_info ("Loaded %s: %d polygons\n", argv[1],
+              static_cast<int> (mesh->polygons.size ()));
+
+  double gl_time = 0.0;
+  double sw_time = 0.0;
+  int total_mismatches = 0;
+  int max_difference = 0;
+
+  for (int ii = 0; ii < num_poses; ++ii)
+  {
+    // Camera on a ring around the mesh centroid, looking at it.
+    double yaw = 2 * M_PI * ii / num_poses;
+    Isometry3d pose = Isometry3d::Identity ();
+    pose.rotate (AngleAxisd (yaw, Vector3d::UnitZ ()));
+    pose.translation () = centroid.head<3> ().cast<double> () -
+                          distance * Vector3d (cos (yaw), sin (yaw), 0.0);
+
+    vector<unsigned short> gl_image, sw_image;
+    simexample->rl_->setUseSoftwareRasterizer (false);
+    gl_time += render (simexample, pose, &gl_image);
+    simexample->rl_->setUseSoftwareRasterizer (true);
+    sw_time += render (simexample, pose, &sw_image);
+
+    int mismatches = 0;
+
+    for (size_t jj = 0; jj < gl_image.size (); ++jj)
+    {
+      int difference = abs (static_cast<int> (gl_image[jj]) - static_cast<int>
+                            (sw_image[jj]));
+
+      if (difference != 0)
+      {
+        ++mismatches;
+        max_difference = max (max_difference, difference);
+      }
+    }
+
+    total_mismatches += mismatches;
+    print_info ("Pose %d: %d mismatched pixels\n", ii, mismatches);
+  }
+
+  print_info ("Total mismatched pixels: %d (max difference %d mm)\n",
+              total_mismatches, max_difference);
+  print_info ("OpenGL:   %f ms per frame\n", 1000.0 * gl_time / num_poses);
+  print_info ("Software: %f ms per frame\n", 1000.0 * sw_time / num_poses);
+  return (total_mismatches == 0) ? 0 : 1;
+}
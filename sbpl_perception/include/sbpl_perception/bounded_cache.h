@@ -0,0 +1,183 @@
+#pragma once
+
+/**
+ * @file bounded_cache.h
+ * @brief Cache of recomputable values with a byte budget
+ * @author Venkatraman Narayanan
+ * Carnegie Mellon University, 2015
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <utility>
+
+namespace sbpl_perception {
+
+struct CacheStats {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+  // Bytes accounted to the entries held now, and the most held at any time.
+  uint64_t bytes;
+  uint64_t peak_bytes;
+};
+
+// Maps keys to values that the owner can always recompute, so that dropping
+// an entry costs time but never correctness. Every value is charged its size
+// (as reported by the size function, plus the cache's own overhead) and a
+// recompute cost (in whatever unit the owner likes, e.g., scenes rendered).
+// Whenever the total size exceeds the byte budget, entries are evicted in
+// GreedyDual-Size order: the entry with the least recompute cost per byte,
+// aged by how long ago it was inserted or found, goes first. With equal costs
+// and sizes this is plain LRU. A budget of 0 means unbounded.
+//
+// Since Find updates the recency and the stats, and what gets evicted depends
+// on value sizes, this is no substitute for LRUCache where readers share the
+// cache across threads or its contents must be mirrored on another processor.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class BoundedCache {
+ public:
+  // Bytes of heap memory owned by a value, beyond sizeof(Value).
+  typedef std::function<size_t(const Value &)> SizeFunction;
+
+  explicit BoundedCache(SizeFunction size_function = [](const Value &) {
+    return size_t(0);
+  }) : size_function_(size_function), byte_budget_(0), age_(0.0),
+    sequence_(0), stats_ {0, 0, 0, 0, 0} {}
+
+  size_t byte_budget() const {
+    return byte_budget_;
+  }
+  void set_byte_budget(size_t byte_budget) {
+    byte_budget_ = byte_budget;
+    EvictToBudget(nullptr);
+  }
+
+  size_t size() const {
+    return entries_.size();
+  }
+  bool empty() const {
+    return entries_.empty();
+  }
+  // Drops all entries, but keeps the counters.
+  void clear() {
+    entries_.clear();
+    priorities_.clear();
+    age_ = 0.0;
+    stats_.bytes = 0;
+  }
+
+  const CacheStats &stats() const {
+    return stats_;
+  }
+  void ResetStats() {
+    stats_.hits = 0;
+    stats_.misses = 0;
+    stats_.evictions = 0;
+    stats_.peak_bytes = stats_.bytes;
+  }
+
+  // Does not count as a hit or miss, and does not renew the entry.
+  bool Contains(const Key &key) const {
+    return entries_.find(key) != entries_.end();
+  }
+
+  // Returns the value for key and renews it, or nullptr on a miss. The
+  // pointer is valid until the next Insert, set_byte_budget or clear.
+  const Value *Find(const Key &key) {
+    const auto it = entries_.find(key);
+
+    if (it == entries_.end()) {
+      ++stats_.misses;
+      return nullptr;
+    }
+
+    ++stats_.hits;
+    Renew(key, &it->second);
+    return &it->second.value;
+  }
+
+  // Inserts (or replaces) the value for key, then evicts other entries until
+  // the cache is within budget. The new entry itself is never evicted here,
+  // even if it alone exceeds the budget.
+  void Insert(const Key &key, Value value, double cost = 1.0) {
+    const size_t bytes = sizeof(Key) + sizeof(Entry) + size_function_(value);
+    auto it = entries_.find(key);
+
+    if (it == entries_.end()) {
+      it = entries_.emplace(key, Entry {std::move(value), bytes, cost,
+                                        Priority()}).first;
+    } else {
+      priorities_.erase(it->second.priority);
+      stats_.bytes -= it->second.bytes;
+      it->second.value = std::move(value);
+      it->second.bytes = bytes;
+      it->second.cost = cost;
+    }
+
+    stats_.bytes += bytes;
+    stats_.peak_bytes = std::max(stats_.peak_bytes, stats_.bytes);
+    SetPriority(key, &it->second);
+    EvictToBudget(&key);
+  }
+
+ private:
+  // GreedyDual-Size priority, with ties broken in favor of the more recently
+  // renewed entry.
+  typedef std::pair<double, uint64_t> Priority;
+
+  struct Entry {
+    Value value;
+    size_t bytes;
+    double cost;
+    Priority priority;
+  };
+
+  SizeFunction size_function_;
+  size_t byte_budget_;
+  // The priority of the last evicted entry. Renewed entries start above it,
+  // which is what ages the ones that are not renewed.
+  double age_;
+  uint64_t sequence_;
+  CacheStats stats_;
+  std::unordered_map<Key, Entry, Hash> entries_;
+  std::map<Priority, Key> priorities_;
+
+  void Renew(const Key &key, Entry *entry) {
+    priorities_.erase(entry->priority);
+    SetPriority(key, entry);
+  }
+
+  void SetPriority(const Key &key, Entry *entry) {
+    entry->priority = Priority(age_ + entry->cost / static_cast<double>
+                               (entry->bytes), sequence_++);
+    priorities_.emplace(entry->priority, key);
+  }
+
+  void EvictToBudget(const Key *keep) {
+    if (byte_budget_ == 0) {
+      return;
+    }
+
+    auto victim = priorities_.begin();
+
+    while (stats_.bytes > byte_budget_ && victim != priorities_.end()) {
+      if (keep != nullptr && victim->second == *keep) {
+        ++victim;
+        continue;
+      }
+
+      const auto it = entries_.find(victim->second);
+      age_ = victim->first.first;
+      stats_.bytes -= it->second.bytes;
+      ++stats_.evictions;
+      entries_.erase(it);
+      victim = priorities_.erase(victim);
+    }
+  }
+};
+}  // namespace sbpl_perception
@@ -0,0 +1,53 @@
+#pragma once
+
+/**
+ * @file depth_image_kernels.h
+ * @brief Vectorized whole-image operations on depth images
+ * @author Venkatraman Narayanan
+ * Carnegie Mellon University, 2015
+ */
+
+#include <vector>
+
+namespace sbpl_perception {
+
+// All kernels operate on unsigned short depth images in mm, where
+// kKinectMaxDepth denotes no return (any other value, including ones above
+// kKinectMaxDepth, is a valid depth). The instruction set is picked at compile
+// time (AVX2, SSE4.1 or plain C++, see depth_image_kernels.cpp); the *Scalar
+// variants are always available and serve as the reference implementation.
+
+// Name of the instruction set the kernels were compiled for.
+const char *DepthImageKernelsInstructionSet();
+
+// composed[i] = min(first[i], second[i]).
+void ComposeDepthImages(const unsigned short *first,
+                        const unsigned short *second, unsigned short *composed, int num_pixels);
+void ComposeDepthImagesScalar(const unsigned short *first,
+                              const unsigned short *second, unsigned short *composed, int num_pixels);
+
+// Returns true if some pixel of succ is valid and closer than a valid pixel
+// of parent. Otherwise, fills new_pixel_indices with the pixels that are valid
+// in succ but not in parent, and sets min_depth/max_depth to the depth range
+// of those pixels. If occluded, new_pixel_indices is empty, min_depth is
+// kKinectMaxDepth and max_depth is 0.
+bool FindNewPixels(const unsigned short *parent, const unsigned short *succ,
+                   int num_pixels, std::vector<int> *new_pixel_indices,
+                   unsigned short *min_depth, unsigned short *max_depth);
+bool FindNewPixelsScalar(const unsigned short *parent,
+                         const unsigned short *succ, int num_pixels, std::vector<int> *new_pixel_indices,
+                         unsigned short *min_depth, unsigned short *max_depth);
+
+// Same as ComposeDepthImages(parent, object, composed) followed by
+// FindNewPixels(parent, composed), in a single pass over the images.
+bool ComposeAndFindNewPixels(const unsigned short *parent,
+                             const unsigned short *object, int num_pixels, unsigned short *composed,
+                             std::vector<int> *new_pixel_indices, unsigned short *min_depth,
+                             unsigned short *max_depth);
+
+// masked[i] = mask[i] > input[i] ? input[i] : kKinectMaxDepth.
+void ApplyOcclusionMask(const unsigned short *input, const unsigned short *mask,
+                        unsigned short *masked, int num_pixels);
+void ApplyOcclusionMaskScalar(const unsigned short *input,
+                              const unsigned short *mask, unsigned short *masked, int num_pixels);
+}  // namespace sbpl_perception
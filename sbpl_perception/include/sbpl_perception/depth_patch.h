@@ -0,0 +1,144 @@
+#pragma once
+
+/**
+ * @file depth_patch.h
+ * @brief Sparse depth image: the bounding box of its valid pixels
+ * @author Venkatraman Narayanan
+ * Carnegie Mellon University, 2015
+ */
+
+#include <sbpl_perception/utils/utils.h>
+#include <sbpl_perception/wire_codec.h>
+
+#include <boost/archive/archive_exception.hpp>
+#include <boost/serialization/serialization.hpp>
+#include <boost/serialization/split_member.hpp>
+#include <boost/serialization/vector.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace sbpl_perception {
+
+// A kDepthImageWidth x kDepthImageHeight depth image, stored as the dense
+// rectangle enclosing all pixels that are not kKinectMaxDepth. Pixels outside
+// the rectangle are implicitly kKinectMaxDepth. Rendered objects typically
+// cover a small part of the frame, so this is what we cache and send over the
+// wire instead of full images.
+class DepthPatch {
+ public:
+  DepthPatch();
+  // Crops a full-size depth image.
+  explicit DepthPatch(const std::vector<unsigned short> &depth_image);
+  // Crops a width x height rectangle of a depth image, with top left corner
+  // at (x_min, y_min), given as row-major depths. Pixels outside it are taken
+  // to be kKinectMaxDepth.
+  DepthPatch(int x_min, int y_min, int width, int height,
+             const std::vector<unsigned short> &depths);
+
+  // True if no pixel has a valid return.
+  bool empty() const {
+    return depths_.empty();
+  }
+  int x_min() const {
+    return x_min_;
+  }
+  int y_min() const {
+    return y_min_;
+  }
+  int width() const {
+    return width_;
+  }
+  int height() const {
+    return height_;
+  }
+  // Row-major depths within the bounding box.
+  const std::vector<unsigned short> &depths() const {
+    return depths_;
+  }
+
+  // Bytes used by the depth values.
+  size_t NumBytes() const {
+    return depths_.size() * sizeof(unsigned short);
+  }
+
+  // Depth at a (row-major) pixel index of the full image.
+  unsigned short GetDepth(int pixel_index) const;
+
+  // Calls func(pixel_index, depth) for every valid pixel, in row-major order.
+  template <typename Func>
+  void ForEachPixel(Func func) const;
+
+  // Expands the patch back to a full-size depth image.
+  void GetDepthImage(std::vector<unsigned short> *depth_image) const;
+
+  // Sets every pixel of the full-size depth_image to the minimum of itself and
+  // the corresponding pixel of this patch.
+  void ComposeInto(std::vector<unsigned short> *depth_image) const;
+
+  // Pixel-wise minimum of two patches.
+  static DepthPatch Compose(const DepthPatch &first, const DepthPatch &second);
+
+  // True if some pixel is valid in both patches and closer in this one, i.e,
+  // this patch occludes part of other.
+  bool Occludes(const DepthPatch &other) const;
+
+ private:
+  int x_min_;
+  int y_min_;
+  int width_;
+  int height_;
+  std::vector<unsigned short> depths_;
+
+  // Sets the patch to the bounding box of the valid pixels of a rectangle of
+  // the image, whose rows are stride pixels apart in depths.
+  void Crop(const unsigned short *depths, int stride, int x_min, int y_min,
+            int width, int height);
+
+  // Depths go over the wire through EncodeDepths.
+  friend class boost::serialization::access;
+  template <typename Ar> void save(Ar &ar, const unsigned int) const {
+    ar &x_min_;
+    ar &y_min_;
+    ar &width_;
+    ar &height_;
+    std::vector<uint8_t> bytes;
+    EncodeDepths(depths_, &bytes);
+    ar &bytes;
+  }
+  template <typename Ar> void load(Ar &ar, const unsigned int) {
+    ar &x_min_;
+    ar &y_min_;
+    ar &width_;
+    ar &height_;
+    std::vector<uint8_t> bytes;
+    ar &bytes;
+
+    // A truncated or corrupt message, or a rectangle outside the image.
+    if (!DecodeDepths(bytes, &depths_) || width_ < 0 || height_ < 0 ||
+        x_min_ < 0 || y_min_ < 0 || width_ > kDepthImageWidth - x_min_ ||
+        height_ > kDepthImageHeight - y_min_ ||
+        static_cast<int>(depths_.size()) != width_ * height_) {
+      *this = DepthPatch();
+      throw boost::archive::archive_exception(
+        boost::archive::archive_exception::input_stream_error);
+    }
+  }
+  BOOST_SERIALIZATION_SPLIT_MEMBER()
+};
+
+template <typename Func>
+void DepthPatch::ForEachPixel(Func func) const {
+  for (int ii = 0; ii < height_; ++ii) {
+    const int image_row_start = (y_min_ + ii) * kDepthImageWidth + x_min_;
+
+    for (int jj = 0; jj < width_; ++jj) {
+      const unsigned short depth = depths_[ii * width_ + jj];
+
+      if (depth != kKinectMaxDepth) {
+        func(image_row_start + jj, depth);
+      }
+    }
+  }
+}
+}  // namespace sbpl_perception
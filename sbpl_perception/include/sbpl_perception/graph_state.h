@@ -1,20 +1,32 @@
 #pragma once
 
 #include <sbpl_perception/object_state.h>
+#include <sbpl_perception/small_vector.h>
 
+#include <boost/serialization/split_member.hpp>
+
+#include <cstdint>
 #include <iostream>
-#include <vector>
 
 class GraphState {
  public:
+  // Scenes with up to this many objects are stored inline, so that copying a
+  // state and appending an object to it (as successor generation does) does
+  // not allocate.
+  static constexpr size_t kNumInlineObjects = 8;
+  typedef sbpl_perception::SmallVector<ObjectState, kNumInlineObjects>
+  ObjectStates;
+
   GraphState();
+  // The source state with object_state appended.
+  GraphState(const GraphState &source_state, const ObjectState &object_state);
   bool operator==(const GraphState &other) const;
   bool operator!=(const GraphState &other) const;
 
-  const std::vector<ObjectState> &object_states() const {
+  const ObjectStates &object_states() const {
     return object_states_;
   }
-  std::vector<ObjectState> &mutable_object_states() {
+  ObjectStates &mutable_object_states() {
     return object_states_;
   }
 
@@ -26,12 +38,30 @@ class GraphState {
   size_t GetHash() const;
 
  private:
-  std::vector<ObjectState> object_states_;
+  ObjectStates object_states_;
 
   friend class boost::serialization::access;
-  template <typename Ar> void serialize(Ar &ar, const unsigned int) {
-    ar &object_states_;
+  template <typename Ar> void save(Ar &ar, const unsigned int) const {
+    uint32_t num_objects = static_cast<uint32_t>(object_states_.size());
+    ar &num_objects;
+
+    for (const auto &object_state : object_states_) {
+      ar &object_state;
+    }
+  }
+  template <typename Ar> void load(Ar &ar, const unsigned int) {
+    uint32_t num_objects = 0;
+    ar &num_objects;
+    object_states_.clear();
+    object_states_.reserve(num_objects);
+
+    for (uint32_t ii = 0; ii < num_objects; ++ii) {
+      ObjectState object_state;
+      ar &object_state;
+      object_states_.push_back(object_state);
+    }
   }
+  BOOST_SERIALIZATION_SPLIT_MEMBER()
 };
 
 std::ostream &operator<< (std::ostream &stream, const GraphState &graph_state);
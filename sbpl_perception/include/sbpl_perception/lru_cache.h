@@ -0,0 +1,86 @@
+#pragma once
+
+/**
+ * @file lru_cache.h
+ * @brief Least-recently-used cache with explicit eviction
+ * @author Venkatraman Narayanan
+ * Carnegie Mellon University, 2015
+ */
+
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+namespace sbpl_perception {
+
+// Maps keys to values, ordered by recency of insertion or Touch. Lookups
+// through Find do not change the order, so any number of threads may call
+// Find concurrently (as long as nothing modifies the cache meanwhile). Entries
+// are dropped only by Evict, which lets callers grow the cache past its
+// capacity for the duration of a batch and trim it afterwards. Two caches
+// subjected to the same sequence of Insert, Touch and Evict calls hold the
+// same keys, which is what lets the master mirror the contents of the caches
+// on the workers.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class LRUCache {
+ public:
+  size_t size() const {
+    return entries_.size();
+  }
+  bool empty() const {
+    return entries_.empty();
+  }
+  void clear() {
+    entries_.clear();
+    index_.clear();
+  }
+
+  bool Contains(const Key &key) const {
+    return index_.find(key) != index_.end();
+  }
+
+  // Returns the value for key, or nullptr if absent.
+  const Value *Find(const Key &key) const {
+    const auto it = index_.find(key);
+    return it == index_.end() ? nullptr : &it->second->second;
+  }
+
+  // Inserts (or replaces) the value for key as the most recently used entry.
+  void Insert(const Key &key, Value value) {
+    const auto it = index_.find(key);
+
+    if (it != index_.end()) {
+      entries_.erase(it->second);
+    }
+
+    entries_.emplace_front(key, std::move(value));
+    index_[key] = entries_.begin();
+  }
+
+  // Marks key as the most recently used entry. Returns false if absent.
+  bool Touch(const Key &key) {
+    const auto it = index_.find(key);
+
+    if (it == index_.end()) {
+      return false;
+    }
+
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return true;
+  }
+
+  // Drops least recently used entries until at most capacity remain.
+  void Evict(size_t capacity) {
+    while (entries_.size() > capacity) {
+      index_.erase(entries_.back().first);
+      entries_.pop_back();
+    }
+  }
+
+ private:
+  typedef std::list<std::pair<Key, Value>> EntryList;
+  EntryList entries_;
+  std::unordered_map<Key, typename EntryList::iterator, Hash> index_;
+};
+}  // namespace sbpl_perception
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <sbpl_perception/depth_patch.h>
 #include <sbpl_perception/graph_state.h>
+#include <sbpl_perception/pixel_set.h>
 
 #include <boost/mpi.hpp>
 
@@ -9,6 +11,10 @@
 // Add serialization support for graph state and other quantities which we want
 // to ship over the wire.
 
+// Depth images are not part of the inputs. Every processor keeps LRU caches
+// of them, keyed by state ID, which the master fills through
+// CostComputationImages before each batch (see
+// EnvObjectRecognition::ShareCostComputationImages).
 struct CostComputationInput {
   GraphState source_state;
   GraphState child_state;
@@ -16,23 +22,46 @@ struct CostComputationInput {
   int source_id;
   int child_id;
 
-  std::vector<unsigned short> source_depth_image;  
-  std::vector<int> source_counted_pixels;
-
-  // This is optional: a non-empty vector should be used only when lazily
-  // computing cost from cached depth images of individual objects.
-  std::vector<unsigned short> unadjusted_last_object_depth_image;
-  std::vector<unsigned short> adjusted_last_object_depth_image;
+  // This is optional: the ID of the single-object state made of the last
+  // object of child_state, whose SingleObjectRender should be used when lazily
+  // computing cost from cached depth images of individual objects, or -1 if
+  // there is none.
+  int last_object_id;
   GraphState adjusted_last_object_state;
 };
 
+// Rendering of a source state, and its counted pixels.
+struct SourceImage {
+  sbpl_perception::DepthPatch depth_image;
+  sbpl_perception::PixelSet counted_pixels;
+};
+
+// Renderings of a single-object state before and after ICP refinement.
+struct SingleObjectRender {
+  sbpl_perception::DepthPatch unadjusted_depth_image;
+  sbpl_perception::DepthPatch adjusted_depth_image;
+};
+
+// Depth images needed by a batch of CostComputationInputs.
+struct CostComputationImages {
+  // IDs referenced by the batch.
+  std::vector<int> source_ids;
+  std::vector<int> single_object_ids;
+  // Images for the referenced IDs that are not cached yet, aligned with
+  // their IDs.
+  std::vector<int> new_source_ids;
+  std::vector<SourceImage> new_source_images;
+  std::vector<int> new_single_object_ids;
+  std::vector<SingleObjectRender> new_single_object_renders;
+};
+
 struct CostComputationOutput {
   int cost;
   GraphState adjusted_state;
   GraphStateProperties state_properties;
-  std::vector<int> child_counted_pixels;
-  std::vector<unsigned short> depth_image;
-  std::vector<unsigned short> unadjusted_depth_image;
+  sbpl_perception::PixelSet child_counted_pixels;
+  sbpl_perception::DepthPatch depth_image;
+  sbpl_perception::DepthPatch unadjusted_depth_image;
 };
 
 namespace boost {
@@ -45,13 +74,34 @@ void serialize(Archive &ar, CostComputationInput &input,
     ar &input.child_state;
     ar &input.source_id;
     ar &input.child_id;
-    ar &input.source_depth_image;
-    ar &input.source_counted_pixels;
-    ar &input.unadjusted_last_object_depth_image;
-    ar &input.adjusted_last_object_depth_image;
+    ar &input.last_object_id;
     ar &input.adjusted_last_object_state;
 }
 
+template<class Archive>
+void serialize(Archive &ar, SourceImage &image, const unsigned int version) {
+    ar &image.depth_image;
+    ar &image.counted_pixels;
+}
+
+template<class Archive>
+void serialize(Archive &ar, SingleObjectRender &render,
+               const unsigned int version) {
+    ar &render.unadjusted_depth_image;
+    ar &render.adjusted_depth_image;
+}
+
+template<class Archive>
+void serialize(Archive &ar, CostComputationImages &images,
+               const unsigned int version) {
+    ar &images.source_ids;
+    ar &images.single_object_ids;
+    ar &images.new_source_ids;
+    ar &images.new_source_images;
+    ar &images.new_single_object_ids;
+    ar &images.new_single_object_renders;
+}
+
 template<class Archive>
 void serialize(Archive &ar, CostComputationOutput &output,
                const unsigned int version) {
@@ -19,6 +19,15 @@
 
 #include <pcl/PolygonMesh.h>
 
+#include <boost/shared_ptr.hpp>
+
+namespace pcl {
+namespace simulation {
+class MeshBuffer;
+class Model;
+}  // namespace simulation
+}  // namespace pcl
+
 // TODO: use config manager.
 // If true, mesh is converted from mm to meters while preprocessing, otherwise left as such.
 extern bool kMeshInMillimeters;
@@ -36,6 +45,18 @@ class ObjectModel {
 
   pcl::PolygonMeshPtr GetTransformedMesh(const Eigen::Matrix4f &transform) const;
 
+  // Writes the mesh vertices, transformed to pose p, into vertices. The
+  // caller can reuse the same cloud across calls, in which case this does
+  // not allocate once the cloud has grown to the number of vertices.
+  void GetTransformedVertices(const ContPose &p, PointCloud *vertices) const;
+  void GetTransformedVertices(const Eigen::Matrix4f &transform,
+                              PointCloud *vertices) const;
+
+  // Returns a renderable instance of the model at pose p. The instance shares
+  // the model's packed vertex/index buffers and only carries the pose as a
+  // model matrix, so this is cheap to call on every render.
+  boost::shared_ptr<pcl::simulation::Model> GetRenderModel(const ContPose &p) const;
+
   // Returns true if point is within the mesh model, where the model has been
   // transformed by the given pose and height.
   std::vector<bool> PointsInsideMesh(const std::vector<Eigen::Vector3d> &points, const ContPose &pose) const;
@@ -97,6 +118,11 @@ class ObjectModel {
 
  private:
   pcl::PolygonMesh mesh_;
+  // Vertices of mesh_, decoded once from its PCLPointCloud2 blob and shared
+  // by all copies of this model.
+  boost::shared_ptr<const pcl::PointCloud<pcl::PointXYZ>> mesh_vertices_;
+  // Packed triangles of mesh_, shared by all copies of this model.
+  boost::shared_ptr<pcl::simulation::MeshBuffer> mesh_buffer_;
   // A point cloud of the object (not just the vertices of the mesh!)
   // corresponding to mesh_
   PointCloudPtr cloud_;
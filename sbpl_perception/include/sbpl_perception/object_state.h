@@ -2,6 +2,7 @@
 
 #include <boost/serialization/serialization.hpp>
 
+#include <cstdint>
 #include <iostream>
 
 #include <Eigen/Geometry>
@@ -17,22 +18,22 @@ class ContPose {
   ContPose(double x, double y, double z, double roll, double pitch, double yaw);
   ContPose(const DiscPose &disc_pose);
 
-  const double &x() const {
+  double x() const {
     return x_;
   }
-  const double &y() const {
+  double y() const {
     return y_;
   }
-  const double &z() const {
+  double z() const {
     return z_;
   }
-  const double &roll() const {
+  double roll() const {
     return roll_;
   }
-  const double &pitch() const {
+  double pitch() const {
     return pitch_;
   }
-  const double &yaw() const {
+  double yaw() const {
     return yaw_;
   }
   Eigen::Isometry3d GetTransform() const;
@@ -48,12 +49,15 @@ class ContPose {
   // second, and yaw finally. All rotations are wrt. the fixed world frame, and
   // not the body frame. More details here:
   // http://planning.cs.uiuc.edu/node102.html.
-  double x_ = 0.0;
-  double y_ = 0.0;
-  double z_ = 0.0;
-  double roll_ = 0.0;
-  double pitch_ = 0.0;
-  double yaw_ = 0.0;
+  // Stored in single precision to keep object states (and so graph states)
+  // small: that is still well below a micron over a table, and well below
+  // the tolerance of operator==.
+  float x_ = 0.0f;
+  float y_ = 0.0f;
+  float z_ = 0.0f;
+  float roll_ = 0.0f;
+  float pitch_ = 0.0f;
+  float yaw_ = 0.0f;
 
   friend class boost::serialization::access;
   template <typename Ar> void serialize(Ar &ar, const unsigned int) {
@@ -138,6 +142,12 @@ class ObjectState {
   bool operator==(const ObjectState &other) const;
   bool operator!=(const ObjectState &other) const;
 
+  // The ID, symmetry, and discrete x, y and yaw (0 for symmetric objects)
+  // packed into 64 bits, with the ID in the most significant bits. Equal
+  // object states have equal keys. Object states with equal keys can still
+  // differ, but only in discrete z, roll or pitch, or in x or y beyond 16 bits.
+  uint64_t PackedKey() const;
+
  private:
   int id_;
   bool symmetric_;
@@ -0,0 +1,120 @@
+#pragma once
+
+/**
+ * @file pixel_set.h
+ * @brief Fixed-size bitset over the pixels (or observed points) of a frame
+ * @author Venkatraman Narayanan
+ * Carnegie Mellon University, 2015
+ */
+
+#include <sbpl_perception/utils/utils.h>
+#include <sbpl_perception/wire_codec.h>
+
+#include <boost/archive/archive_exception.hpp>
+#include <boost/serialization/serialization.hpp>
+#include <boost/serialization/split_member.hpp>
+#include <boost/serialization/vector.hpp>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace sbpl_perception {
+
+// A set of indices in [0, kNumPixels), stored as one bit per index. Used for
+// the observed points a state has accounted for ("counted pixels"). The bits
+// are stored inline, so constructing or copying a set never allocates: copies
+// are a fixed-size memcpy, and set operations go a word at a time.
+class PixelSet {
+ public:
+  static constexpr int kNumWords = (kNumPixels + 63) / 64;
+
+  // The empty set.
+  PixelSet();
+
+  void Set(int index) {
+    words_[index >> 6] |= uint64_t(1) << (index & 63);
+  }
+  bool Test(int index) const {
+    return (words_[index >> 6] >> (index & 63)) & 1;
+  }
+  void Clear();
+
+  // Number of indices in the set.
+  int Count() const;
+
+  // Union and difference (this AND NOT other), in place.
+  PixelSet &operator|=(const PixelSet &other);
+  void AndNot(const PixelSet &other);
+
+  bool operator==(const PixelSet &other) const {
+    return words_ == other.words_;
+  }
+  bool operator!=(const PixelSet &other) const {
+    return !(*this == other);
+  }
+
+  const std::array<uint64_t, kNumWords> &words() const {
+    return words_;
+  }
+  size_t NumBytes() const {
+    return sizeof(words_);
+  }
+
+  // Calls func(index) for every index in the set, in increasing order.
+  template <typename Func>
+  void ForEach(Func func) const;
+
+  // Calls func(index) for every index in first but not in second, in
+  // increasing order, without materializing the difference.
+  template <typename Func>
+  static void ForEachInDifference(const PixelSet &first,
+                                  const PixelSet &second, Func func);
+
+ private:
+  std::array<uint64_t, kNumWords> words_;
+
+  template <typename Func>
+  static void ForEachBit(uint64_t word, int word_index, Func func) {
+    while (word != 0) {
+      func(word_index * 64 + __builtin_ctzll(word));
+      word &= word - 1;
+    }
+  }
+
+  // Sent through EncodePixelSet.
+  friend class boost::serialization::access;
+  template <typename Ar> void save(Ar &ar, const unsigned int) const {
+    std::vector<uint8_t> bytes;
+    EncodePixelSet(*this, &bytes);
+    ar &bytes;
+  }
+  template <typename Ar> void load(Ar &ar, const unsigned int) {
+    std::vector<uint8_t> bytes;
+    ar &bytes;
+
+    // A truncated or corrupt message.
+    if (!DecodePixelSet(bytes, this)) {
+      Clear();
+      throw boost::archive::archive_exception(
+        boost::archive::archive_exception::input_stream_error);
+    }
+  }
+  BOOST_SERIALIZATION_SPLIT_MEMBER()
+};
+
+template <typename Func>
+void PixelSet::ForEach(Func func) const {
+  for (int ii = 0; ii < kNumWords; ++ii) {
+    ForEachBit(words_[ii], ii, func);
+  }
+}
+
+template <typename Func>
+void PixelSet::ForEachInDifference(const PixelSet &first,
+                                   const PixelSet &second, Func func) {
+  for (int ii = 0; ii < kNumWords; ++ii) {
+    ForEachBit(first.words_[ii] & ~second.words_[ii], ii, func);
+  }
+}
+}  // namespace sbpl_perception
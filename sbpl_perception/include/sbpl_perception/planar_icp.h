@@ -0,0 +1,110 @@
+#pragma once
+
+/**
+ * @file planar_icp.h
+ * @brief ICP restricted to (x, y, yaw) transformations
+ * @author Venkatraman Narayanan
+ * Carnegie Mellon University, 2015
+ */
+
+#include <perception_utils/pcl_typedefs.h>
+
+#include <Eigen/Core>
+#include <pcl/search/kdtree.h>
+
+#include <vector>
+
+namespace sbpl_perception {
+
+// Point-to-point ICP over planar rigid transformations (translation in x, y
+// and rotation about z). A drop-in replacement for
+// pcl::IterativeClosestPointNonLinear with
+// pcl::registration::TransformationEstimation2D: it uses the same
+// correspondence rule, closed-form update and termination criteria, but keeps
+// the per-iteration state in fixed-size Eigen types and can reuse a
+// prebuilt search index for the target.
+class PlanarICP {
+ public:
+  typedef pcl::search::KdTree<PointT> SearchIndex;
+  typedef SearchIndex::Ptr SearchIndexPtr;
+
+  PlanarICP();
+
+  // Correspondences farther apart than this are ignored.
+  void SetMaxCorrespondenceDistance(double distance) {
+    max_correspondence_distance_ = distance;
+  }
+  void SetMaximumIterations(int iterations) {
+    max_iterations_ = iterations;
+  }
+  // Terminate when the squared translation of an iteration's update is
+  // below this (and its rotation is negligible).
+  void SetTransformationEpsilon(double epsilon) {
+    transformation_epsilon_ = epsilon;
+  }
+  // Terminate when the mean squared correspondence distance changes by less
+  // than this between iterations.
+  void SetEuclideanFitnessEpsilon(double epsilon) {
+    euclidean_fitness_epsilon_ = epsilon;
+  }
+
+  // Sets the target cloud and builds a search index for it.
+  void SetInputTarget(const PointCloudPtr &target);
+  // Sets the target cloud along with a search index already built over it.
+  void SetInputTarget(const PointCloudPtr &target,
+                      const SearchIndexPtr &target_index);
+
+  // Target points i with (*excluded)[i] set are ignored, both for
+  // correspondences and for the fitness score. Lets callers remove points from
+  // a shared target without copying it or rebuilding its index. The mask
+  // must outlive calls to Align; pass nullptr to use all target points.
+  void SetTargetMask(const std::vector<bool> *excluded) {
+    target_mask_ = excluded;
+  }
+
+  // Aligns source to the target. Returns true if ICP converged, in which case
+  // aligned holds the transformed source. Otherwise, aligned is a copy of
+  // the source.
+  bool Align(const PointCloud &source, PointCloud *aligned);
+
+  bool HasConverged() const {
+    return converged_;
+  }
+  // Transformation taking the source to the target.
+  Eigen::Matrix4f GetFinalTransformation() const;
+  // Mean squared distance from the aligned source points to their nearest
+  // target points (same as pcl::Registration::getFitnessScore).
+  double GetFitnessScore() const {
+    return fitness_score_;
+  }
+  int GetNumIterations() const {
+    return num_iterations_;
+  }
+
+ private:
+  double max_correspondence_distance_;
+  int max_iterations_;
+  double transformation_epsilon_;
+  double euclidean_fitness_epsilon_;
+
+  PointCloudPtr target_;
+  SearchIndexPtr target_index_;
+  const std::vector<bool> *target_mask_;
+
+  // Result of the last call to Align.
+  bool converged_;
+  double fitness_score_;
+  int num_iterations_;
+  double yaw_;
+  Eigen::Vector2d translation_;
+
+  // Scratch space for nearest neighbor queries.
+  std::vector<int> nn_indices_;
+  std::vector<float> nn_sqr_dists_;
+
+  // Finds the nearest unmasked target point to point. Returns false if there
+  // is none with squared distance at most max_sqr_dist.
+  bool FindNearestTarget(const PointT &point, float max_sqr_dist, int *index,
+                         float *sqr_dist);
+};
+}  // namespace sbpl_perception
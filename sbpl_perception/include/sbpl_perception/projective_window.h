@@ -0,0 +1,29 @@
+#pragma once
+
+/**
+ * @file projective_window.h
+ * @brief Pixel windows for projective nearest-neighbor association
+ * @author Venkatraman Narayanan
+ * Carnegie Mellon University, 2015
+ */
+
+#include <Eigen/Core>
+
+namespace sbpl_perception {
+
+// The pixel (column u, row v) a point projects to, and the half-width of the
+// square pixel window that contains the projection of every point within a
+// given radius of it. Negative half-width for points that have no window.
+struct ProjectiveWindow {
+  int u, v, half_width;
+};
+
+// Computes the window for camera_point, given in the camera frame of
+// kinect_sim's RangeLikelihood (looking down -z, rows of the depth image
+// counted from the top), with the kCamera* intrinsics. A point within radius
+// of camera_point that renders to pixel (u', v') has |u' - u| <= half_width
+// and |v' - v| <= half_width, so scanning the window finds a rendered
+// neighbor exactly when a radius search over the rendered cloud does.
+ProjectiveWindow ComputeProjectiveWindow(const Eigen::Vector3f &camera_point,
+                                         double radius);
+}  // namespace sbpl_perception
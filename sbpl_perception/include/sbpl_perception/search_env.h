@@ -13,12 +13,19 @@
 #include <perception_utils/pcl_typedefs.h>
 #include <sbpl/headers.h>
 #include <sbpl/discrete_space_information/environment_mha.h>
+#include <sbpl_perception/bounded_cache.h>
 #include <sbpl_perception/config_parser.h>
+#include <sbpl_perception/depth_patch.h>
 #include <sbpl_perception/graph_state.h>
+#include <sbpl_perception/lru_cache.h>
 #include <sbpl_perception/mpi_utils.h>
 #include <sbpl_perception/object_model.h>
+#include <sbpl_perception/pixel_set.h>
+#include <sbpl_perception/planar_icp.h>
+#include <sbpl_perception/projective_window.h>
 #include <sbpl_perception/rcnn_heuristic_factory.h>
 #include <sbpl_perception/utils/utils.h>
+#include <sbpl_perception/voxel_hash_grid.h>
 #include <sbpl_utils/hash_manager/hash_manager.h>
 
 #include <boost/mpi.hpp>
@@ -93,6 +100,49 @@ struct PERCHParams {
   // function, otherwise, it will carefully balance labeling points as
   // occluders versus minimizing the objective.
   double clutter_regularizer;
+  // If true, depth images are rendered with kinect_sim's CPU rasterizer
+  // instead of OpenGL.
+  bool use_software_rasterizer;
+  // If true, the single-object renders needed for a batch of successors are
+  // drawn together as tiles of one framebuffer.
+  bool use_batch_rendering;
+  // If true, the depth image of one render is read back asynchronously while
+  // the next one is drawn. Ignored when use_batch_rendering is set.
+  bool use_pipelined_rendering;
+  // If true, the OpenGL renderer writes millimeter depth directly, so depth
+  // images need no conversion after readback.
+  bool use_linear_depth;
+  // If true, single-object renders are restricted to the object's projected
+  // bounding box, and only that part of the frame is cleared and read back.
+  bool use_cropped_rendering;
+  // If true, every valid single-object pose is rendered once when the input
+  // is set, and successor costs are computed from those renders.
+  bool use_depth_patch_library;
+  // If true, GetSourceCost and GetLastLevelCost find rendered points near an
+  // observed point by scanning the pixels around its projection in the
+  // rendered depth image, instead of building a KdTree per successor.
+  bool use_projective_association;
+  // If true, GetICPAdjustedPose uses PlanarICP instead of
+  // pcl::IterativeClosestPointNonLinear.
+  bool use_planar_icp;
+  // If true, every processor computes its share of the successor costs with a
+  // pool of num_threads threads (0 to use all cores), each with its own
+  // software renderer. With a single MPI rank, all costs are computed in
+  // process; with one rank per node, this keeps all cores of every node busy
+  // while holding a single copy of the models and observation per node.
+  // Implies use_software_rasterizer.
+  bool use_thread_pool;
+  int num_threads;
+  // If true, ComputeCostsInParallel hands out work in chunks of
+  // dynamic_scheduling_chunk_size inputs (per thread, with use_thread_pool)
+  // to whichever rank is idle, instead of scattering equal partitions to all
+  // ranks.
+  bool use_dynamic_scheduling;
+  int dynamic_scheduling_chunk_size;
+  // Memory (in MB) the master may spend on the per-state caches of the search
+  // (successors, counted pixels and depth images); evicted entries are
+  // recomputed when needed again. 0 for unbounded.
+  int cache_memory_budget_mb;
 
   bool vis_expanded_states;
   bool print_expanded_states;
@@ -115,6 +165,19 @@ struct PERCHParams {
     ar &debug_verbose;
     ar &use_clutter_mode;
     ar &clutter_regularizer;
+    ar &use_software_rasterizer;
+    ar &use_batch_rendering;
+    ar &use_pipelined_rendering;
+    ar &use_linear_depth;
+    ar &use_cropped_rendering;
+    ar &use_depth_patch_library;
+    ar &use_projective_association;
+    ar &use_planar_icp;
+    ar &use_thread_pool;
+    ar &num_threads;
+    ar &use_dynamic_scheduling;
+    ar &dynamic_scheduling_chunk_size;
+    ar &cache_memory_budget_mb;
   }
 };
 // BOOST_IS_MPI_DATATYPE(PERCHParams);
@@ -143,12 +206,36 @@ class EnvObjectRecognition : public EnvironmentMHA {
   // If kClutterMode is true, then the rendered scene will account for
   // "occluders" in the input scene, i.e, any point in the input cloud which
   // occludes a point in the rendered scene.
+  // Returns the float depth buffer of the render, or NULL with linear depth.
   const float *GetDepthImage(GraphState s,
                              std::vector<unsigned short> *depth_image, int* num_occluders_in_input_cloud);
   const float *GetDepthImage(GraphState s,
                              std::vector<unsigned short> *depth_image);
+  // Batched version of GetDepthImage: renders the given states as tiles of a
+  // single framebuffer, kinect_simulator_->get_batch_size() states per pass.
+  void GetDepthImages(const std::vector<GraphState> &states,
+                      std::vector<std::vector<unsigned short>> *depth_images,
+                      std::vector<int> *num_occluders_in_input_cloud);
+  // Renders state s within the projected bounding box of its objects only,
+  // and returns that part of the depth image. Otherwise the same as
+  // GetDepthImage.
+  DepthPatch GetDepthPatch(const GraphState &s,
+                           int *num_occluders_in_input_cloud);
+  // Same output as GetDepthImages, but renders the states one at a time,
+  // reading back each depth image while the following states are rendered.
+  void GetDepthImagesPipelined(const std::vector<GraphState> &states,
+                               std::vector<std::vector<unsigned short>> *depth_images,
+                               std::vector<int> *num_occluders_in_input_cloud);
 
   pcl::simulation::SimExample::Ptr kinect_simulator_;
+  // Software renderers for the threads of the thread pool backend, indexed by
+  // OpenMP thread number.
+  std::vector<pcl::simulation::SimExample::Ptr> thread_simulators_;
+  // True while ComputeCostsWithThreads runs its thread pool.
+  bool computing_with_threads_;
+  // Renderer for the calling thread: its entry of thread_simulators_ inside
+  // the thread pool, and kinect_simulator_ otherwise.
+  const pcl::simulation::SimExample::Ptr &GetSimulator() const;
 
   void Initialize(const EnvConfig &env_config);
   void SetInput(const RecognitionInput &input);
@@ -165,7 +252,7 @@ class EnvObjectRecognition : public EnvironmentMHA {
 
   double GetICPAdjustedPose(const PointCloudPtr cloud_in,
                             const ContPose &pose_in, PointCloudPtr &cloud_out, ContPose *pose_out,
-                            const std::vector<int> counted_indices = std::vector<int>(0));
+                            const PixelSet *counted_pixels = nullptr);
 
   std::vector<unsigned short> GetInputDepthImage() {
     return observed_depth_image_;
@@ -230,8 +317,13 @@ class EnvObjectRecognition : public EnvironmentMHA {
   int GetBestSuccessorID(int state_id);
 
   // Compute costs of successor states in parallel using MPI. This method must
-  // be called by all processors.
+  // be called by all processors. Inputs are either split statically across
+  // processors or, with use_dynamic_scheduling, handed out in chunks by the
+  // master to whichever processor is idle. The master passes the depth images
+  // referenced by input in images (see ShareCostComputationImages); other
+  // processors pass an empty one.
   void ComputeCostsInParallel(const std::vector<CostComputationInput> &input,
+                              CostComputationImages *images,
                               std::vector<CostComputationOutput> *output, bool lazy);
 
 
@@ -284,15 +376,30 @@ class EnvObjectRecognition : public EnvironmentMHA {
   /**@brief Mapping from state IDs to states for those states that were changed
    * after evaluating true cost**/
   std::unordered_map<int, GraphState> adjusted_states_;
+  // The state whose successor the state was first evaluated as (and
+  // adjusted for). Evicted cache entries of a state are recomputed from the
+  // edge from its parent.
+  std::unordered_map<int, int> parent_ids_;
 
   // The rendering cost (or TargetCost) incurred while adding the last object
   // in this state.
   std::unordered_map<int, int> last_object_rendering_cost_;
 
-  /**@brief Mapping from State to State ID**/
-  std::unordered_map<int, std::vector<unsigned short>> depth_image_cache_;
-  std::unordered_map<int, std::vector<int>> succ_cache;
-  std::unordered_map<int, std::vector<int>> cost_cache;
+  // The caches below are bounded by perch_params_.cache_memory_budget_mb
+  // (see BoundedCache), and recompute what they miss.
+  struct CachedSuccessors {
+    std::vector<int> succ_ids;
+    std::vector<int> costs;
+  };
+  // A single-object state as evaluated when expanding the start state, and
+  // whether it was valid at all.
+  struct SingleObjectEntry {
+    bool valid;
+    SingleObjectRender render;
+    GraphState adjusted_state;
+  };
+  // Successors (and edge costs) of expanded states.
+  BoundedCache<int, CachedSuccessors> successor_cache_;
   std::unordered_map<int, unsigned short> minz_map_;
   std::unordered_map<int, unsigned short> maxz_map_;
   std::unordered_map<int, int> g_value_map_;
@@ -300,18 +407,57 @@ class EnvObjectRecognition : public EnvironmentMHA {
   // This includes all points in the observed point cloud that fall within the volume of objects assigned
   // so far in the state. For the last level states, this *does not* include the points that
   // lie outside the union volumes of all assigned objects.
-  std::unordered_map<int, std::vector<int>> counted_pixels_map_;
-  // Maps state hash to depth image.
-  std::unordered_map<GraphState, std::vector<unsigned short>>
-                                                           unadjusted_single_object_depth_image_cache_;
-  std::unordered_map<GraphState, std::vector<unsigned short>>
-                                                           adjusted_single_object_depth_image_cache_;
-  std::unordered_map<GraphState, GraphState> adjusted_single_object_state_cache_;
-
-  // pcl::search::OrganizedNeighbor<PointT>::Ptr knn;
-  pcl::search::KdTree<PointT>::Ptr knn;
+  BoundedCache<int, PixelSet> counted_pixels_cache_;
+  // Keyed by the unadjusted single-object state.
+  BoundedCache<GraphState, SingleObjectEntry> single_object_cache_;
+  // Maps single-object states (every valid model pose in the scene) to their
+  // cropped depth images. Identical on all MPI ranks.
+  std::unordered_map<GraphState, DepthPatch> depth_patch_library_;
+  // Depth images referenced by CostComputationInputs, keyed by state ID.
+  // Every processor applies the same updates to these (see
+  // ShareCostComputationImages), so the master knows what the others hold.
+  LRUCache<int, SourceImage> source_images_;
+  LRUCache<int, SingleObjectRender> single_object_renders_;
+
+  // Answers "is there an observed point within sensor_resolution" for the
+  // target cost. Built once per observation.
+  VoxelHashGrid observed_grid_;
   pcl::search::KdTree<PointT>::Ptr projected_knn_;
-  std::vector<int> valid_indices_;
+
+  // The poses of a model that pass every check of IsValidPose that does not
+  // depend on the objects already in the scene, in the order
+  // GenerateSuccessorStates visits them. They are grouped into cells of equal
+  // x and y: a cell's poses are poses[poses_begin, poses_end), and
+  // num_neighbors is the number of projected observed points found near it
+  // (at most min_neighbor_points_for_valid_pose).
+  struct ValidPoseGrid {
+    struct Cell {
+      int poses_begin, poses_end;
+      int num_neighbors;
+    };
+    std::vector<Cell> cells;
+    std::vector<ContPose> poses;
+  };
+  // One per model, built by SetObservation.
+  std::vector<ValidPoseGrid> valid_pose_grids_;
+  // Observed points with a finite depth, and their number.
+  PixelSet valid_pixels_;
+  int num_valid_pixels_;
+
+  // For every point in observed_cloud_, the window of pixels that contains
+  // all rendered points within sensor_resolution of it. Negative half-width
+  // for invalid points.
+  std::vector<ProjectiveWindow> observed_projective_windows_;
+
+  // ICP target shared by all GetICPAdjustedPose calls: the observed cloud
+  // voxel-downsampled once per observation, and a search index over it.
+  // observed_downsampled_indices_[i] is the point of
+  // downsampled_observed_cloud_ that observed_cloud_->points[i] was averaged
+  // into (-1 if none), and downsampled_voxel_sizes_[j] is the number of
+  // observed points averaged into point j.
+  pcl::search::KdTree<PointT>::Ptr downsampled_observed_knn_;
+  std::vector<int> observed_downsampled_indices_;
+  std::vector<int> downsampled_voxel_sizes_;
 
   std::vector<unsigned short> observed_depth_image_;
   PointCloudPtr original_input_cloud_, observed_cloud_, downsampled_observed_cloud_,
@@ -332,6 +478,9 @@ class EnvObjectRecognition : public EnvironmentMHA {
 
   void ResetEnvironmentState();
 
+  // Fills valid_pose_grids_ for the current observation, in parallel.
+  void ComputeValidPoseGrids();
+  // Only checks the valid poses for overlap with the objects in source_state.
   void GenerateSuccessorStates(const GraphState &source_state,
                                std::vector<GraphState> *succ_states) const;
 
@@ -339,34 +488,124 @@ class EnvObjectRecognition : public EnvironmentMHA {
   static bool GetComposedDepthImage(const std::vector<unsigned short>
                                     &source_depth_image, const std::vector<unsigned short>
                                     &last_object_depth_image, std::vector<unsigned short> *composed_depth_image);
-  bool GetSingleObjectDepthImage(const GraphState &single_object_graph_state,
-                                 std::vector<unsigned short> *single_object_depth_image, bool after_refinement);
+  // Looks up the single-object state in single_object_cache_, evaluating it
+  // in the empty scene if absent. Returns entry->valid.
+  bool GetSingleObjectEntry(const GraphState &single_object_graph_state,
+                            SingleObjectEntry *entry);
+  // Looks up the counted pixels of a state in counted_pixels_cache_,
+  // re-evaluating the edge from its parent if absent.
+  PixelSet GetCountedPixels(int state_id);
+  // Sets the byte budgets of the bounded caches from
+  // perch_params_.cache_memory_budget_mb.
+  void SetCacheBudgets();
+
+  // Renders every single-object state that is valid in the empty scene into
+  // depth_patch_library_. The renders are split across MPI ranks and then
+  // exchanged so that every rank holds the full library.
+  void ComputeDepthPatchLibrary();
+  // Returns false if the state is not in depth_patch_library_.
+  bool GetDepthPatchLibraryImage(const GraphState &single_object_graph_state,
+                                 std::vector<unsigned short> *single_object_depth_image) const;
 
   // Computes the cost for the parent-child edge. Returns the adjusted child state, where the pose
   // of the last added object is adjusted using ICP and the computed state properties.
+  // If last_object_depth_image is provided, it is used as the (unadjusted)
+  // render of the last added object instead of rendering it again.
   int GetCost(const GraphState &source_state, const GraphState &child_state,
               const std::vector<unsigned short> &source_depth_image,
-              const std::vector<int> &parent_counted_pixels,
-              std::vector<int> *child_counted_pixels,
+              const PixelSet &parent_counted_pixels,
+              PixelSet *child_counted_pixels,
               GraphState *adjusted_child_state,
               GraphStateProperties *state_properties,
               std::vector<unsigned short> *adjusted_child_depth_image,
-              std::vector<unsigned short> *unadjusted_child_depth_image);
+              std::vector<unsigned short> *unadjusted_child_depth_image,
+              const std::vector<unsigned short> *last_object_depth_image = nullptr);
+
+  // Called by all processors before computing a batch of costs. The master
+  // drops the images other processors already have from images and
+  // broadcasts the rest; every processor then adds them to its caches, marks
+  // all images referenced by the batch as recently used and evicts the least
+  // recently used ones beyond the cache capacity.
+  void ShareCostComputationImages(CostComputationImages *images);
+  // Adds the rendering of source_id to images, unless it is already cached
+  // or added.
+  void AddSourceImage(int source_id, const GraphState &source_state,
+                      CostComputationImages *images);
+
+  // Computes the costs of input[begin, end) on the calling thread into the
+  // same entries of output (which must be as large as input), adding the time
+  // spent to busy_time.
+  void ComputeCosts(const std::vector<CostComputationInput> &input, int begin,
+                    int end, std::vector<CostComputationOutput> *output, bool lazy,
+                    double *busy_time);
+  // Computes the costs of all of input on this processor, with the thread pool
+  // if use_thread_pool is set.
+  void ComputeCostsOnProcessor(const std::vector<CostComputationInput> &input,
+                               std::vector<CostComputationOutput> *output, bool lazy,
+                               double *busy_time);
+  // Thread pool backend: computes all costs of input in this process, in
+  // chunks handed to thread_simulators_.size() threads.
+  void ComputeCostsWithThreads(const std::vector<CostComputationInput> &input,
+                               std::vector<CostComputationOutput> *output, bool lazy,
+                               double *busy_time);
+  // Dynamic scheduling: the master sends chunks of input to workers as they
+  // become idle (and computes single inputs itself while all are busy), until
+  // every input is done. Workers run ServeCostComputation in the meantime.
+  void DispatchCostComputation(const std::vector<CostComputationInput> &input,
+                               std::vector<CostComputationOutput> *output, bool lazy,
+                               double *busy_time);
+  void ServeCostComputation(bool lazy, double *busy_time);
+
+  // ICP with pcl::IterativeClosestPointNonLinear, used by GetICPAdjustedPose
+  // when use_planar_icp is false. Returns true if ICP converged, in which case
+  // transformation and score are the final transformation and fitness score.
+  bool GetPCLICPTransformation(const PointCloudPtr cloud_in,
+                               const PointCloudPtr target_cloud, PointCloudPtr &cloud_out,
+                               Eigen::Matrix4f *transformation, double *score);
+
+  // Computes downsampled_observed_cloud_ and the structures that map
+  // observed points to it.
+  void DownsampleObservedCloud();
+  // Marks the points of downsampled_observed_cloud_ whose voxels contain only
+  // counted observed points.
+  void GetCountedDownsampledPoints(const PixelSet &counted_pixels,
+                                   std::vector<bool> *counted_downsampled_points);
 
   // Cost for newly rendered object. Input cloud must contain only newly rendered points.
   int GetTargetCost(const PointCloudPtr
                     partial_rendered_cloud);
   // Cost for points in observed cloud that can be computed based on the rendered cloud.
+  // With use_projective_association, full_rendered_cloud must be organized
+  // (see GetRenderedCloudForAssociation).
   int GetSourceCost(const PointCloudPtr full_rendered_cloud,
                     const ObjectState &last_object, const bool last_level,
-                    const std::vector<int> &parent_counted_pixels,
-                    std::vector<int> *child_counted_pixels);
-  // NOTE: updated_counted_pixels should always be equal to the number of
-  // points in the input point cloud.
+                    const PixelSet &parent_counted_pixels,
+                    PixelSet *child_counted_pixels);
+  // NOTE: updated_counted_pixels will always contain every valid point in the
+  // input point cloud.
   int GetLastLevelCost(const PointCloudPtr full_rendered_cloud,
                        const ObjectState &last_object,
-                       const std::vector<int> &counted_pixels,
-                       std::vector<int> *updated_counted_pixels);
+                       const PixelSet &counted_pixels,
+                       PixelSet *updated_counted_pixels);
+
+  // Point cloud of a rendered depth image in the form GetSourceCost and
+  // GetLastLevelCost expect: organized when using projective association,
+  // and containing only valid points otherwise.
+  PointCloudPtr GetRenderedCloudForAssociation(const std::vector<unsigned short>
+                                               &depth_image);
+  // True if observed_cloud_->points[observed_index] has a point of
+  // full_rendered_cloud within sensor_resolution. knn_reverse must be a
+  // KdTree over full_rendered_cloud, unless using projective association
+  // (in which case it is unused).
+  bool HasRenderedNeighbor(const PointCloudPtr &full_rendered_cloud,
+                           const pcl::search::KdTree<PointT>::Ptr &knn_reverse,
+                           int observed_index) const;
+  // Projective association: scans the window of pixels around the projection
+  // of observed_cloud_->points[observed_index] in the organized rendered cloud.
+  bool HasProjectiveNeighbor(const PointCloudPtr &organized_rendered_cloud,
+                             int observed_index) const;
+  // Computes observed_projective_windows_.
+  void ComputeObservedProjectiveWindows();
 
   // Computes the cost for the lazy parent-child edge. This is an admissible estimate of the true parent-child edge cost, computed without any
   // additional renderings. This requires the true source depth image and
@@ -376,7 +615,7 @@ class EnvObjectRecognition : public EnvironmentMHA {
                   const std::vector<unsigned short> &unadjusted_last_object_depth_image,
                   const std::vector<unsigned short> &adjusted_last_object_depth_image,
                   const GraphState &adjusted_last_object_state,
-                  const std::vector<int> &parent_counted_pixels,
+                  const PixelSet &parent_counted_pixels,
                   GraphState *adjusted_child_state,
                   GraphStateProperties *state_properties,
                   std::vector<unsigned short> *final_depth_image);
@@ -390,18 +629,34 @@ class EnvObjectRecognition : public EnvironmentMHA {
 
   bool IsValidPose(GraphState s, int model_id, ContPose p,
                    bool after_refinement) const;
+  // The parts of IsValidPose. The number of projected observed points near
+  // the pose (at most min_neighbor_points_for_valid_pose), whether the model
+  // overlaps an object of s (by inscribed radii), and whether its footprint
+  // lies on the table and contains enough constraint points.
+  int CountNeighborPoints(int model_id, const ContPose &pose,
+                          bool after_refinement) const;
+  bool OverlapsObjects(const GraphState &s, int model_id,
+                       const ContPose &pose) const;
+  bool IsValidFootprint(int model_id, const ContPose &pose) const;
 
   void LabelEuclideanClusters();
   std::vector<unsigned short> GetDepthImageFromPointCloud(
     const PointCloudPtr &cloud);
+  // In clutter mode, sets pixels of depth_image that are occluded by the
+  // observed depth image to max range. Returns the number of such pixels.
+  int MaskInputOccluders(std::vector<unsigned short> *depth_image);
+  // Same, for a width x height rectangle of the image with top left corner
+  // (x_min, y_min), given as row-major depths.
+  int MaskInputOccluders(int x_min, int y_min, int width, int height,
+                         std::vector<unsigned short> *depths);
 
   // Sets a pixel of input_depth_image to max_range if the corresponding pixel
   // in masking_depth_image occludes the pixel in input_depth_image. Otherwise,
   // the value is retained.
   static std::vector<unsigned short> ApplyOcclusionMask(const
-                                                        std::vector<unsigned short> input_depth_image,
+                                                        std::vector<unsigned short> &input_depth_image,
                                                         const
-                                                        std::vector<unsigned short> masking_depth_image);
+                                                        std::vector<unsigned short> &masking_depth_image);
   // Unused base class methods.
  public:
   bool InitializeEnv(const char *sEnvFile) {
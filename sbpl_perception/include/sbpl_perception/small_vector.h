@@ -0,0 +1,265 @@
+#pragma once
+
+/**
+ * @file small_vector.h
+ * @brief Vector with inline storage for a few elements
+ * @author Venkatraman Narayanan
+ * Carnegie Mellon University, 2015
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace sbpl_perception {
+
+// A vector that keeps up to N elements inside the object itself, and moves
+// them to the heap only when it grows beyond that. Copying a small vector that
+// fits inline does not allocate. Iterators are plain pointers, and are
+// invalidated by any operation that changes the size.
+template <typename T, size_t N>
+class SmallVector {
+ public:
+  typedef T value_type;
+  typedef size_t size_type;
+  typedef T &reference;
+  typedef const T &const_reference;
+  typedef T *iterator;
+  typedef const T *const_iterator;
+
+  SmallVector() : data_(InlineData()), size_(0), capacity_(N) {}
+
+  SmallVector(std::initializer_list<T> values) : SmallVector() {
+    Append(values.begin(), values.end());
+  }
+
+  SmallVector(const SmallVector &other) : SmallVector() {
+    Append(other.begin(), other.end());
+  }
+
+  SmallVector(SmallVector &&other) noexcept : SmallVector() {
+    MoveFrom(&other);
+  }
+
+  ~SmallVector() {
+    clear();
+    FreeHeap();
+  }
+
+  SmallVector &operator=(const SmallVector &other) {
+    if (this != &other) {
+      clear();
+      Append(other.begin(), other.end());
+    }
+
+    return *this;
+  }
+
+  SmallVector &operator=(SmallVector &&other) noexcept {
+    if (this != &other) {
+      clear();
+      MoveFrom(&other);
+    }
+
+    return *this;
+  }
+
+  SmallVector &operator=(std::initializer_list<T> values) {
+    clear();
+    Append(values.begin(), values.end());
+    return *this;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+  bool empty() const {
+    return size_ == 0;
+  }
+  size_t capacity() const {
+    return capacity_;
+  }
+  // True while the elements are held inline.
+  bool is_inline() const {
+    return data_ == InlineData();
+  }
+  // Bytes allocated on the heap, beyond sizeof(SmallVector).
+  size_t NumHeapBytes() const {
+    return is_inline() ? 0 : capacity_ * sizeof(T);
+  }
+
+  T *data() {
+    return data_;
+  }
+  const T *data() const {
+    return data_;
+  }
+  iterator begin() {
+    return data_;
+  }
+  iterator end() {
+    return data_ + size_;
+  }
+  const_iterator begin() const {
+    return data_;
+  }
+  const_iterator end() const {
+    return data_ + size_;
+  }
+
+  T &operator[](size_t index) {
+    assert(index < size_);
+    return data_[index];
+  }
+  const T &operator[](size_t index) const {
+    assert(index < size_);
+    return data_[index];
+  }
+  T &front() {
+    return (*this)[0];
+  }
+  const T &front() const {
+    return (*this)[0];
+  }
+  T &back() {
+    return (*this)[size_ - 1];
+  }
+  const T &back() const {
+    return (*this)[size_ - 1];
+  }
+
+  void reserve(size_t capacity) {
+    if (capacity > capacity_) {
+      Grow(capacity);
+    }
+  }
+
+  void push_back(const T &value) {
+    emplace_back(value);
+  }
+  void push_back(T &&value) {
+    emplace_back(std::move(value));
+  }
+
+  template <typename... Args>
+  T &emplace_back(Args &&... args) {
+    if (size_ == capacity_) {
+      return GrowAndEmplace(std::forward<Args>(args)...);
+    }
+
+    new (data_ + size_) T(std::forward<Args>(args)...);
+    return data_[size_++];
+  }
+
+  void pop_back() {
+    assert(size_ > 0);
+    data_[--size_].~T();
+  }
+
+  // Destroys the elements, but keeps the storage.
+  void clear() {
+    for (size_t ii = 0; ii < size_; ++ii) {
+      data_[ii].~T();
+    }
+
+    size_ = 0;
+  }
+
+ private:
+  typename std::aligned_storage<sizeof(T), alignof(T)>::type storage_[N];
+  T *data_;
+  size_t size_;
+  size_t capacity_;
+
+  T *InlineData() {
+    return reinterpret_cast<T *>(storage_);
+  }
+  const T *InlineData() const {
+    return reinterpret_cast<const T *>(storage_);
+  }
+
+  template <typename Iterator>
+  void Append(Iterator first, Iterator last) {
+    reserve(size_ + static_cast<size_t>(std::distance(first, last)));
+
+    for (; first != last; ++first) {
+      new (data_ + size_) T(*first);
+      ++size_;
+    }
+  }
+
+  // Takes other's heap buffer if it has one, otherwise moves its elements
+  // one at a time. Expects this to be empty, and leaves other empty.
+  void MoveFrom(SmallVector *other) {
+    if (!other->is_inline()) {
+      FreeHeap();
+      data_ = other->data_;
+      size_ = other->size_;
+      capacity_ = other->capacity_;
+      other->data_ = other->InlineData();
+      other->size_ = 0;
+      other->capacity_ = N;
+      return;
+    }
+
+    reserve(other->size_);
+
+    for (size_t ii = 0; ii < other->size_; ++ii) {
+      new (data_ + ii) T(std::move(other->data_[ii]));
+    }
+
+    size_ = other->size_;
+    other->clear();
+  }
+
+  void Grow(size_t capacity) {
+    capacity = std::max<size_t>(capacity, 1);
+    T *data = static_cast<T *>(::operator new(capacity * sizeof(T)));
+    Relocate(data, capacity);
+  }
+
+  // Builds the new element in the new buffer before the old elements are
+  // moved out, since args may refer to one of them (v.push_back(v[0])).
+  template <typename... Args>
+  T &GrowAndEmplace(Args &&... args) {
+    const size_t capacity = std::max<size_t>(2 * capacity_, 1);
+    T *data = static_cast<T *>(::operator new(capacity * sizeof(T)));
+
+    try {
+      new (data + size_) T(std::forward<Args>(args)...);
+    } catch (...) {
+      ::operator delete(data);
+      throw;
+    }
+
+    Relocate(data, capacity);
+    return data_[size_++];
+  }
+
+  // Moves the elements into data, which holds capacity elements, and takes
+  // ownership of it.
+  void Relocate(T *data, size_t capacity) {
+    for (size_t ii = 0; ii < size_; ++ii) {
+      new (data + ii) T(std::move(data_[ii]));
+      data_[ii].~T();
+    }
+
+    FreeHeap();
+    data_ = data;
+    capacity_ = capacity;
+  }
+
+  void FreeHeap() {
+    if (!is_inline()) {
+      ::operator delete(data_);
+      data_ = InlineData();
+      capacity_ = N;
+    }
+  }
+};
+}  // namespace sbpl_perception
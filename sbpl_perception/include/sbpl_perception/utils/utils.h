@@ -5,15 +5,19 @@
 #include <opencv2/contrib/contrib.hpp>
 #include <perception_utils/pcl_typedefs.h>
 #include <perception_utils/pcl_serialization.h>
+#include <sbpl_perception/bounded_cache.h>
 #include <sbpl_perception/graph_state.h>
 #include <sbpl_perception/object_state.h>
 
 #include <boost/mpi.hpp>
 #include <XmlRpcValue.h>
 
+#include <cstdint>
 #include <functional>
+#include <map>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace sbpl_perception {
 
@@ -90,6 +94,17 @@ struct ModelMetaData {
 struct EnvStats {
   int scenes_rendered;
   int scenes_valid;
+  // Time (in seconds) each MPI rank spent computing successor costs, and the
+  // wall time spent in ComputeCostsInParallel. The utilization of rank i is
+  // rank_busy_time[i] / cost_computation_time.
+  std::vector<double> rank_busy_time;
+  double cost_computation_time;
+  // Bytes of depth images and counted pixels sent between MPI ranks during
+  // cost computation, before and after encoding (see wire_codec.h).
+  uint64_t wire_raw_bytes;
+  uint64_t wire_encoded_bytes;
+  // Counters of the bounded per-state caches of the environment, by name.
+  std::map<std::string, CacheStats> cache_stats;
 };
 
 typedef std::function<int(const GraphState &state)> Heuristic;
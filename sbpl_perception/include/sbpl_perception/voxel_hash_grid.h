@@ -0,0 +1,58 @@
+#pragma once
+
+/**
+ * @file voxel_hash_grid.h
+ * @brief Fixed-radius neighbor queries on a static point cloud
+ * @author Venkatraman Narayanan
+ * Carnegie Mellon University, 2015
+ */
+
+#include <perception_utils/pcl_typedefs.h>
+
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace sbpl_perception {
+
+// Buckets a point cloud into cubic voxels whose side equals the query radius,
+// so that "is there a point within radius of p" needs to look at the 27 voxels
+// around p only. Answers are exact (same as a KdTree radius search).
+class VoxelHashGrid {
+ public:
+  VoxelHashGrid();
+
+  // Indexes the finite points of cloud for queries with the given radius.
+  void SetInputCloud(const PointCloudPtr &cloud, double radius);
+
+  // True if some indexed point is strictly within radius of point.
+  bool HasPointWithinRadius(const PointT &point) const;
+
+  // Batched version of HasPointWithinRadius over all points in cloud
+  // (parallelized with OpenMP, distance tests vectorized with SSE or AVX). has_neighbor[i] is 1 if cloud.points[i] has
+  // an indexed point within radius, and 0 otherwise.
+  void HasPointsWithinRadius(const PointCloud &cloud,
+                             std::vector<unsigned char> *has_neighbor) const;
+
+ private:
+  float radius_;
+  float sqr_radius_;
+  float inv_cell_size_;
+  // Lower corner of the indexed volume, padded by one voxel.
+  float origin_x_, origin_y_, origin_z_;
+  // Number of voxels along each axis.
+  int dim_x_, dim_y_, dim_z_;
+
+  // Coordinates of the indexed points, sorted by voxel.
+  std::vector<float> xs_, ys_, zs_;
+  // Maps a voxel key to the [begin, end) range of its points.
+  std::unordered_map<uint64_t, std::pair<int, int>> voxels_;
+
+  // Returns false if the point falls outside the indexed volume.
+  bool GetVoxel(float x, float y, float z, int *ix, int *iy, int *iz) const;
+  uint64_t GetKey(int ix, int iy, int iz) const {
+    return (static_cast<uint64_t>(iz) * dim_y_ + iy) * dim_x_ + ix;
+  }
+};
+}  // namespace sbpl_perception
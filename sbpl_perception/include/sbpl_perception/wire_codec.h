@@ -0,0 +1,41 @@
+#pragma once
+
+/**
+ * @file wire_codec.h
+ * @brief Compact encodings for depth images and pixel index lists sent over MPI
+ * @author Venkatraman Narayanan
+ * Carnegie Mellon University, 2015
+ */
+
+#include <cstdint>
+#include <vector>
+
+namespace sbpl_perception {
+
+class PixelSet;
+
+// Encodes depths (in millimeters, kKinectMaxDepth for no return) as a stream
+// of varint tokens: runs of no-returns, runs of repeats of the previous valid
+// depth, and zigzag deltas from the previous valid depth. Rendered surfaces
+// are smooth, so most pixels take a single byte instead of two.
+void EncodeDepths(const std::vector<unsigned short> &depths,
+                  std::vector<uint8_t> *bytes);
+// Inverse of EncodeDepths. Returns false if bytes is malformed.
+bool DecodeDepths(const std::vector<uint8_t> &bytes,
+                  std::vector<unsigned short> *depths);
+
+// Encodes a set of pixel indices in whichever is smaller of two formats:
+// varint deltas between the indices in increasing order, or the bitset
+// itself.
+void EncodePixelSet(const PixelSet &pixels, std::vector<uint8_t> *bytes);
+// Inverse of EncodePixelSet. Returns false if bytes is malformed.
+bool DecodePixelSet(const std::vector<uint8_t> &bytes, PixelSet *pixels);
+
+// Running totals, over all encodes in this process, of the bytes the raw
+// vectors would have taken and of the bytes actually produced.
+struct WireCodecBytes {
+  uint64_t raw_bytes;
+  uint64_t encoded_bytes;
+};
+WireCodecBytes GetWireCodecBytes();
+}  // namespace sbpl_perception
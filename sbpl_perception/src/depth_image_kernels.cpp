@@ -0,0 +1,367 @@
+/**
+ * @file depth_image_kernels.cpp
+ * @brief Vectorized whole-image operations on depth images
+ * @author Venkatraman Narayanan
+ * Carnegie Mellon University, 2015
+ */
+
+#include <sbpl_perception/depth_image_kernels.h>
+
+#include <sbpl_perception/utils/utils.h>
+
+#include <algorithm>
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+namespace sbpl_perception {
+
+namespace {
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+
+// Thin wrappers around the 16-bit unsigned integer intrinsics, so that the
+// kernels below are written once for both vector widths.
+struct SSE4Ops {
+  typedef __m128i Vec;
+  static constexpr int kLanes = 8;
+  static constexpr unsigned int kLaneBits = 0x5555;
+
+  static Vec Load(const unsigned short *src) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+  }
+  static void Store(unsigned short *dst, Vec v) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), v);
+  }
+  static Vec Set1(unsigned short value) {
+    return _mm_set1_epi16(static_cast<short>(value));
+  }
+  static Vec Min(Vec a, Vec b) {
+    return _mm_min_epu16(a, b);
+  }
+  static Vec Max(Vec a, Vec b) {
+    return _mm_max_epu16(a, b);
+  }
+  static Vec Equal(Vec a, Vec b) {
+    return _mm_cmpeq_epi16(a, b);
+  }
+  static Vec And(Vec a, Vec b) {
+    return _mm_and_si128(a, b);
+  }
+  // ~a & b
+  static Vec AndNot(Vec a, Vec b) {
+    return _mm_andnot_si128(a, b);
+  }
+  static Vec Or(Vec a, Vec b) {
+    return _mm_or_si128(a, b);
+  }
+  // mask ? b : a
+  static Vec Select(Vec a, Vec b, Vec mask) {
+    return _mm_blendv_epi8(a, b, mask);
+  }
+  // Two bits per lane.
+  static unsigned int MoveMask(Vec mask) {
+    return static_cast<unsigned int>(_mm_movemask_epi8(mask));
+  }
+  static unsigned short HorizontalMin(Vec v) {
+    return static_cast<unsigned short>(_mm_extract_epi16(_mm_minpos_epu16(v), 0));
+  }
+  static unsigned short HorizontalMax(Vec v) {
+    const __m128i ones = _mm_set1_epi16(-1);
+    return static_cast<unsigned short>(~_mm_extract_epi16(_mm_minpos_epu16(
+                                                            _mm_xor_si128(v, ones)), 0));
+  }
+};
+
+#if defined(__AVX2__)
+struct AVX2Ops {
+  typedef __m256i Vec;
+  static constexpr int kLanes = 16;
+  static constexpr unsigned int kLaneBits = 0x55555555;
+
+  static Vec Load(const unsigned short *src) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+  }
+  static void Store(unsigned short *dst, Vec v) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), v);
+  }
+  static Vec Set1(unsigned short value) {
+    return _mm256_set1_epi16(static_cast<short>(value));
+  }
+  static Vec Min(Vec a, Vec b) {
+    return _mm256_min_epu16(a, b);
+  }
+  static Vec Max(Vec a, Vec b) {
+    return _mm256_max_epu16(a, b);
+  }
+  static Vec Equal(Vec a, Vec b) {
+    return _mm256_cmpeq_epi16(a, b);
+  }
+  static Vec And(Vec a, Vec b) {
+    return _mm256_and_si256(a, b);
+  }
+  static Vec AndNot(Vec a, Vec b) {
+    return _mm256_andnot_si256(a, b);
+  }
+  static Vec Or(Vec a, Vec b) {
+    return _mm256_or_si256(a, b);
+  }
+  static Vec Select(Vec a, Vec b, Vec mask) {
+    return _mm256_blendv_epi8(a, b, mask);
+  }
+  static unsigned int MoveMask(Vec mask) {
+    return static_cast<unsigned int>(_mm256_movemask_epi8(mask));
+  }
+  static unsigned short HorizontalMin(Vec v) {
+    return SSE4Ops::HorizontalMin(_mm_min_epu16(_mm256_castsi256_si128(v),
+                                                _mm256_extracti128_si256(v, 1)));
+  }
+  static unsigned short HorizontalMax(Vec v) {
+    return SSE4Ops::HorizontalMax(_mm_max_epu16(_mm256_castsi256_si128(v),
+                                                _mm256_extracti128_si256(v, 1)));
+  }
+};
+typedef AVX2Ops VecOps;
+#else
+typedef SSE4Ops VecOps;
+#endif
+
+// Occlusion test and new-pixel bookkeeping for one vector of pixels. Returns
+// true if succ occludes parent anywhere in the vector.
+inline bool FindNewPixelsVec(VecOps::Vec parent, VecOps::Vec succ,
+                             int offset, VecOps::Vec *min_depth, VecOps::Vec *max_depth,
+                             std::vector<int> *new_pixel_indices) {
+  const VecOps::Vec max_range = VecOps::Set1(kKinectMaxDepth);
+  const VecOps::Vec parent_invalid = VecOps::Equal(parent, max_range);
+  const VecOps::Vec succ_invalid = VecOps::Equal(succ, max_range);
+  // succ < parent, with both valid. Depths above kKinectMaxDepth count as
+  // valid, as in FindNewPixelsScalar, so a no-return succ can be less than a
+  // valid parent.
+  const VecOps::Vec closer = VecOps::AndNot(VecOps::Equal(succ, parent),
+                                            VecOps::Equal(VecOps::Min(succ, parent), succ));
+  const VecOps::Vec either_invalid = VecOps::Or(parent_invalid, succ_invalid);
+
+  if (VecOps::MoveMask(VecOps::AndNot(either_invalid, closer)) != 0) {
+    return true;
+  }
+
+  const VecOps::Vec is_new = VecOps::AndNot(succ_invalid, parent_invalid);
+  unsigned int new_bits = VecOps::MoveMask(is_new) & VecOps::kLaneBits;
+
+  if (new_bits == 0) {
+    return false;
+  }
+
+  *min_depth = VecOps::Min(*min_depth, VecOps::Select(max_range, succ, is_new));
+  *max_depth = VecOps::Max(*max_depth, VecOps::And(is_new, succ));
+
+  while (new_bits != 0) {
+    new_pixel_indices->push_back(offset + (__builtin_ctz(new_bits) >> 1));
+    new_bits &= new_bits - 1;
+  }
+
+  return false;
+}
+
+// Shared body of FindNewPixels and ComposeAndFindNewPixels. If composed is
+// not null, succ is min(parent, object) and is written to composed, otherwise
+// succ is object.
+bool FindNewPixelsImpl(const unsigned short *parent,
+                       const unsigned short *object, int num_pixels, unsigned short *composed,
+                       std::vector<int> *new_pixel_indices, unsigned short *min_depth,
+                       unsigned short *max_depth) {
+  new_pixel_indices->clear();
+  VecOps::Vec min_depth_vec = VecOps::Set1(kKinectMaxDepth);
+  VecOps::Vec max_depth_vec = VecOps::Set1(0);
+  const int num_vec_pixels = num_pixels - num_pixels % VecOps::kLanes;
+  bool is_occluded = false;
+  int ii = 0;
+
+  for (; ii < num_vec_pixels; ii += VecOps::kLanes) {
+    const VecOps::Vec parent_vec = VecOps::Load(parent + ii);
+    VecOps::Vec succ_vec = VecOps::Load(object + ii);
+
+    if (composed != nullptr) {
+      succ_vec = VecOps::Min(parent_vec, succ_vec);
+      VecOps::Store(composed + ii, succ_vec);
+    }
+
+    if (FindNewPixelsVec(parent_vec, succ_vec, ii, &min_depth_vec,
+                         &max_depth_vec, new_pixel_indices)) {
+      is_occluded = true;
+      ii += VecOps::kLanes;
+      break;
+    }
+  }
+
+  *min_depth = VecOps::HorizontalMin(min_depth_vec);
+  *max_depth = VecOps::HorizontalMax(max_depth_vec);
+
+  if (!is_occluded) {
+    // Remaining pixels that do not fill a vector.
+    std::vector<int> tail_indices;
+    unsigned short tail_min_depth, tail_max_depth;
+    const int tail = num_pixels - ii;
+    std::vector<unsigned short> tail_succ(object + ii, object + num_pixels);
+
+    if (composed != nullptr) {
+      ComposeDepthImagesScalar(parent + ii, object + ii, composed + ii, tail);
+      std::copy(composed + ii, composed + num_pixels, tail_succ.begin());
+    }
+
+    is_occluded = FindNewPixelsScalar(parent + ii, tail_succ.data(), tail,
+                                      &tail_indices, &tail_min_depth, &tail_max_depth);
+
+    for (int index : tail_indices) {
+      new_pixel_indices->push_back(ii + index);
+    }
+
+    *min_depth = std::min(*min_depth, tail_min_depth);
+    *max_depth = std::max(*max_depth, tail_max_depth);
+  } else if (composed != nullptr) {
+    ComposeDepthImages(parent + ii, object + ii, composed + ii, num_pixels - ii);
+  }
+
+  if (is_occluded) {
+    new_pixel_indices->clear();
+    *min_depth = kKinectMaxDepth;
+    *max_depth = 0;
+  }
+
+  return is_occluded;
+}
+
+#endif
+}  // namespace
+
+const char *DepthImageKernelsInstructionSet() {
+#if defined(__AVX2__)
+  return "AVX2";
+#elif defined(__SSE4_1__)
+  return "SSE4.1";
+#else
+  return "scalar";
+#endif
+}
+
+void ComposeDepthImagesScalar(const unsigned short *first,
+                              const unsigned short *second, unsigned short *composed, int num_pixels) {
+  for (int ii = 0; ii < num_pixels; ++ii) {
+    composed[ii] = std::min(first[ii], second[ii]);
+  }
+}
+
+bool FindNewPixelsScalar(const unsigned short *parent,
+                         const unsigned short *succ, int num_pixels, std::vector<int> *new_pixel_indices,
+                         unsigned short *min_depth, unsigned short *max_depth) {
+  new_pixel_indices->clear();
+  *min_depth = kKinectMaxDepth;
+  *max_depth = 0;
+
+  for (int ii = 0; ii < num_pixels; ++ii) {
+    if (succ[ii] == kKinectMaxDepth) {
+      continue;
+    }
+
+    if (parent[ii] == kKinectMaxDepth) {
+      new_pixel_indices->push_back(ii);
+      *min_depth = std::min(*min_depth, succ[ii]);
+      *max_depth = std::max(*max_depth, succ[ii]);
+    } else if (succ[ii] < parent[ii]) {
+      new_pixel_indices->clear();
+      *min_depth = kKinectMaxDepth;
+      *max_depth = 0;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void ApplyOcclusionMaskScalar(const unsigned short *input,
+                              const unsigned short *mask, unsigned short *masked, int num_pixels) {
+  for (int ii = 0; ii < num_pixels; ++ii) {
+    masked[ii] = mask[ii] > input[ii] ? input[ii] : kKinectMaxDepth;
+  }
+}
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+
+void ComposeDepthImages(const unsigned short *first,
+                        const unsigned short *second, unsigned short *composed, int num_pixels) {
+  const int num_vec_pixels = num_pixels - num_pixels % VecOps::kLanes;
+
+  for (int ii = 0; ii < num_vec_pixels; ii += VecOps::kLanes) {
+    VecOps::Store(composed + ii, VecOps::Min(VecOps::Load(first + ii),
+                                             VecOps::Load(second + ii)));
+  }
+
+  ComposeDepthImagesScalar(first + num_vec_pixels, second + num_vec_pixels,
+                           composed + num_vec_pixels, num_pixels - num_vec_pixels);
+}
+
+bool FindNewPixels(const unsigned short *parent, const unsigned short *succ,
+                   int num_pixels, std::vector<int> *new_pixel_indices,
+                   unsigned short *min_depth, unsigned short *max_depth) {
+  return FindNewPixelsImpl(parent, succ, num_pixels, nullptr,
+                           new_pixel_indices, min_depth, max_depth);
+}
+
+bool ComposeAndFindNewPixels(const unsigned short *parent,
+                             const unsigned short *object, int num_pixels, unsigned short *composed,
+                             std::vector<int> *new_pixel_indices, unsigned short *min_depth,
+                             unsigned short *max_depth) {
+  return FindNewPixelsImpl(parent, object, num_pixels, composed,
+                           new_pixel_indices, min_depth, max_depth);
+}
+
+void ApplyOcclusionMask(const unsigned short *input, const unsigned short *mask,
+                        unsigned short *masked, int num_pixels) {
+  const VecOps::Vec max_range = VecOps::Set1(kKinectMaxDepth);
+  const int num_vec_pixels = num_pixels - num_pixels % VecOps::kLanes;
+
+  for (int ii = 0; ii < num_vec_pixels; ii += VecOps::kLanes) {
+    const VecOps::Vec input_vec = VecOps::Load(input + ii);
+    const VecOps::Vec mask_vec = VecOps::Load(mask + ii);
+    // mask <= input
+    const VecOps::Vec not_greater = VecOps::Equal(VecOps::Min(mask_vec,
+                                                              input_vec), mask_vec);
+    VecOps::Store(masked + ii, VecOps::Select(input_vec, max_range,
+                                              not_greater));
+  }
+
+  ApplyOcclusionMaskScalar(input + num_vec_pixels, mask + num_vec_pixels,
+                           masked + num_vec_pixels, num_pixels - num_vec_pixels);
+}
+
+#else
+
+void ComposeDepthImages(const unsigned short *first,
+                        const unsigned short *second, unsigned short *composed, int num_pixels) {
+  ComposeDepthImagesScalar(first, second, composed, num_pixels);
+}
+
+bool FindNewPixels(const unsigned short *parent, const unsigned short *succ,
+                   int num_pixels, std::vector<int> *new_pixel_indices,
+                   unsigned short *min_depth, unsigned short *max_depth) {
+  return FindNewPixelsScalar(parent, succ, num_pixels, new_pixel_indices,
+                             min_depth, max_depth);
+}
+
+bool ComposeAndFindNewPixels(const unsigned short *parent,
+                             const unsigned short *object, int num_pixels, unsigned short *composed,
+                             std::vector<int> *new_pixel_indices, unsigned short *min_depth,
+                             unsigned short *max_depth) {
+  ComposeDepthImagesScalar(parent, object, composed, num_pixels);
+  return FindNewPixelsScalar(parent, composed, num_pixels, new_pixel_indices,
+                             min_depth, max_depth);
+}
+
+void ApplyOcclusionMask(const unsigned short *input, const unsigned short *mask,
+                        unsigned short *masked, int num_pixels) {
+  ApplyOcclusionMaskScalar(input, mask, masked, num_pixels);
+}
+
+#endif
+}  // namespace sbpl_perception
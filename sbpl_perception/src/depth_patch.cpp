@@ -0,0 +1,164 @@
+/**
+ * @file depth_patch.cpp
+ * @brief Sparse depth image: the bounding box of its valid pixels
+ * @author Venkatraman Narayanan
+ * Carnegie Mellon University, 2015
+ */
+
+#include <sbpl_perception/depth_patch.h>
+
+#include <algorithm>
+#include <cassert>
+
+namespace sbpl_perception {
+
+DepthPatch::DepthPatch() : x_min_(0), y_min_(0), width_(0), height_(0) {}
+
+DepthPatch::DepthPatch(const std::vector<unsigned short> &depth_image) :
+  x_min_(0), y_min_(0), width_(0), height_(0) {
+  assert(static_cast<int>(depth_image.size()) == kNumPixels);
+  Crop(depth_image.data(), kDepthImageWidth, 0, 0, kDepthImageWidth,
+       kDepthImageHeight);
+}
+
+DepthPatch::DepthPatch(int x_min, int y_min, int width, int height,
+                       const std::vector<unsigned short> &depths) :
+  x_min_(0), y_min_(0), width_(0), height_(0) {
+  assert(x_min >= 0 && y_min >= 0 && x_min + width <= kDepthImageWidth &&
+         y_min + height <= kDepthImageHeight);
+  assert(static_cast<int>(depths.size()) == width * height);
+  Crop(depths.data(), width, x_min, y_min, width, height);
+}
+
+void DepthPatch::Crop(const unsigned short *depths, int stride, int x_min,
+                      int y_min, int width, int height) {
+  int x_begin = width;
+  int x_end = -1;
+  int y_begin = height;
+  int y_end = -1;
+
+  for (int ii = 0; ii < height; ++ii) {
+    for (int jj = 0; jj < width; ++jj) {
+      if (depths[ii * stride + jj] == kKinectMaxDepth) {
+        continue;
+      }
+
+      x_begin = std::min(x_begin, jj);
+      x_end = std::max(x_end, jj);
+      y_begin = std::min(y_begin, ii);
+      y_end = std::max(y_end, ii);
+    }
+  }
+
+  if (x_end < 0) {
+    return;
+  }
+
+  x_min_ = x_min + x_begin;
+  y_min_ = y_min + y_begin;
+  width_ = x_end - x_begin + 1;
+  height_ = y_end - y_begin + 1;
+  depths_.resize(width_ * height_);
+
+  for (int ii = 0; ii < height_; ++ii) {
+    const unsigned short *row_begin = depths + (y_begin + ii) * stride +
+                                      x_begin;
+    std::copy(row_begin, row_begin + width_, depths_.begin() + ii * width_);
+  }
+}
+
+unsigned short DepthPatch::GetDepth(int pixel_index) const {
+  const int x = pixel_index % kDepthImageWidth - x_min_;
+  const int y = pixel_index / kDepthImageWidth - y_min_;
+
+  if (x < 0 || x >= width_ || y < 0 || y >= height_) {
+    return kKinectMaxDepth;
+  }
+
+  return depths_[y * width_ + x];
+}
+
+void DepthPatch::GetDepthImage(std::vector<unsigned short> *depth_image)
+const {
+  depth_image->assign(kNumPixels, kKinectMaxDepth);
+
+  for (int ii = 0; ii < height_; ++ii) {
+    const auto row_begin = depths_.begin() + ii * width_;
+    std::copy(row_begin, row_begin + width_,
+              depth_image->begin() + (y_min_ + ii) * kDepthImageWidth + x_min_);
+  }
+}
+
+void DepthPatch::ComposeInto(std::vector<unsigned short> *depth_image) const {
+  assert(static_cast<int>(depth_image->size()) == kNumPixels);
+
+  for (int ii = 0; ii < height_; ++ii) {
+    const unsigned short *patch_row = &depths_[ii * width_];
+    unsigned short *image_row = &depth_image->at((y_min_ + ii) *
+                                                 kDepthImageWidth + x_min_);
+
+    for (int jj = 0; jj < width_; ++jj) {
+      image_row[jj] = std::min(image_row[jj], patch_row[jj]);
+    }
+  }
+}
+
+DepthPatch DepthPatch::Compose(const DepthPatch &first,
+                               const DepthPatch &second) {
+  if (first.empty()) {
+    return second;
+  }
+
+  if (second.empty()) {
+    return first;
+  }
+
+  DepthPatch composed;
+  composed.x_min_ = std::min(first.x_min_, second.x_min_);
+  composed.y_min_ = std::min(first.y_min_, second.y_min_);
+  composed.width_ = std::max(first.x_min_ + first.width_,
+                             second.x_min_ + second.width_) - composed.x_min_;
+  composed.height_ = std::max(first.y_min_ + first.height_,
+                              second.y_min_ + second.height_) - composed.y_min_;
+  composed.depths_.resize(composed.width_ * composed.height_, kKinectMaxDepth);
+
+  auto compose_patch = [&composed](const DepthPatch & patch) {
+    for (int ii = 0; ii < patch.height_; ++ii) {
+      const int composed_row_start = (patch.y_min_ + ii - composed.y_min_) *
+                                     composed.width_ + patch.x_min_ - composed.x_min_;
+
+      for (int jj = 0; jj < patch.width_; ++jj) {
+        unsigned short &depth = composed.depths_[composed_row_start + jj];
+        depth = std::min(depth, patch.depths_[ii * patch.width_ + jj]);
+      }
+    }
+  };
+
+  compose_patch(first);
+  compose_patch(second);
+  return composed;
+}
+
+bool DepthPatch::Occludes(const DepthPatch &other) const {
+  // Only the intersection of the two bounding boxes can overlap.
+  const int x_begin = std::max(x_min_, other.x_min_);
+  const int y_begin = std::max(y_min_, other.y_min_);
+  const int x_end = std::min(x_min_ + width_, other.x_min_ + other.width_);
+  const int y_end = std::min(y_min_ + height_, other.y_min_ + other.height_);
+
+  for (int y = y_begin; y < y_end; ++y) {
+    for (int x = x_begin; x < x_end; ++x) {
+      const unsigned short depth = depths_[(y - y_min_) * width_ + x - x_min_];
+      const unsigned short other_depth = other.depths_[(y - other.y_min_) *
+                                                       other.width_ + x - other.x_min_];
+
+      if (depth != kKinectMaxDepth && other_depth != kKinectMaxDepth &&
+          depth < other_depth) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+}  // namespace sbpl_perception
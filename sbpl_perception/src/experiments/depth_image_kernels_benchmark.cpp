@@ -0,0 +1,128 @@
+/**
+ * @file depth_image_kernels_benchmark.cpp
+ * @brief Micro-benchmark for the vectorized depth image kernels
+ * @author Venkatraman Narayanan
+ * Carnegie Mellon University, 2015
+ */
+
+#include <sbpl_perception/depth_image_kernels.h>
+#include <sbpl_perception/utils/utils.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace std;
+using namespace sbpl_perception;
+
+namespace {
+constexpr int kNumIterations = 1000;
+
+// Draws num_boxes random axis-aligned boxes of constant depth into the image,
+// keeping the closest depth at every pixel.
+void DrawRandomBoxes(int num_boxes, unsigned short min_depth,
+                     unsigned short max_depth, std::mt19937 *rng,
+                     vector<unsigned short> *depth_image) {
+  uniform_int_distribution<int> x_dist(0, kDepthImageWidth - 1);
+  uniform_int_distribution<int> y_dist(0, kDepthImageHeight - 1);
+  uniform_int_distribution<int> depth_dist(min_depth, max_depth);
+
+  for (int ii = 0; ii < num_boxes; ++ii) {
+    const int x_min = x_dist(*rng);
+    const int y_min = y_dist(*rng);
+    const int x_max = std::min(kDepthImageWidth, x_min + 120);
+    const int y_max = std::min(kDepthImageHeight, y_min + 90);
+    const unsigned short depth = static_cast<unsigned short>(depth_dist(*rng));
+
+    for (int y = y_min; y < y_max; ++y) {
+      for (int x = x_min; x < x_max; ++x) {
+        unsigned short &pixel = depth_image->at(y * kDepthImageWidth + x);
+        pixel = std::min(pixel, depth);
+      }
+    }
+  }
+}
+
+template <typename Func>
+double TimeMicroseconds(Func func) {
+  const auto start = chrono::high_resolution_clock::now();
+
+  for (int ii = 0; ii < kNumIterations; ++ii) {
+    func();
+  }
+
+  const auto end = chrono::high_resolution_clock::now();
+  return chrono::duration<double, micro>(end - start).count() / kNumIterations;
+}
+
+void Report(const char *name, double scalar_time, double vector_time) {
+  printf("%-28s scalar: %8.1f us   %s: %8.1f us   speedup: %.2fx\n", name,
+         scalar_time, DepthImageKernelsInstructionSet(), vector_time,
+         scalar_time / vector_time);
+}
+}  // namespace
+
+int main() {
+  std::mt19937 rng(0);
+
+  // Parent: a few objects in the foreground. Object: an object behind them,
+  // so that the occlusion test has to scan the whole frame.
+  vector<unsigned short> parent(kNumPixels, kKinectMaxDepth);
+  vector<unsigned short> object(kNumPixels, kKinectMaxDepth);
+  DrawRandomBoxes(4, 500, 1000, &rng, &parent);
+  DrawRandomBoxes(1, 1500, 2000, &rng, &object);
+
+  vector<unsigned short> composed_scalar(kNumPixels), composed(kNumPixels);
+  vector<unsigned short> masked_scalar(kNumPixels), masked(kNumPixels);
+  vector<int> indices_scalar, indices;
+  unsigned short min_scalar, max_scalar, min_depth, max_depth;
+  bool occluded_scalar = false, occluded = false;
+
+  const double compose_scalar_time = TimeMicroseconds([&]() {
+    ComposeDepthImagesScalar(parent.data(), object.data(), composed_scalar.data(),
+                             kNumPixels);
+  });
+  const double compose_time = TimeMicroseconds([&]() {
+    ComposeDepthImages(parent.data(), object.data(), composed.data(), kNumPixels);
+  });
+
+  const double find_scalar_time = TimeMicroseconds([&]() {
+    occluded_scalar = FindNewPixelsScalar(parent.data(), composed_scalar.data(),
+                                          kNumPixels, &indices_scalar, &min_scalar, &max_scalar);
+  });
+  const double find_time = TimeMicroseconds([&]() {
+    occluded = FindNewPixels(parent.data(), composed.data(), kNumPixels,
+                             &indices, &min_depth, &max_depth);
+  });
+
+  // The fused kernel replaces compose followed by the occlusion test.
+  const double fused_time = TimeMicroseconds([&]() {
+    occluded = ComposeAndFindNewPixels(parent.data(), object.data(), kNumPixels,
+                                       composed.data(), &indices, &min_depth, &max_depth);
+  });
+
+  const double mask_scalar_time = TimeMicroseconds([&]() {
+    ApplyOcclusionMaskScalar(object.data(), parent.data(), masked_scalar.data(),
+                             kNumPixels);
+  });
+  const double mask_time = TimeMicroseconds([&]() {
+    ApplyOcclusionMask(object.data(), parent.data(), masked.data(), kNumPixels);
+  });
+
+  const bool results_match = composed == composed_scalar &&
+                             indices == indices_scalar && occluded == occluded_scalar &&
+                             min_depth == min_scalar && max_depth == max_scalar &&
+                             masked == masked_scalar;
+
+  printf("%dx%d frames, %zu new pixels, %d iterations\n", kDepthImageWidth,
+         kDepthImageHeight, indices_scalar.size(), kNumIterations);
+  Report("ComposeDepthImages", compose_scalar_time, compose_time);
+  Report("FindNewPixels", find_scalar_time, find_time);
+  Report("Compose + FindNewPixels", compose_scalar_time + find_scalar_time,
+         fused_time);
+  Report("ApplyOcclusionMask", mask_scalar_time, mask_time);
+  printf("Results match: %s\n", results_match ? "yes" : "NO");
+  return results_match ? 0 : 1;
+}
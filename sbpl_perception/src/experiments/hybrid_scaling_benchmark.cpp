@@ -0,0 +1,209 @@
+/**
+ * @file hybrid_scaling_benchmark.cpp
+ * @brief Scaling of the hybrid MPI + threads mode over simulated nodes
+ * @author Venkatraman Narayanan
+ * Carnegie Mellon University, 2015
+ */
+
+// Run through hybrid_scaling_benchmark.launch. Without a --nodes argument, the
+// program relaunches itself under mpirun with 1, 2 and 4 ranks, each rank
+// standing in for a node that owns cores / nodes threads, and tabulates the
+// results. Every configuration localizes the objects of the demo scene.
+
+#include <perception_utils/pcl_typedefs.h>
+#include <ros/package.h>
+#include <ros/ros.h>
+#include <sbpl_perception/object_recognizer.h>
+#include <sbpl_perception/utils/utils.h>
+
+#include <pcl/io/pcd_io.h>
+
+#include <boost/mpi.hpp>
+#include <Eigen/Core>
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace sbpl_perception;
+
+namespace {
+constexpr int kNumTrials = 3;
+const vector<int> kNumNodes = {1, 2, 4};
+
+struct ScalingResult {
+  int nodes;
+  int threads_per_node;
+  double time;
+  double cost_computation_time;
+  double utilization;
+  double max_rss_per_node;
+  double total_rss;
+};
+
+// Value of the --name argument, or default_value if absent.
+int GetIntArg(int argc, char **argv, const char *name, int default_value) {
+  for (int ii = 1; ii + 1 < argc; ++ii) {
+    if (strcmp(argv[ii], name) == 0) {
+      return atoi(argv[ii + 1]);
+    }
+  }
+
+  return default_value;
+}
+
+RecognitionInput GetDemoInput() {
+  RecognitionInput input;
+  input.camera_pose.matrix() <<
+                             0.00974155,   0.997398, -0.0714239,  -0.031793,
+                             -0.749216,  -0.040025,  -0.661116,   0.743224,
+                             -0.662254,  0.0599522,   0.746877,   0.878005,
+                             0,          0,          0,          1;
+  input.x_min = -0.179464;
+  input.x_max = 0.141014;
+  input.y_min = -0.397647;
+  input.y_max = 0.0103991;
+  input.table_height = 0.0;
+  input.model_names = vector<string>({"tilex_spray", "tide", "glass_7"});
+
+  const string demo_pcd_file = ros::package::getPath("sbpl_perception") +
+                               "/demo/demo_pointcloud.pcd";
+
+  if (pcl::io::loadPCDFile<PointT>(demo_pcd_file.c_str(), input.cloud) != 0) {
+    printf("ERROR: Could not find demo PCD file %s\n", demo_pcd_file.c_str());
+  }
+
+  return input;
+}
+
+// Runs one configuration; every rank of the MPI job acts as one node.
+int RunNodes(int argc, char **argv, int cores) {
+  boost::mpi::environment env(argc, argv);
+  std::shared_ptr<boost::mpi::communicator> world(new
+                                                  boost::mpi::communicator());
+  ros::init(argc, argv, "hybrid_scaling_benchmark");
+
+  const int nodes = world->size();
+  const int threads_per_node = std::max(1, cores / nodes);
+
+  // Parameters are read by the master and broadcast to all ranks.
+  if (IsMaster(world)) {
+    ros::param::set("~perch_params/use_thread_pool", true);
+    ros::param::set("~perch_params/num_threads", threads_per_node);
+  }
+
+  ObjectRecognizer object_recognizer(world);
+  const RecognitionInput input = GetDemoInput();
+
+  double time = 0, cost_computation_time = 0, busy_time = 0;
+
+  for (int trial = 0; trial < kNumTrials; ++trial) {
+    vector<Eigen::Affine3f> object_transforms;
+    const auto start = chrono::high_resolution_clock::now();
+    object_recognizer.LocalizeObjects(input, &object_transforms);
+    time += chrono::duration<double>(chrono::high_resolution_clock::now() -
+                                     start).count();
+
+    if (IsMaster(world)) {
+      const EnvStats &env_stats = object_recognizer.GetLastEnvStats();
+      cost_computation_time += env_stats.cost_computation_time;
+      busy_time += std::accumulate(env_stats.rank_busy_time.begin(),
+                                   env_stats.rank_busy_time.end(), 0.0);
+    }
+  }
+
+  // Peak resident memory of every rank, i.e., of every simulated node.
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  const double rss = usage.ru_maxrss / 1024.0;
+  vector<double> rss_per_rank;
+  boost::mpi::gather(*world, rss, rss_per_rank, kMasterRank);
+
+  if (IsMaster(world)) {
+    printf("RESULT %d %d %f %f %f %f %f\n", nodes, threads_per_node,
+           time / kNumTrials, cost_computation_time / kNumTrials,
+           cost_computation_time > 0 ? busy_time / (nodes * cost_computation_time) :
+           0.0,
+           *std::max_element(rss_per_rank.begin(), rss_per_rank.end()),
+           std::accumulate(rss_per_rank.begin(), rss_per_rank.end(), 0.0));
+  }
+
+  return 0;
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+  int cores = GetIntArg(argc, argv, "--cores", 0);
+
+  if (cores <= 0) {
+    cores = static_cast<int>(std::thread::hardware_concurrency());
+  }
+
+  if (GetIntArg(argc, argv, "--nodes", 0) > 0) {
+    return RunNodes(argc, argv, cores);
+  }
+
+  // Relaunch under mpirun once per node count, forwarding the ROS remappings
+  // so that the ranks find this node's parameters.
+  string forwarded_args;
+
+  for (int ii = 1; ii < argc; ++ii) {
+    forwarded_args += string(" '") + argv[ii] + "'";
+  }
+
+  vector<ScalingResult> results;
+
+  for (const int nodes : kNumNodes) {
+    const string command = "mpirun -n " + to_string(nodes) + " '" + argv[0] +
+                           "' --nodes " + to_string(nodes) + " --cores " + to_string(cores) +
+                           forwarded_args;
+    printf("Running %s\n", command.c_str());
+    FILE *pipe = popen(command.c_str(), "r");
+
+    if (pipe == nullptr) {
+      printf("ERROR: Could not run mpirun\n");
+      return 1;
+    }
+
+    char line[1024];
+
+    while (fgets(line, sizeof(line), pipe) != nullptr) {
+      ScalingResult result;
+
+      if (sscanf(line, "RESULT %d %d %lf %lf %lf %lf %lf", &result.nodes,
+                 &result.threads_per_node, &result.time, &result.cost_computation_time,
+                 &result.utilization, &result.max_rss_per_node,
+                 &result.total_rss) == 7) {
+        results.push_back(result);
+      } else {
+        fputs(line, stdout);
+      }
+    }
+
+    if (pclose(pipe) != 0) {
+      printf("ERROR: Run with %d nodes failed\n", nodes);
+    }
+  }
+
+  printf("\n%d cores, demo scene, mean of %d trials\n", cores, kNumTrials);
+  printf("nodes  threads/node  time (s)  cost time (s)  speedup  utilization  "
+         "max RSS/node (MB)  total RSS (MB)\n");
+
+  for (const auto &result : results) {
+    printf("%5d  %12d  %8.3f  %13.3f  %7.2f  %11.2f  %17.1f  %14.1f\n",
+           result.nodes, result.threads_per_node, result.time,
+           result.cost_computation_time, results[0].time / result.time,
+           result.utilization, result.max_rss_per_node, result.total_rss);
+  }
+
+  return results.size() == kNumNodes.size() ? 0 : 1;
+}
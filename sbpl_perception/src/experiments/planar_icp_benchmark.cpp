@@ -0,0 +1,188 @@
+/**
+ * @file planar_icp_benchmark.cpp
+ * @brief Compares PlanarICP with PCL's non-linear ICP on synthetic scenes
+ * @author Venkatraman Narayanan
+ * Carnegie Mellon University, 2015
+ */
+
+#include <sbpl_perception/planar_icp.h>
+
+#include <pcl/registration/icp_nl.h>
+#include <pcl/registration/transformation_estimation_2D.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace std;
+using namespace sbpl_perception;
+
+namespace {
+constexpr int kNumTrials = 200;
+constexpr double kMaxCorrespondence = 0.05;
+constexpr int kMaxIterations = 20;
+constexpr double kSensorResolution = 0.005;
+// Trials whose poses differ by more than this are counted as disagreements.
+constexpr double kTranslationTolerance = 1e-3;
+constexpr double kYawTolerance = 1e-3;
+
+// Samples points on the sides and top of an upright box standing on the
+// z = 0 plane, at roughly the density of a downsampled Kinect cloud.
+void AddBox(double cx, double cy, double half_x, double half_y, double height,
+            std::mt19937 *rng, PointCloud *cloud) {
+  uniform_real_distribution<double> unit(0.0, 1.0);
+  const double area = 4 * (half_x + half_y) * height + 4 * half_x * half_y;
+  const int num_points = static_cast<int>(area / (0.004 * 0.004));
+
+  for (int ii = 0; ii < num_points; ++ii) {
+    PointT point;
+    const double u = unit(*rng);
+    const double v = unit(*rng);
+
+    switch ((*rng)() % 5) {
+    case 0:
+      point.x = cx - half_x + 2 * half_x * u;
+      point.y = cy - half_y;
+      point.z = height * v;
+      break;
+
+    case 1:
+      point.x = cx - half_x + 2 * half_x * u;
+      point.y = cy + half_y;
+      point.z = height * v;
+      break;
+
+    case 2:
+      point.x = cx - half_x;
+      point.y = cy - half_y + 2 * half_y * u;
+      point.z = height * v;
+      break;
+
+    case 3:
+      point.x = cx + half_x;
+      point.y = cy - half_y + 2 * half_y * u;
+      point.z = height * v;
+      break;
+
+    default:
+      point.x = cx - half_x + 2 * half_x * u;
+      point.y = cy - half_y + 2 * half_y * v;
+      point.z = height;
+    }
+
+    cloud->points.push_back(point);
+  }
+
+  cloud->width = cloud->points.size();
+  cloud->height = 1;
+}
+
+PointCloudPtr TransformPlanar(const PointCloud &cloud, double x, double y,
+                              double yaw) {
+  PointCloudPtr transformed(new PointCloud(cloud));
+
+  for (auto &point : transformed->points) {
+    const double px = point.x;
+    const double py = point.y;
+    point.x = cos(yaw) * px - sin(yaw) * py + x;
+    point.y = sin(yaw) * px + cos(yaw) * py + y;
+  }
+
+  return transformed;
+}
+
+double Yaw(const Eigen::Matrix4f &transformation) {
+  return atan2(transformation(1, 0), transformation(0, 0));
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::mt19937 rng(0);
+  uniform_real_distribution<double> offset(-0.03, 0.03);
+  uniform_real_distribution<double> rotation(-0.2, 0.2);
+
+  double pcl_time = 0, planar_time = 0;
+  double max_translation_diff = 0, max_yaw_diff = 0, max_score_diff = 0;
+  int num_disagreements = 0, num_converged = 0;
+
+  for (int trial = 0; trial < kNumTrials; ++trial) {
+    // Observation: the object and a neighboring object.
+    PointCloudPtr object(new PointCloud);
+    AddBox(0.0, 0.0, 0.04, 0.06, 0.15, &rng, object.get());
+    PointCloudPtr target(new PointCloud(*object));
+    AddBox(0.2, 0.05, 0.05, 0.05, 0.1, &rng, target.get());
+
+    // Rendered object at a perturbed pose.
+    PointCloudPtr source = TransformPlanar(*object, offset(rng), offset(rng),
+                                           rotation(rng));
+
+    pcl::IterativeClosestPointNonLinear<PointT, PointT> pcl_icp;
+    pcl::registration::TransformationEstimation2D<PointT, PointT>::Ptr est(
+      new pcl::registration::TransformationEstimation2D<PointT, PointT>);
+    pcl_icp.setTransformationEstimation(est);
+    pcl_icp.setMaxCorrespondenceDistance(kMaxCorrespondence);
+    pcl_icp.setMaximumIterations(kMaxIterations);
+    pcl_icp.setTransformationEpsilon(1e-8);
+    pcl_icp.setEuclideanFitnessEpsilon(kSensorResolution);
+    PointCloud pcl_aligned;
+
+    // Both timings include building the target search index.
+    auto start = chrono::high_resolution_clock::now();
+    pcl_icp.setInputSource(source);
+    pcl_icp.setInputTarget(target);
+    pcl_icp.align(pcl_aligned);
+    const double pcl_score = pcl_icp.getFitnessScore();
+    auto end = chrono::high_resolution_clock::now();
+    pcl_time += chrono::duration<double, milli>(end - start).count();
+
+    PlanarICP planar_icp;
+    planar_icp.SetMaxCorrespondenceDistance(kMaxCorrespondence);
+    planar_icp.SetMaximumIterations(kMaxIterations);
+    planar_icp.SetTransformationEpsilon(1e-8);
+    planar_icp.SetEuclideanFitnessEpsilon(kSensorResolution);
+    PointCloud planar_aligned;
+
+    start = chrono::high_resolution_clock::now();
+    planar_icp.SetInputTarget(target);
+    planar_icp.Align(*source, &planar_aligned);
+    const double planar_score = planar_icp.GetFitnessScore();
+    end = chrono::high_resolution_clock::now();
+    planar_time += chrono::duration<double, milli>(end - start).count();
+
+    if (pcl_icp.hasConverged() != planar_icp.HasConverged()) {
+      ++num_disagreements;
+      continue;
+    }
+
+    if (!pcl_icp.hasConverged()) {
+      continue;
+    }
+
+    ++num_converged;
+    const Eigen::Matrix4f pcl_transformation = pcl_icp.getFinalTransformation();
+    const Eigen::Matrix4f planar_transformation =
+      planar_icp.GetFinalTransformation();
+    const double translation_diff = (pcl_transformation.block<2, 1>(0, 3) -
+                                     planar_transformation.block<2, 1>(0, 3)).norm();
+    const double yaw_diff = fabs(remainder(Yaw(pcl_transformation) - Yaw(
+                                             planar_transformation), 2 * M_PI));
+    max_translation_diff = std::max(max_translation_diff, translation_diff);
+    max_yaw_diff = std::max(max_yaw_diff, yaw_diff);
+    max_score_diff = std::max(max_score_diff, fabs(pcl_score - planar_score));
+
+    if (translation_diff > kTranslationTolerance || yaw_diff > kYawTolerance) {
+      ++num_disagreements;
+    }
+  }
+
+  printf("%d trials, %d converged\n", kNumTrials, num_converged);
+  printf("PCL ICP:    %8.3f ms per call\n", pcl_time / kNumTrials);
+  printf("PlanarICP:  %8.3f ms per call   speedup: %.2fx\n",
+         planar_time / kNumTrials, pcl_time / planar_time);
+  printf("Max difference: translation %g m, yaw %g rad, fitness %g\n",
+         max_translation_diff, max_yaw_diff, max_score_diff);
+  printf("Disagreements: %d\n", num_disagreements);
+  return num_disagreements == 0 ? 0 : 1;
+}
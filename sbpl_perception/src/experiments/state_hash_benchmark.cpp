@@ -0,0 +1,171 @@
+/**
+ * @file state_hash_benchmark.cpp
+ * @brief Insert and lookup throughput of HashManager<GraphState>
+ * @author Venkatraman Narayanan
+ * Carnegie Mellon University, 2015
+ */
+
+// Inserts a million random multi-object states into a HashManager and looks
+// them all up again, then does the same with the hash and equality that
+// GraphState used before packed keys, for comparison. Also reports how many
+// distinct hash values each produces. The legacy hash takes only a few hundred
+// values, so its map degenerates into long chains; it is timed on the first
+// kNumLegacyStates states only.
+
+#include <sbpl_perception/discretization_manager.h>
+#include <sbpl_perception/graph_state.h>
+#include <sbpl_utils/hash_manager/hash_manager.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+
+namespace {
+constexpr int kNumStates = 1000000;
+constexpr int kNumLegacyStates = 20000;
+constexpr int kMaxObjects = 4;
+constexpr int kNumModels = 6;
+// A 1 m x 1 m table at 1 cm resolution, and 10 degree yaw steps.
+constexpr int kGridSize = 100;
+constexpr double kResolution = 0.01;
+constexpr double kThetaResolution = M_PI / 18.0;
+
+// GraphState::GetHash and operator== before packed keys.
+struct LegacyHash {
+  size_t operator()(const GraphState &graph_state) const {
+    size_t hash_val = 0;
+
+    for (const auto &object_state : graph_state.object_states()) {
+      const auto &disc_pose = object_state.disc_pose();
+      hash_val ^= std::hash<int>()(disc_pose.x())
+                  ^ std::hash<int>()(disc_pose.y());
+
+      if (!object_state.symmetric()) {
+        hash_val ^= std::hash<int>()(disc_pose.yaw());
+      }
+    }
+
+    return hash_val;
+  }
+};
+
+struct LegacyEqual {
+  bool operator()(const GraphState &first, const GraphState &second) const {
+    return first.NumObjects() == second.NumObjects() &&
+           std::is_permutation(first.object_states().begin(),
+                               first.object_states().end(), second.object_states().begin());
+  }
+};
+
+vector<GraphState> GenerateStates() {
+  std::mt19937 rng(0);
+  const int num_thetas = static_cast<int>(2 * M_PI / kThetaResolution);
+  vector<GraphState> states(kNumStates);
+
+  for (auto &state : states) {
+    vector<int> model_ids(kNumModels);
+
+    for (int ii = 0; ii < kNumModels; ++ii) {
+      model_ids[ii] = ii;
+    }
+
+    std::shuffle(model_ids.begin(), model_ids.end(), rng);
+    const int num_objects = 1 + static_cast<int>(rng() % kMaxObjects);
+
+    for (int ii = 0; ii < num_objects; ++ii) {
+      const DiscPose pose(static_cast<int>(rng() % kGridSize),
+                          static_cast<int>(rng() % kGridSize), 0, 0, 0,
+                          static_cast<int>(rng() % num_thetas));
+      state.AppendObject(ObjectState(model_ids[ii], model_ids[ii] % 3 == 0,
+                                     pose));
+    }
+  }
+
+  return states;
+}
+
+template <typename Hash>
+size_t NumDistinctHashes(const vector<GraphState> &states, Hash hash) {
+  unordered_set<size_t> hashes;
+  hashes.reserve(states.size());
+
+  for (const auto &state : states) {
+    hashes.insert(hash(state));
+  }
+
+  return hashes.size();
+}
+
+double Seconds(const chrono::high_resolution_clock::time_point &start) {
+  return chrono::duration<double>(chrono::high_resolution_clock::now() -
+                                  start).count();
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+  WorldResolutionParams world_resolution_params;
+  SetWorldResolutionParams(kResolution, kResolution, kThetaResolution, 0.0,
+                           0.0, world_resolution_params);
+  DiscretizationManager::Initialize(world_resolution_params);
+
+  const vector<GraphState> states = GenerateStates();
+
+  // Packed keys, through HashManager as the search uses it.
+  sbpl_utils::HashManager<GraphState> hash_manager;
+  auto start = chrono::high_resolution_clock::now();
+
+  for (const auto &state : states) {
+    hash_manager.GetStateIDForceful(state);
+  }
+
+  const double insert_time = Seconds(start);
+  start = chrono::high_resolution_clock::now();
+  size_t id_sum = 0;
+
+  for (const auto &state : states) {
+    id_sum += hash_manager.GetStateIDForceful(state);
+  }
+
+  const double lookup_time = Seconds(start);
+
+  // The previous hash and equality, in a map of the same shape.
+  unordered_map<GraphState, int, LegacyHash, LegacyEqual> legacy_map;
+  start = chrono::high_resolution_clock::now();
+
+  for (int ii = 0; ii < kNumLegacyStates; ++ii) {
+    legacy_map.emplace(states[ii], static_cast<int>(legacy_map.size()));
+  }
+
+  const double legacy_insert_time = Seconds(start);
+  start = chrono::high_resolution_clock::now();
+  size_t legacy_id_sum = 0;
+
+  for (int ii = 0; ii < kNumLegacyStates; ++ii) {
+    legacy_id_sum += legacy_map.find(states[ii])->second;
+  }
+
+  const double legacy_lookup_time = Seconds(start);
+
+  printf("%d states (%zu distinct), up to %d objects\n", kNumStates,
+         static_cast<size_t>(hash_manager.Size()), kMaxObjects);
+  printf("hash         distinct hashes   states  insert (s)  lookup (s)  "
+         "ns/lookup\n");
+  printf("packed keys  %15zu  %7d  %10.3f  %10.3f  %9.1f\n",
+         NumDistinctHashes(states, std::hash<GraphState>()), kNumStates,
+         insert_time, lookup_time, 1e9 * lookup_time / kNumStates);
+  printf("legacy       %15zu  %7d  %10.3f  %10.3f  %9.1f\n",
+         NumDistinctHashes(states, LegacyHash()), kNumLegacyStates,
+         legacy_insert_time, legacy_lookup_time,
+         1e9 * legacy_lookup_time / kNumLegacyStates);
+
+  // Keep the lookups from being optimized away.
+  return id_sum == 0 && legacy_id_sum == 0 ? 1 : 0;
+}
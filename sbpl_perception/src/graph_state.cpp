@@ -1,16 +1,69 @@
 #include <sbpl_perception/graph_state.h>
 
 #include <algorithm>
+#include <utility>
+
+namespace {
+// The SplitMix64 finalizer: every input bit affects every output bit.
+uint64_t Mix(uint64_t value) {
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+  return value ^ (value >> 31);
+}
+
+typedef sbpl_perception::SmallVector<std::pair<uint64_t, size_t>,
+        GraphState::kNumInlineObjects> SortedKeys;
+
+// Packed keys of the objects, each with the object's index, in key order.
+void GetSortedKeys(const GraphState::ObjectStates &object_states,
+                   SortedKeys *keys) {
+  keys->clear();
+
+  for (size_t ii = 0; ii < object_states.size(); ++ii) {
+    keys->emplace_back(object_states[ii].PackedKey(), ii);
+  }
 
-GraphState::GraphState() : object_states_(0) {}
+  std::sort(keys->begin(), keys->end());
+}
+}  // namespace
+
+constexpr size_t GraphState::kNumInlineObjects;
+
+GraphState::GraphState() {}
+
+GraphState::GraphState(const GraphState &source_state,
+                       const ObjectState &object_state) {
+  object_states_.reserve(source_state.NumObjects() + 1);
+  object_states_ = source_state.object_states();
+  object_states_.push_back(object_state);
+}
 
 bool GraphState::operator==(const GraphState &other) const {
   if (NumObjects() != other.NumObjects()) {
     return false;
   }
 
-  return std::is_permutation(object_states_.begin(), object_states_.end(),
-                             other.object_states().begin());
+  SortedKeys keys;
+  SortedKeys other_keys;
+  GetSortedKeys(object_states_, &keys);
+  GetSortedKeys(other.object_states(), &other_keys);
+
+  for (size_t ii = 0; ii < keys.size(); ++ii) {
+    if (keys[ii].first != other_keys[ii].first) {
+      return false;
+    }
+  }
+
+  // Object IDs are unique within a state and lead the keys, so equal keys
+  // pair up the objects. Compare those in full for the fields the keys omit.
+  for (size_t ii = 0; ii < keys.size(); ++ii) {
+    if (object_states_[keys[ii].second] !=
+        other.object_states()[other_keys[ii].second]) {
+      return false;
+    }
+  }
+
+  return true;
 }
 
 bool GraphState::operator!=(const GraphState &other) const {
@@ -22,19 +75,15 @@ void GraphState::AppendObject(const ObjectState &object_state) {
 }
 
 size_t GraphState::GetHash() const {
-  size_t hash_val = 0;
+  // Summing the mixed keys makes the hash independent of the order of the
+  // objects, without the cancellation of XOR.
+  uint64_t hash_val = NumObjects();
 
   for (const auto &object_state : object_states()) {
-    const auto &disc_pose = object_state.disc_pose();
-    hash_val ^= std::hash<int>()(disc_pose.x())
-                ^ std::hash<int>()(disc_pose.y());
-
-    if (!object_state.symmetric()) {
-      hash_val ^= std::hash<int>()(disc_pose.yaw());
-    }
+    hash_val += Mix(object_state.PackedKey());
   }
 
-  return hash_val;
+  return static_cast<size_t>(Mix(hash_val));
 }
 
 std::ostream &operator<< (std::ostream &stream,
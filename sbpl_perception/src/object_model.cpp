@@ -17,13 +17,14 @@
 #include <pcl/filters/filter.h>
 #include <pcl/PCLPointCloud2.h>
 #include <pcl/segmentation/extract_polygonal_prism_data.h>
-#include <pcl/surface/vtk_smoothing/vtk_utils.h>
 #include <pcl/surface/convex_hull.h>
 #include <ros/package.h>
 
 #include <opencv2/highgui/highgui.hpp>
 
 #include <vtkVersion.h>
+#include <vtkCellArray.h>
+#include <vtkPoints.h>
 #include <vtkPolyData.h>
 #include <vtkPointData.h>
 #include <vtkSmartPointer.h>
@@ -210,6 +211,7 @@ ObjectModel::ObjectModel(const pcl::PolygonMesh &mesh, const string name,
   preprocessing_transform_ = PreprocessModel(mesh_in, mesh_out,
                                              kMeshInMillimeters, flipped);
   mesh_ = *mesh_out;
+  mesh_buffer_.reset(new pcl::simulation::MeshBuffer(mesh_));
   symmetric_ = symmetric;
   name_ = name;
   cloud_.reset(new PointCloud);
@@ -234,11 +236,12 @@ void ObjectModel::TransformPolyMesh(const pcl::PolygonMesh::Ptr
 void ObjectModel::SetObjectProperties() {
   pcl::PointCloud<pcl::PointXYZ>::Ptr cloud (new
                                              pcl::PointCloud<pcl::PointXYZ>);
+  pcl::fromPCLPointCloud2(mesh_.cloud, *cloud);
+  mesh_vertices_ = cloud;
   pcl::PointCloud<pcl::PointXYZ>::Ptr base_cloud (new
                                                   pcl::PointCloud<pcl::PointXYZ>);
   pcl::PointCloud<pcl::PointXYZ>::Ptr projected_cloud (new
                                                        pcl::PointCloud<pcl::PointXYZ>);
-  pcl::fromPCLPointCloud2(mesh_.cloud, *cloud);
 
   for (size_t ii = 0; ii < cloud->size(); ++ii) {
     auto point = cloud->points[ii];
@@ -332,22 +335,53 @@ double ObjectModel::GetCircumscribedRadius() const {
 
 
 pcl::PolygonMeshPtr ObjectModel::GetTransformedMesh(const ContPose &p) const {
-  pcl::PolygonMeshPtr mesh_in(new pcl::PolygonMesh(mesh_));
-  pcl::PolygonMeshPtr transformed_mesh(new pcl::PolygonMesh);
   Eigen::Matrix4f transform;
   transform = p.GetTransform().matrix().cast<float>();
-  TransformPolyMesh(mesh_in, transformed_mesh, transform);
-  return transformed_mesh;
+  return GetTransformedMesh(transform);
 }
 
 pcl::PolygonMeshPtr ObjectModel::GetTransformedMesh(const Eigen::Matrix4f
                                                     &transform ) const {
-  pcl::PolygonMeshPtr mesh_in(new pcl::PolygonMesh(mesh_));
+  // Same result as TransformPolyMesh, without copying the mesh or decoding
+  // its vertices again.
   pcl::PolygonMeshPtr transformed_mesh(new pcl::PolygonMesh);
-  TransformPolyMesh(mesh_in, transformed_mesh, transform);
+  transformed_mesh->header = mesh_.header;
+  transformed_mesh->polygons = mesh_.polygons;
+  pcl::PointCloud<pcl::PointXYZ> vertices;
+  transformPointCloud(*mesh_vertices_, vertices, transform);
+  pcl::toPCLPointCloud2(vertices, transformed_mesh->cloud);
   return transformed_mesh;
 }
 
+void ObjectModel::GetTransformedVertices(const ContPose &p,
+                                         PointCloud *vertices) const {
+  Eigen::Matrix4f transform;
+  transform = p.GetTransform().matrix().cast<float>();
+  GetTransformedVertices(transform, vertices);
+}
+
+void ObjectModel::GetTransformedVertices(const Eigen::Matrix4f &transform,
+                                         PointCloud *vertices) const {
+  const Eigen::Affine3f affine_transform(transform);
+  const size_t num_vertices = mesh_vertices_->size();
+  vertices->resize(num_vertices);
+
+  for (size_t ii = 0; ii < num_vertices; ++ii) {
+    PointT &vertex = vertices->points[ii];
+    vertex = PointT();
+    vertex.getVector3fMap() = affine_transform *
+                              mesh_vertices_->points[ii].getVector3fMap();
+  }
+}
+
+boost::shared_ptr<pcl::simulation::Model> ObjectModel::GetRenderModel(
+  const ContPose &p) const {
+  Eigen::Matrix4f transform;
+  transform = p.GetTransform().matrix().cast<float>();
+  return boost::shared_ptr<pcl::simulation::Model>(new
+                                                   pcl::simulation::MeshInstanceModel(mesh_buffer_, transform));
+}
+
 Eigen::Affine3f ObjectModel::GetRawModelToSceneTransform(
   const ContPose &p) const {
   Eigen::Matrix4f transform;
@@ -378,10 +412,33 @@ vector<bool> ObjectModel::PointsInsideMesh(const vector<Eigen::Vector3d>
   Eigen::Matrix4f transform;
   transform = pose.GetTransform().matrix().cast<float>();
   transform.block<3, 3>(0, 0) = inflation_factor_ * transform.block<3, 3>(0, 0);
-  auto transformed_mesh = GetTransformedMesh(transform);
+  const Eigen::Affine3f affine_transform(transform);
+
+  // Fill the VTK mesh straight from the decoded vertices, rather than
+  // through a transformed copy of the PolygonMesh.
+  vtkSmartPointer<vtkPoints> mesh_points = vtkSmartPointer<vtkPoints>::New();
+  mesh_points->SetNumberOfPoints(mesh_vertices_->size());
+
+  for (size_t ii = 0; ii < mesh_vertices_->size(); ++ii) {
+    const Eigen::Vector3f vertex = affine_transform *
+                                   mesh_vertices_->points[ii].getVector3fMap();
+    mesh_points->SetPoint(ii, vertex[0], vertex[1], vertex[2]);
+  }
+
+  vtkSmartPointer<vtkCellArray> mesh_polygons =
+    vtkSmartPointer<vtkCellArray>::New();
+
+  for (const auto &polygon : mesh_.polygons) {
+    mesh_polygons->InsertNextCell(static_cast<int>(polygon.vertices.size()));
+
+    for (const auto vertex_index : polygon.vertices) {
+      mesh_polygons->InsertCellPoint(vertex_index);
+    }
+  }
 
   vtkSmartPointer<vtkPolyData> vtk_mesh = vtkSmartPointer<vtkPolyData>::New();
-  pcl::VTKUtils::mesh2vtk(*transformed_mesh, vtk_mesh);
+  vtk_mesh->SetPoints(mesh_points);
+  vtk_mesh->SetPolys(mesh_polygons);
 
   vtkSmartPointer<vtkPoints> vtk_points =
     vtkSmartPointer<vtkPoints>::New();
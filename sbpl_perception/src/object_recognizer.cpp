@@ -352,6 +352,33 @@ bool ObjectRecognizer::RunPlanner(vector<ContPose> *detected_poses) const {
       cout << env_stats.scenes_rendered << " " << env_stats.scenes_valid << " "  <<
            stats_vector[0].expands
            << " " << stats_vector[0].time << " " << stats_vector[0].cost << endl;
+
+      if (env_stats.cost_computation_time > 0) {
+        cout << "Rank utilization:";
+
+        for (const double busy_time : env_stats.rank_busy_time) {
+          cout << " " << busy_time / env_stats.cost_computation_time;
+        }
+
+        cout << endl;
+      }
+
+      if (env_stats.wire_raw_bytes > 0) {
+        printf("Wire bytes: %lu encoded, %lu raw (%.1f%% saved)\n",
+               static_cast<unsigned long>(env_stats.wire_encoded_bytes),
+               static_cast<unsigned long>(env_stats.wire_raw_bytes),
+               100.0 * (1.0 - static_cast<double>(env_stats.wire_encoded_bytes) /
+                        env_stats.wire_raw_bytes));
+      }
+
+      for (const auto &cache_stats : env_stats.cache_stats) {
+        printf("Cache %s: %lu hits, %lu misses, %lu evictions, %.1f MB peak\n",
+               cache_stats.first.c_str(),
+               static_cast<unsigned long>(cache_stats.second.hits),
+               static_cast<unsigned long>(cache_stats.second.misses),
+               static_cast<unsigned long>(cache_stats.second.evictions),
+               cache_stats.second.peak_bytes / (1024.0 * 1024.0));
+      }
     }
 
     planning_finished = true;
@@ -364,16 +391,18 @@ bool ObjectRecognizer::RunPlanner(vector<ContPose> *detected_poses) const {
     // ComputeCostsInParallel.
     {
       vector<CostComputationInput> input;
+      CostComputationImages images;
       vector<CostComputationOutput> output;
       bool lazy;
-      env_obj_->ComputeCostsInParallel(input, &output, lazy);
+      env_obj_->ComputeCostsInParallel(input, &images, &output, lazy);
     }
   } else {
     while (!planning_finished) {
       vector<CostComputationInput> input;
+      CostComputationImages images;
       vector<CostComputationOutput> output;
       bool lazy;
-      env_obj_->ComputeCostsInParallel(input, &output, lazy);
+      env_obj_->ComputeCostsInParallel(input, &images, &output, lazy);
       // If master is done, exit loop.
       mpi_world_->irecv(kMasterRank, kPlanningFinishedTag, planning_finished);
     }
@@ -8,6 +8,8 @@
 
 namespace {
 constexpr double kFloatingPointTolerance = 1e-5;
+// Discrete x and y are stored in 16 bits, offset to hold negative values.
+constexpr int kPackedCoordinateOffset = 1 << 15;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -154,6 +156,20 @@ bool ObjectState::operator!=(const ObjectState &other) const {
   return !(*this == other);
 }
 
+uint64_t ObjectState::PackedKey() const {
+  // 16 bits of ID (offset by one for the goal marker -1), 1 bit of symmetry,
+  // 16 bits each of x and y, and 15 bits of yaw.
+  const uint64_t id = static_cast<uint16_t>(id_ + 1);
+  const uint64_t x = static_cast<uint16_t>(disc_pose_.x() +
+                                           kPackedCoordinateOffset);
+  const uint64_t y = static_cast<uint16_t>(disc_pose_.y() +
+                                           kPackedCoordinateOffset);
+  const uint64_t yaw = symmetric_ ? 0 : static_cast<uint64_t>
+                       (disc_pose_.yaw()) & 0x7fff;
+  return id << 48 | static_cast<uint64_t>(symmetric_) << 47 | x << 31 |
+         y << 15 | yaw;
+}
+
 std::ostream &operator<< (std::ostream &stream,
                           const ObjectState &object_state) {
   stream << "Object ID: " << object_state.id() << std::endl
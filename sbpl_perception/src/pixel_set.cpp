@@ -0,0 +1,45 @@
+/**
+ * @file pixel_set.cpp
+ * @brief Fixed-size bitset over the pixels (or observed points) of a frame
+ * @author Venkatraman Narayanan
+ * Carnegie Mellon University, 2015
+ */
+
+#include <sbpl_perception/pixel_set.h>
+
+namespace sbpl_perception {
+
+constexpr int PixelSet::kNumWords;
+
+PixelSet::PixelSet() {
+  words_.fill(0);
+}
+
+void PixelSet::Clear() {
+  words_.fill(0);
+}
+
+int PixelSet::Count() const {
+  int count = 0;
+
+  for (const uint64_t word : words_) {
+    count += __builtin_popcountll(word);
+  }
+
+  return count;
+}
+
+PixelSet &PixelSet::operator|=(const PixelSet &other) {
+  for (int ii = 0; ii < kNumWords; ++ii) {
+    words_[ii] |= other.words_[ii];
+  }
+
+  return *this;
+}
+
+void PixelSet::AndNot(const PixelSet &other) {
+  for (int ii = 0; ii < kNumWords; ++ii) {
+    words_[ii] &= ~other.words_[ii];
+  }
+}
+}  // namespace sbpl_perception
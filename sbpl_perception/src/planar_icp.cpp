@@ -0,0 +1,231 @@
+/**
+ * @file planar_icp.cpp
+ * @brief ICP restricted to (x, y, yaw) transformations
+ * @author Venkatraman Narayanan
+ * Carnegie Mellon University, 2015
+ */
+
+#include <sbpl_perception/planar_icp.h>
+
+#include <pcl/common/point_tests.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+// Same as the defaults of pcl::registration::DefaultConvergenceCriteria.
+constexpr double kRotationCosineThreshold = 0.99999;
+constexpr double kRelativeMSEThreshold = 1e-5;
+// Fewest correspondences needed for a transformation estimate.
+constexpr int kMinCorrespondences = 3;
+}  // namespace
+
+namespace sbpl_perception {
+
+PlanarICP::PlanarICP() : max_correspondence_distance_(0.05),
+  max_iterations_(10), transformation_epsilon_(0),
+  euclidean_fitness_epsilon_(-std::numeric_limits<double>::max()),
+  target_mask_(nullptr),
+  converged_(false), fitness_score_(std::numeric_limits<double>::max()),
+  num_iterations_(0), yaw_(0), translation_(Eigen::Vector2d::Zero()),
+  nn_indices_(1), nn_sqr_dists_(1) {}
+
+void PlanarICP::SetInputTarget(const PointCloudPtr &target) {
+  SearchIndexPtr target_index(new SearchIndex(true));
+  target_index->setInputCloud(target);
+  SetInputTarget(target, target_index);
+}
+
+void PlanarICP::SetInputTarget(const PointCloudPtr &target,
+                               const SearchIndexPtr &target_index) {
+  target_ = target;
+  target_index_ = target_index;
+}
+
+bool PlanarICP::FindNearestTarget(const PointT &point, float max_sqr_dist,
+                                  int *index, float *sqr_dist) {
+  const int num_targets = static_cast<int>(target_->points.size());
+  int k = 1;
+
+  // Masked points are usually a small, clustered part of the target, so the
+  // nearest neighbor is almost always unmasked. Otherwise, widen the search
+  // until an unmasked point turns up or the neighbors get too far away.
+  while (k <= num_targets) {
+    const int num_found = target_index_->nearestKSearch(point, k, nn_indices_,
+                                                        nn_sqr_dists_);
+
+    for (int ii = 0; ii < num_found; ++ii) {
+      if (nn_sqr_dists_[ii] > max_sqr_dist) {
+        return false;
+      }
+
+      if (target_mask_ == nullptr || !(*target_mask_)[nn_indices_[ii]]) {
+        *index = nn_indices_[ii];
+        *sqr_dist = nn_sqr_dists_[ii];
+        return true;
+      }
+    }
+
+    if (num_found < k || k == num_targets) {
+      return false;
+    }
+
+    k = std::min(4 * k, num_targets);
+  }
+
+  return false;
+}
+
+bool PlanarICP::Align(const PointCloud &source, PointCloud *aligned) {
+  converged_ = false;
+  fitness_score_ = std::numeric_limits<double>::max();
+  num_iterations_ = 0;
+  yaw_ = 0;
+  translation_.setZero();
+
+  *aligned = source;
+
+  if (!target_ || !target_index_) {
+    return false;
+  }
+
+  const float max_sqr_dist = static_cast<float>(max_correspondence_distance_ *
+                                                max_correspondence_distance_);
+  double prev_mse = std::numeric_limits<double>::max();
+
+  while (true) {
+    const double cos_yaw = cos(yaw_);
+    const double sin_yaw = sin(yaw_);
+
+    // Sums over correspondences (s, t) of s, t and s t^T, in the xy plane.
+    Eigen::Vector2d sum_source = Eigen::Vector2d::Zero();
+    Eigen::Vector2d sum_target = Eigen::Vector2d::Zero();
+    Eigen::Matrix2d sum_products = Eigen::Matrix2d::Zero();
+    double sum_sqr_dists = 0;
+    int num_correspondences = 0;
+
+    for (size_t ii = 0; ii < source.points.size(); ++ii) {
+      const PointT &source_point = source.points[ii];
+
+      if (!pcl::isFinite(source_point)) {
+        continue;
+      }
+
+      PointT &point = aligned->points[ii];
+      point.x = static_cast<float>(cos_yaw * source_point.x - sin_yaw *
+                                   source_point.y + translation_[0]);
+      point.y = static_cast<float>(sin_yaw * source_point.x + cos_yaw *
+                                   source_point.y + translation_[1]);
+
+      int index = 0;
+      float sqr_dist = 0;
+
+      if (!FindNearestTarget(point, max_sqr_dist, &index, &sqr_dist)) {
+        continue;
+      }
+
+      const PointT &target_point = target_->points[index];
+      const Eigen::Vector2d s(point.x, point.y);
+      const Eigen::Vector2d t(target_point.x, target_point.y);
+      sum_source += s;
+      sum_target += t;
+      sum_products.noalias() += s * t.transpose();
+      sum_sqr_dists += sqr_dist;
+      ++num_correspondences;
+    }
+
+    if (num_correspondences < kMinCorrespondences) {
+      converged_ = false;
+      *aligned = source;
+      return false;
+    }
+
+    // Closed-form least squares rotation and translation between the
+    // correspondences (cf. TransformationEstimation2D).
+    const double inv_n = 1.0 / num_correspondences;
+    const Eigen::Vector2d centroid_source = sum_source * inv_n;
+    const Eigen::Vector2d centroid_target = sum_target * inv_n;
+    const Eigen::Matrix2d H = sum_products - num_correspondences *
+                              centroid_source * centroid_target.transpose();
+    const double delta_yaw = atan2(H(0, 1) - H(1, 0), H(0, 0) + H(1, 1));
+    Eigen::Matrix2d delta_rotation;
+    delta_rotation << cos(delta_yaw), -sin(delta_yaw),
+                   sin(delta_yaw), cos(delta_yaw);
+    const Eigen::Vector2d delta_translation = centroid_target - delta_rotation *
+                                              centroid_source;
+
+    yaw_ += delta_yaw;
+    translation_ = delta_rotation * translation_ + delta_translation;
+    ++num_iterations_;
+
+    // Termination criteria, in the order pcl::DefaultConvergenceCriteria
+    // checks them.
+    if (num_iterations_ >= max_iterations_) {
+      break;
+    }
+
+    if (cos(delta_yaw) >= kRotationCosineThreshold &&
+        delta_translation.squaredNorm() <= transformation_epsilon_) {
+      break;
+    }
+
+    const double mse = sum_sqr_dists * inv_n;
+
+    if (fabs(mse - prev_mse) < euclidean_fitness_epsilon_ ||
+        fabs(mse - prev_mse) / prev_mse < kRelativeMSEThreshold) {
+      break;
+    }
+
+    prev_mse = mse;
+  }
+
+  converged_ = true;
+
+  // Final transform and fitness score.
+  const double cos_yaw = cos(yaw_);
+  const double sin_yaw = sin(yaw_);
+  double sum_sqr_dists = 0;
+  int num_points = 0;
+
+  for (size_t ii = 0; ii < source.points.size(); ++ii) {
+    const PointT &source_point = source.points[ii];
+    PointT &point = aligned->points[ii];
+
+    if (!pcl::isFinite(source_point)) {
+      continue;
+    }
+
+    point.x = static_cast<float>(cos_yaw * source_point.x - sin_yaw *
+                                 source_point.y + translation_[0]);
+    point.y = static_cast<float>(sin_yaw * source_point.x + cos_yaw *
+                                 source_point.y + translation_[1]);
+
+    int index = 0;
+    float sqr_dist = 0;
+
+    if (FindNearestTarget(point, std::numeric_limits<float>::max(), &index,
+                          &sqr_dist)) {
+      sum_sqr_dists += sqr_dist;
+      ++num_points;
+    }
+  }
+
+  if (num_points > 0) {
+    fitness_score_ = sum_sqr_dists / num_points;
+  }
+
+  return true;
+}
+
+Eigen::Matrix4f PlanarICP::GetFinalTransformation() const {
+  Eigen::Matrix4f transformation = Eigen::Matrix4f::Identity();
+  transformation(0, 0) = static_cast<float>(cos(yaw_));
+  transformation(0, 1) = static_cast<float>(-sin(yaw_));
+  transformation(1, 0) = static_cast<float>(sin(yaw_));
+  transformation(1, 1) = static_cast<float>(cos(yaw_));
+  transformation(0, 3) = static_cast<float>(translation_[0]);
+  transformation(1, 3) = static_cast<float>(translation_[1]);
+  return transformation;
+}
+}  // namespace sbpl_perception
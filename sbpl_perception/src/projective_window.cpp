@@ -0,0 +1,51 @@
+/**
+ * @file projective_window.cpp
+ * @brief Pixel windows for projective nearest-neighbor association
+ * @author Venkatraman Narayanan
+ * Carnegie Mellon University, 2015
+ */
+
+#include <sbpl_perception/projective_window.h>
+
+#include <kinect_sim/camera_constants.h>
+#include <sbpl_perception/utils/utils.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace sbpl_perception {
+
+ProjectiveWindow ComputeProjectiveWindow(const Eigen::Vector3f &camera_point,
+                                         double radius) {
+  const int max_half_width = std::max(kDepthImageWidth, kDepthImageHeight);
+  const double range = -camera_point[2];
+  ProjectiveWindow window;
+
+  // Points within radius may lie anywhere in the image (or behind the
+  // camera), so the window covers all of it.
+  if (range <= radius) {
+    window.u = kDepthImageWidth / 2;
+    window.v = kDepthImageHeight / 2;
+    window.half_width = max_half_width;
+    return window;
+  }
+
+  // Same projection as RangeLikelihood::getCameraCoordinate, rounded to the
+  // nearest pixel, with rows flipped to depth image order.
+  window.u = static_cast<int>(std::floor(-kCameraFX * camera_point[0] /
+                                         camera_point[2] + kCameraCX + 0.5));
+  window.v = kDepthImageHeight - 1 - static_cast<int>(std::floor(
+                                                        -kCameraFY * camera_point[1] / camera_point[2] + kCameraCY + 0.5));
+
+  // A point within radius projects at most
+  // radius * f * (1 + tan(angle off the optical axis)) / (range - radius)
+  // pixels away. One extra pixel accounts for rounding to the pixel grid.
+  const double focal_length = std::max(kCameraFX, kCameraFY);
+  const double tan_off_axis = std::max(std::fabs(camera_point[0]),
+                                       std::fabs(camera_point[1])) / range;
+  window.half_width = std::min(max_half_width,
+                               static_cast<int>(std::ceil(radius * focal_length * (1.0 + tan_off_axis) /
+                                                          (range - radius))) + 1);
+  return window;
+}
+}  // namespace sbpl_perception
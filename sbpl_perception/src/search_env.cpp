@@ -8,7 +8,9 @@
 #include <sbpl_perception/search_env.h>
 
 #include <perception_utils/perception_utils.h>
+#include <sbpl_perception/depth_image_kernels.h>
 #include <sbpl_perception/discretization_manager.h>
+#include <sbpl_perception/wire_codec.h>
 #include <kinect_sim/camera_constants.h>
 // #include <sbpl_perception/utils/object_utils.h>
 
@@ -17,6 +19,7 @@
 
 #include <pcl/conversions.h>
 #include <pcl/filters/filter.h>
+#include <pcl/filters/voxel_grid.h>
 #include <pcl_ros/transforms.h>
 #include <pcl/PCLPointCloud2.h>
 #include <pcl_conversions/pcl_conversions.h>
@@ -35,6 +38,7 @@
 #include <boost/lexical_cast.hpp>
 #include <omp.h>
 #include <algorithm>
+#include <chrono>
 
 using namespace std;
 using namespace perception_utils;
@@ -57,6 +61,21 @@ constexpr unsigned short kOcclusionThreshold = 50; // mm
 // Tolerance used when deciding the footprint of the object in a given pose is
 // out of bounds of the supporting place.
 constexpr double kFootprintTolerance = 0.02; // m
+// MPI tags for the messages exchanged under dynamic scheduling (see
+// ComputeCostsInParallel).
+constexpr int kCostChunkTag = 2;
+constexpr int kCostOutputTag = 3;
+// Number of depth images of each kind that every processor keeps around for
+// cost computation (see ShareCostComputationImages). A batch may exceed these
+// temporarily.
+constexpr size_t kSourceImageCacheCapacity = 64;
+constexpr size_t kSingleObjectRenderCacheCapacity = 2048;
+// Shares of perch_params_.cache_memory_budget_mb given to each bounded cache.
+// Counted pixels are 38 KB per state and make up most of the memory of a
+// long search.
+constexpr double kCountedPixelsCacheShare = 0.5;
+constexpr double kSingleObjectCacheShare = 0.25;
+constexpr double kSuccessorCacheShare = 0.25;
 }  // namespace
 
 namespace sbpl_perception {
@@ -65,7 +84,8 @@ EnvObjectRecognition::EnvObjectRecognition(const
                                            std::shared_ptr<boost::mpi::communicator> &comm) :
   mpi_comm_(comm),
   image_debug_(false), debug_dir_(ros::package::getPath("sbpl_perception") +
-                                  "/visualization/"), env_stats_ {0, 0} {
+                                  "/visualization/"), env_stats_ {0, 0, {}, 0.0, 0, 0, {}},
+  num_valid_pixels_(0), computing_with_threads_(false) {
 
   // OpenGL requires argc and argv
   char **argv;
@@ -120,12 +140,42 @@ EnvObjectRecognition::EnvObjectRecognition(const
                      perch_params_.use_model_specific_search_resolution, false);
     private_nh.param("use_clutter_mode", perch_params_.use_clutter_mode, false);
     private_nh.param("clutter_regularizer", perch_params_.clutter_regularizer, 1.0);
+    private_nh.param("use_software_rasterizer",
+                     perch_params_.use_software_rasterizer, false);
+    private_nh.param("use_batch_rendering",
+                     perch_params_.use_batch_rendering, false);
+    private_nh.param("use_pipelined_rendering",
+                     perch_params_.use_pipelined_rendering, false);
+    private_nh.param("use_linear_depth", perch_params_.use_linear_depth, false);
+    private_nh.param("use_cropped_rendering",
+                     perch_params_.use_cropped_rendering, false);
+    private_nh.param("use_depth_patch_library",
+                     perch_params_.use_depth_patch_library, false);
+    private_nh.param("use_projective_association",
+                     perch_params_.use_projective_association, false);
+    private_nh.param("use_planar_icp", perch_params_.use_planar_icp, false);
+    private_nh.param("use_thread_pool", perch_params_.use_thread_pool, false);
+    private_nh.param("num_threads", perch_params_.num_threads, 0);
+    private_nh.param("use_dynamic_scheduling",
+                     perch_params_.use_dynamic_scheduling, false);
+    private_nh.param("dynamic_scheduling_chunk_size",
+                     perch_params_.dynamic_scheduling_chunk_size, 2);
+    private_nh.param("cache_memory_budget_mb",
+                     perch_params_.cache_memory_budget_mb, 0);
 
     private_nh.param("visualize_expanded_states",
                      perch_params_.vis_expanded_states, false);
     private_nh.param("print_expanded_states", perch_params_.print_expanded_states,
                      false);
     private_nh.param("debug_verbose", perch_params_.debug_verbose, false);
+
+    // Pool threads render with the software rasterizer, and costs must not
+    // depend on which thread scored a state.
+    if (perch_params_.use_thread_pool && !perch_params_.use_software_rasterizer) {
+      printf("WARNING: use_thread_pool requires use_software_rasterizer, enabling it\n");
+      perch_params_.use_software_rasterizer = true;
+    }
+
     perch_params_.initialized = true;
 
     printf("----------PERCH Config-------------\n");
@@ -141,6 +191,23 @@ EnvObjectRecognition::EnvObjectRecognition(const
     printf("RCNN Heuristic: %d\n", perch_params_.use_rcnn_heuristic);
     printf("Use Clutter: %d\n", perch_params_.use_clutter_mode);
     printf("Clutter Regularization: %f\n", perch_params_.clutter_regularizer);
+    printf("Software Rasterizer: %d\n", perch_params_.use_software_rasterizer);
+    printf("Batch Rendering: %d\n", perch_params_.use_batch_rendering);
+    printf("Pipelined Rendering: %d\n",
+           perch_params_.use_pipelined_rendering);
+    printf("Linear Depth: %d\n", perch_params_.use_linear_depth);
+    printf("Cropped Rendering: %d\n", perch_params_.use_cropped_rendering);
+    printf("Depth Patch Library: %d\n", perch_params_.use_depth_patch_library);
+    printf("Projective Association: %d\n",
+           perch_params_.use_projective_association);
+    printf("Planar ICP: %d\n", perch_params_.use_planar_icp);
+    printf("Thread Pool: %d\n", perch_params_.use_thread_pool);
+    printf("Num Threads: %d\n", perch_params_.num_threads);
+    printf("Dynamic Scheduling: %d\n", perch_params_.use_dynamic_scheduling);
+    printf("Dynamic Scheduling Chunk Size: %d\n",
+           perch_params_.dynamic_scheduling_chunk_size);
+    printf("Cache Memory Budget (MB): %d\n",
+           perch_params_.cache_memory_budget_mb);
     printf("Vis Expansions: %d\n", perch_params_.vis_expanded_states);
     printf("Print Expansions: %d\n", perch_params_.print_expanded_states);
     printf("Debug Verbose: %d\n", perch_params_.debug_verbose);
@@ -163,6 +230,41 @@ EnvObjectRecognition::EnvObjectRecognition(const
     printf("ERROR: PERCH Params not initialized for process %d\n",
            mpi_comm_->rank());
   }
+
+  kinect_simulator_->rl_->setUseSoftwareRasterizer(
+    perch_params_.use_software_rasterizer);
+  kinect_simulator_->rl_->setUseLinearDepth(perch_params_.use_linear_depth);
+
+  successor_cache_ = BoundedCache<int, CachedSuccessors>([](
+  const CachedSuccessors & successors) {
+    return (successors.succ_ids.size() + successors.costs.size()) * sizeof(int);
+  });
+  counted_pixels_cache_ = BoundedCache<int, PixelSet>([](
+  const PixelSet & pixels) {
+    return pixels.NumBytes();
+  });
+  single_object_cache_ = BoundedCache<GraphState, SingleObjectEntry>([](
+  const SingleObjectEntry & entry) {
+    return entry.render.unadjusted_depth_image.NumBytes() +
+           entry.render.adjusted_depth_image.NumBytes() +
+           entry.adjusted_state.object_states().NumHeapBytes();
+  });
+  SetCacheBudgets();
+
+  if (perch_params_.use_thread_pool) {
+    const int num_threads = perch_params_.num_threads > 0 ?
+                            perch_params_.num_threads : omp_get_max_threads();
+
+    printf("Processor %d computing costs with %d threads\n", mpi_comm_->rank(),
+           num_threads);
+
+    // The OpenGL context belongs to this thread, so every thread of the pool
+    // renders with its own context-free software renderer.
+    for (int ii = 0; ii < num_threads; ++ii) {
+      thread_simulators_.push_back(SimExample::Ptr(new SimExample(0, argv,
+                                                                  kDepthImageHeight, kDepthImageWidth, false)));
+    }
+  }
 }
 
 EnvObjectRecognition::~EnvObjectRecognition() {
@@ -214,6 +316,28 @@ void EnvObjectRecognition::LoadObjFiles(const ModelBank
 
 bool EnvObjectRecognition::IsValidPose(GraphState s, int model_id,
                                        ContPose pose, bool after_refinement = false) const {
+  if (CountNeighborPoints(model_id, pose,
+                          after_refinement) < perch_params_.min_neighbor_points_for_valid_pose) {
+    return false;
+  }
+
+  if (OverlapsObjects(s, model_id, pose)) {
+    return false;
+  }
+
+  // Do collision checking.
+  // if (s.NumObjects() > 1) {
+  //   printf("Model ids: %d %d\n", model_id, s.object_states().back().id());
+  //   if (ObjectsCollide(obj_models_[model_id], obj_models_[s.object_states().back().id()], pose, s.object_states().back().cont_pose())) {
+  //     return false;
+  //   }
+  // }
+
+  return IsValidFootprint(model_id, pose);
+}
+
+int EnvObjectRecognition::CountNeighborPoints(int model_id,
+                                              const ContPose &pose, bool after_refinement) const {
   vector<int> indices;
   vector<float> sqr_dists;
   PointT point;
@@ -251,40 +375,34 @@ bool EnvObjectRecognition::IsValidPose(GraphState s, int model_id,
   // int num_neighbors_found = knn->radiusSearch(point, search_rad,
   //                                             indices,
   //                                             sqr_dists, perch_params_.min_neighbor_points_for_valid_pose); //0.2
-  int num_neighbors_found = projected_knn_->radiusSearch(point, search_rad,
-                                                         indices,
-                                                         sqr_dists, perch_params_.min_neighbor_points_for_valid_pose); //0.2
-
-  if (num_neighbors_found < perch_params_.min_neighbor_points_for_valid_pose) {
-    return false;
-  }
+  return projected_knn_->radiusSearch(point, search_rad, indices, sqr_dists,
+                                      perch_params_.min_neighbor_points_for_valid_pose); //0.2
+}
 
+bool EnvObjectRecognition::OverlapsObjects(const GraphState &s, int model_id,
+                                           const ContPose &pose) const {
   // TODO: revisit this and accomodate for collision model
   double rad_1, rad_2;
   rad_1 = obj_models_[model_id].GetInscribedRadius();
 
-  for (size_t ii = 0; ii < s.NumObjects(); ++ii) {
-    const auto object_state = s.object_states()[ii];
+  for (const auto &object_state : s.object_states()) {
     int obj_id = object_state.id();
-    ContPose obj_pose = object_state.cont_pose();
+    const ContPose &obj_pose = object_state.cont_pose();
 
     rad_2 = obj_models_[obj_id].GetInscribedRadius();
 
     if ((pose.x() - obj_pose.x()) * (pose.x() - obj_pose.x()) +
         (pose.y() - obj_pose.y()) *
         (pose.y() - obj_pose.y()) < (rad_1 + rad_2) * (rad_1 + rad_2))  {
-      return false;
+      return true;
     }
   }
 
-  // Do collision checking.
-  // if (s.NumObjects() > 1) {
-  //   printf("Model ids: %d %d\n", model_id, s.object_states().back().id());
-  //   if (ObjectsCollide(obj_models_[model_id], obj_models_[s.object_states().back().id()], pose, s.object_states().back().cont_pose())) {
-  //     return false;
-  //   }
-  // }
+  return false;
+}
 
+bool EnvObjectRecognition::IsValidFootprint(int model_id,
+                                            const ContPose &pose) const {
   // Check if the footprint is contained with the support surface bounds.
   auto footprint = obj_models_[model_id].GetFootprint(pose);
 
@@ -383,16 +501,17 @@ void EnvObjectRecognition::GetSuccs(int source_state_id,
   }
 
   // If in cache, return
-  auto it = succ_cache.find(source_state_id);
+  const CachedSuccessors *cached_successors = successor_cache_.Find(
+                                                source_state_id);
 
-  if (it != succ_cache.end()) {
-    *costs = cost_cache[source_state_id];
+  if (cached_successors != nullptr) {
+    *costs = cached_successors->costs;
 
     if (static_cast<int>(source_state.NumObjects()) == env_params_.num_objects -
         1) {
       succ_ids->resize(costs->size(), env_params_.goal_state_id);
     } else {
-      *succ_ids = succ_cache[source_state_id];
+      *succ_ids = cached_successors->succ_ids;
     }
 
     printf("Expanding cached state: %d with %zu objects\n",
@@ -420,8 +539,8 @@ void EnvObjectRecognition::GetSuccs(int source_state_id,
   // We don't need IDs for the candidate succs at all.
   candidate_succ_ids.resize(candidate_succs.size(), 0);
 
-  vector<unsigned short> source_depth_image;
-  GetDepthImage(source_state, &source_depth_image);
+  CostComputationImages cost_computation_images;
+  AddSourceImage(source_state_id, source_state, &cost_computation_images);
 
   candidate_costs.resize(candidate_succ_ids.size());
 
@@ -434,13 +553,12 @@ void EnvObjectRecognition::GetSuccs(int source_state_id,
     input_unit.child_state = candidate_succs[ii];
     input_unit.source_id = source_state_id;
     input_unit.child_id = candidate_succ_ids[ii];
-    input_unit.source_depth_image = source_depth_image;
-    input_unit.source_counted_pixels = counted_pixels_map_[source_state_id];
+    input_unit.last_object_id = -1;
   }
 
   vector<CostComputationOutput> cost_computation_output;
-  ComputeCostsInParallel(cost_computation_input, &cost_computation_output,
-                         false);
+  ComputeCostsInParallel(cost_computation_input, &cost_computation_images,
+                         &cost_computation_output, false);
 
 
   //---- PARALLELIZE THIS LOOP-----------//
@@ -472,7 +590,12 @@ void EnvObjectRecognition::GetSuccs(int source_state_id,
     candidate_succ_ids[ii] = hash_manager_.GetStateIDForceful(
                                input_unit.child_state);
 
-    if (adjusted_states_.find(candidate_succ_ids[ii]) != adjusted_states_.end()) {
+    // A state already evaluated as the successor of another parent is a
+    // duplicate. Its own parent gets here again only if its successors were
+    // evicted from successor_cache_.
+    const auto parent_it = parent_ids_.find(candidate_succ_ids[ii]);
+
+    if (parent_it != parent_ids_.end() && parent_it->second != source_state_id) {
       invalid_state = true;
     }
 
@@ -480,41 +603,44 @@ void EnvObjectRecognition::GetSuccs(int source_state_id,
       candidate_costs[ii] = -1;
     } else {
       adjusted_states_[candidate_succ_ids[ii]] = output_unit.adjusted_state;
-      assert(output_unit.depth_image.size() != 0);
+      parent_ids_[candidate_succ_ids[ii]] = source_state_id;
       candidate_costs[ii] = output_unit.cost;
       minz_map_[candidate_succ_ids[ii]] =
         output_unit.state_properties.last_min_depth;
       maxz_map_[candidate_succ_ids[ii]] =
         output_unit.state_properties.last_max_depth;
-      counted_pixels_map_[candidate_succ_ids[ii]] = output_unit.child_counted_pixels;
+      counted_pixels_cache_.Insert(candidate_succ_ids[ii],
+                                   output_unit.child_counted_pixels);
       g_value_map_[candidate_succ_ids[ii]] = g_value_map_[source_state_id] +
                                              output_unit.cost;
 
       last_object_rendering_cost_[candidate_succ_ids[ii]] =
         output_unit.state_properties.target_cost +
         output_unit.state_properties.source_cost;
+    }
+
+    // Cache single object renderings, and which ones are invalid, for lazy
+    // evaluation.
+    // NOTE: The hash key is computed on the *unadjusted* child state.
+    if (source_state.NumObjects() == 0) {
+      SingleObjectEntry entry;
+      entry.valid = !invalid_state;
 
-      // Cache the depth image only for single object renderings, *only* if valid.
-      // NOTE: The hash key is computed on the *unadjusted* child state.
-      if (source_state.NumObjects() == 0) {
-        // depth_image_cache_[candidate_succ_ids[ii]] = output_unit.depth_image;
-        adjusted_single_object_depth_image_cache_[cost_computation_input[ii].child_state]
-          =
-            output_unit.depth_image;
-        unadjusted_single_object_depth_image_cache_[cost_computation_input[ii].child_state]
-          =
-            output_unit.unadjusted_depth_image;
-        adjusted_single_object_state_cache_[cost_computation_input[ii].child_state] =
-          output_unit.adjusted_state;
+      if (entry.valid) {
+        entry.render.unadjusted_depth_image = output_unit.unadjusted_depth_image;
+        entry.render.adjusted_depth_image = output_unit.depth_image;
+        entry.adjusted_state = output_unit.adjusted_state;
         assert(output_unit.adjusted_state.object_states().size() > 0);
-        assert(adjusted_single_object_state_cache_[cost_computation_input[ii].child_state].object_states().size()
-               > 0);
       }
+
+      single_object_cache_.Insert(input_unit.child_state, std::move(entry));
     }
   }
 
   //--------------------------------------//
 
+  CachedSuccessors successors;
+
   for (size_t ii = 0; ii < candidate_succ_ids.size(); ++ii) {
     const auto &output_unit = cost_computation_output[ii];
 
@@ -528,14 +654,16 @@ void EnvObjectRecognition::GetSuccs(int source_state_id,
       succ_ids->push_back(candidate_succ_ids[ii]);
     }
 
-    succ_cache[source_state_id].push_back(candidate_succ_ids[ii]);
+    successors.succ_ids.push_back(candidate_succ_ids[ii]);
     costs->push_back(candidate_costs[ii]);
 
     if (image_debug_) {
       std::stringstream ss;
       ss.precision(20);
       ss << debug_dir_ + "succ_" << candidate_succ_ids[ii] << ".png";
-      PrintImage(ss.str(), output_unit.depth_image);
+      vector<unsigned short> depth_image;
+      output_unit.depth_image.GetDepthImage(&depth_image);
+      PrintImage(ss.str(), depth_image);
       printf("State %d,       %d      %d      %d      %d      %d\n",
              candidate_succ_ids[ii],
              output_unit.state_properties.target_cost,
@@ -554,8 +682,10 @@ void EnvObjectRecognition::GetSuccs(int source_state_id,
     }
   }
 
-  // cache succs and costs
-  cost_cache[source_state_id] = *costs;
+  // cache succs and costs, which took rendering every candidate to compute
+  successors.costs = *costs;
+  successor_cache_.Insert(source_state_id, std::move(successors),
+                          static_cast<double>(candidate_succs.size()));
 
   if (perch_params_.debug_verbose) {
     printf("Succs for %d\n", source_state_id);
@@ -575,29 +705,49 @@ void EnvObjectRecognition::GetSuccs(int source_state_id,
 }
 
 int EnvObjectRecognition::GetBestSuccessorID(int state_id) {
-  const auto &succ_costs = cost_cache[state_id];
+  const CachedSuccessors *successors = successor_cache_.Find(state_id);
+
+  // Expanding the state again recomputes evicted successors.
+  if (successors == nullptr) {
+    vector<int> succ_ids_unused, costs_unused;
+    GetSuccs(state_id, &succ_ids_unused, &costs_unused);
+    successors = successor_cache_.Find(state_id);
+  }
+
+  assert(successors != nullptr);
+  const auto &succ_costs = successors->costs;
   assert(!succ_costs.empty());
   const auto min_element_it = std::min_element(succ_costs.begin(),
                                                succ_costs.end());
   int offset = std::distance(succ_costs.begin(), min_element_it);
-  const auto &succs = succ_cache[state_id];
+  const auto &succs = successors->succ_ids;
   int best_succ_id = succs[offset];
   return best_succ_id;
 }
 
 void EnvObjectRecognition::ComputeCostsInParallel(const
                                                   std::vector<CostComputationInput> &input,
+                                                  CostComputationImages *images,
                                                   std::vector<CostComputationOutput> *output,
                                                   bool lazy) {
+  const auto start_time = chrono::high_resolution_clock::now();
+  const WireCodecBytes start_wire_bytes = GetWireCodecBytes();
   int count = 0;
   int original_count = 0;
   auto appended_input = input;
   const int num_processors = static_cast<int>(mpi_comm_->size());
+  const bool dynamic = perch_params_.use_dynamic_scheduling &&
+                       num_processors > 1;
+  // A single processor with a thread pool needs no MPI communication at all.
+  const bool threads_only = perch_params_.use_thread_pool &&
+                            num_processors == 1;
 
   if (mpi_comm_->rank() == kMasterRank) {
     original_count = count = input.size();
 
-    if (count % num_processors != 0) {
+    // Static scheduling scatters equal partitions, so pad the input with
+    // dummies to a multiple of the number of processors.
+    if (!dynamic && count % num_processors != 0) {
       count += num_processors - count % num_processors;
       CostComputationInput dummy_input;
       dummy_input.source_id = -1;
@@ -616,16 +766,308 @@ void EnvObjectRecognition::ComputeCostsInParallel(const
     return;
   }
 
-  int recvcount = count / num_processors;
+  ShareCostComputationImages(images);
+
+  double busy_time = 0;
+
+  if (threads_only) {
+    ComputeCostsWithThreads(appended_input, output, lazy, &busy_time);
+  } else if (dynamic) {
+    if (mpi_comm_->rank() == kMasterRank) {
+      DispatchCostComputation(appended_input, output, lazy, &busy_time);
+    } else {
+      ServeCostComputation(lazy, &busy_time);
+    }
+  } else {
+    int recvcount = count / num_processors;
+
+    std::vector<CostComputationInput> input_partition(recvcount);
+    std::vector<CostComputationOutput> output_partition(recvcount);
+    boost::mpi::scatter(*mpi_comm_, appended_input, &input_partition[0], recvcount,
+                        kMasterRank);
+
+    ComputeCostsOnProcessor(input_partition, &output_partition, lazy,
+                            &busy_time);
+
+    boost::mpi::gather(*mpi_comm_, &output_partition[0], recvcount, *output,
+                       kMasterRank);
+  }
+
+  vector<double> busy_times;
+  boost::mpi::gather(*mpi_comm_, busy_time, busy_times, kMasterRank);
+
+  // Every rank encodes what it sends.
+  const WireCodecBytes end_wire_bytes = GetWireCodecBytes();
+  uint64_t wire_raw_bytes = 0, wire_encoded_bytes = 0;
+  boost::mpi::reduce(*mpi_comm_, end_wire_bytes.raw_bytes -
+                     start_wire_bytes.raw_bytes, wire_raw_bytes, std::plus<uint64_t>(),
+                     kMasterRank);
+  boost::mpi::reduce(*mpi_comm_, end_wire_bytes.encoded_bytes -
+                     start_wire_bytes.encoded_bytes, wire_encoded_bytes,
+                     std::plus<uint64_t>(), kMasterRank);
+
+  if (mpi_comm_->rank() == kMasterRank) {
+    output->resize(original_count);
+
+    env_stats_.rank_busy_time.resize(num_processors, 0.0);
+
+    for (int ii = 0; ii < num_processors; ++ii) {
+      env_stats_.rank_busy_time[ii] += busy_times[ii];
+    }
+
+    env_stats_.wire_raw_bytes += wire_raw_bytes;
+    env_stats_.wire_encoded_bytes += wire_encoded_bytes;
+    env_stats_.cost_computation_time += chrono::duration<double>
+                                        (chrono::high_resolution_clock::now() - start_time).count();
+  }
+}
+
+void EnvObjectRecognition::ShareCostComputationImages(CostComputationImages
+                                                     *images) {
+  if (mpi_comm_->size() > 1) {
+    broadcast(*mpi_comm_, *images, kMasterRank);
+  }
+
+  for (size_t ii = 0; ii < images->new_source_ids.size(); ++ii) {
+    source_images_.Insert(images->new_source_ids[ii],
+                          std::move(images->new_source_images[ii]));
+  }
+
+  for (size_t ii = 0; ii < images->new_single_object_ids.size(); ++ii) {
+    single_object_renders_.Insert(images->new_single_object_ids[ii],
+                                  std::move(images->new_single_object_renders[ii]));
+  }
+
+  for (const int id : images->source_ids) {
+    source_images_.Touch(id);
+  }
+
+  for (const int id : images->single_object_ids) {
+    single_object_renders_.Touch(id);
+  }
+
+  // Never evict images this batch needs.
+  source_images_.Evict(std::max(kSourceImageCacheCapacity,
+                                images->source_ids.size()));
+  single_object_renders_.Evict(std::max(kSingleObjectRenderCacheCapacity,
+                                        images->single_object_ids.size()));
+}
+
+void EnvObjectRecognition::AddSourceImage(int source_id,
+                                          const GraphState &source_state, CostComputationImages *images) {
+  images->source_ids.push_back(source_id);
+
+  if (source_images_.Contains(source_id) ||
+      std::find(images->new_source_ids.begin(), images->new_source_ids.end(),
+                source_id) != images->new_source_ids.end()) {
+    return;
+  }
+
+  vector<unsigned short> source_depth_image;
+  GetDepthImage(source_state, &source_depth_image);
+
+  SourceImage source_image;
+  source_image.depth_image = DepthPatch(source_depth_image);
+  source_image.counted_pixels = GetCountedPixels(source_id);
+  images->new_source_ids.push_back(source_id);
+  images->new_source_images.push_back(std::move(source_image));
+}
+
+void EnvObjectRecognition::DispatchCostComputation(const
+                                                   std::vector<CostComputationInput> &input,
+                                                   std::vector<CostComputationOutput> *output, bool lazy,
+                                                   double *busy_time) {
+  const int count = static_cast<int>(input.size());
+  const int num_processors = static_cast<int>(mpi_comm_->size());
+  // With a thread pool, every thread of a worker gets a chunk's worth.
+  const int chunk_size = std::max(1,
+                                  perch_params_.dynamic_scheduling_chunk_size) *
+                         std::max(1, static_cast<int>(thread_simulators_.size()));
+  int next_input = 0;
+
+  // Offset into input of the chunk each worker is computing, and the pending
+  // receives for their outputs.
+  vector<int> chunk_offsets(num_processors, -1);
+  vector<vector<CostComputationOutput>> chunk_outputs(num_processors);
+  vector<boost::mpi::request> requests;
+  vector<int> request_ranks;
+
+  auto send_chunk = [&](int rank) {
+    if (next_input >= count) {
+      return;
+    }
+
+    const int chunk_end = std::min(count, next_input + chunk_size);
+    const vector<CostComputationInput> chunk(input.begin() + next_input,
+                                             input.begin() + chunk_end);
+    mpi_comm_->send(rank, kCostChunkTag, chunk);
+    chunk_offsets[rank] = next_input;
+    next_input = chunk_end;
+    requests.push_back(mpi_comm_->irecv(rank, kCostOutputTag,
+                                        chunk_outputs[rank]));
+    request_ranks.push_back(rank);
+  };
+
+  for (int rank = 0; rank < num_processors; ++rank) {
+    if (rank != kMasterRank) {
+      send_chunk(rank);
+    }
+  }
+
+  while (!requests.empty() || next_input < count) {
+    auto completed = boost::mpi::test_any(requests.begin(), requests.end());
+
+    if (!completed && next_input < count) {
+      // No worker is waiting for work, so compute a single input here and
+      // check again.
+      ComputeCosts(input, next_input, next_input + 1, output, lazy, busy_time);
+      ++next_input;
+      continue;
+    }
+
+    if (!completed) {
+      completed = boost::mpi::wait_any(requests.begin(), requests.end());
+    }
+
+    const int request_index = static_cast<int>(completed->second -
+                                               requests.begin());
+    const int rank = request_ranks[request_index];
+    requests.erase(requests.begin() + request_index);
+    request_ranks.erase(request_ranks.begin() + request_index);
+
+    auto &chunk_output = chunk_outputs[rank];
+
+    for (size_t ii = 0; ii < chunk_output.size(); ++ii) {
+      (*output)[chunk_offsets[rank] + ii] = std::move(chunk_output[ii]);
+    }
+
+    chunk_output.clear();
+    send_chunk(rank);
+  }
+
+  // An empty chunk tells the workers that this batch is done.
+  for (int rank = 0; rank < num_processors; ++rank) {
+    if (rank != kMasterRank) {
+      mpi_comm_->send(rank, kCostChunkTag, vector<CostComputationInput>());
+    }
+  }
+}
+
+void EnvObjectRecognition::ServeCostComputation(bool lazy, double *busy_time) {
+  while (true) {
+    vector<CostComputationInput> chunk;
+    mpi_comm_->recv(kMasterRank, kCostChunkTag, chunk);
+
+    if (chunk.empty()) {
+      break;
+    }
+
+    vector<CostComputationOutput> chunk_output(chunk.size());
+    ComputeCostsOnProcessor(chunk, &chunk_output, lazy, busy_time);
+    mpi_comm_->send(kMasterRank, kCostOutputTag, chunk_output);
+  }
+}
+
+void EnvObjectRecognition::ComputeCostsOnProcessor(const
+                                                   std::vector<CostComputationInput> &input,
+                                                   std::vector<CostComputationOutput> *output, bool lazy,
+                                                   double *busy_time) {
+  if (perch_params_.use_thread_pool) {
+    ComputeCostsWithThreads(input, output, lazy, busy_time);
+  } else {
+    ComputeCosts(input, 0, static_cast<int>(input.size()), output, lazy,
+                 busy_time);
+  }
+}
+
+void EnvObjectRecognition::ComputeCostsWithThreads(const
+                                                   std::vector<CostComputationInput> &input,
+                                                   std::vector<CostComputationOutput> *output, bool lazy,
+                                                   double *busy_time) {
+  const int count = static_cast<int>(input.size());
+  const int num_threads = static_cast<int>(thread_simulators_.size());
+  // Consecutive inputs usually share a source state, whose depth image
+  // ComputeCosts expands once per call, so threads take a few at a time.
+  const int chunk_size = std::max(1,
+                                  perch_params_.dynamic_scheduling_chunk_size);
+  const int num_chunks = (count + chunk_size - 1) / chunk_size;
+  double thread_busy_time = 0;
+  computing_with_threads_ = true;
+
+  #pragma omp parallel for schedule(dynamic, 1) num_threads(num_threads) reduction(+:thread_busy_time)
+
+  for (int chunk = 0; chunk < num_chunks; ++chunk) {
+    const int begin = chunk * chunk_size;
+    const int end = std::min(count, begin + chunk_size);
+    ComputeCosts(input, begin, end, output, lazy, &thread_busy_time);
+  }
+
+  computing_with_threads_ = false;
+
+  // Report the mean over threads, so that utilization stays in [0, 1].
+  *busy_time += thread_busy_time / num_threads;
+}
+
+void EnvObjectRecognition::ComputeCosts(const std::vector<CostComputationInput>
+                                        &input, int begin, int end, std::vector<CostComputationOutput> *output,
+                                        bool lazy, double *busy_time) {
+  const auto start_time = chrono::high_resolution_clock::now();
+  assert(output->size() == input.size());
+
+  // Render the newly added object of every (non-dummy) candidate in this
+  // range up front, as tiles of a single framebuffer or through the
+  // pipelined readback.
+  vector<vector<unsigned short>> last_object_depth_images;
+  vector<int> batch_index(end - begin, -1);
+
+  if (!lazy && (perch_params_.use_batch_rendering ||
+                perch_params_.use_pipelined_rendering)) {
+    vector<GraphState> last_object_states;
+
+    for (int ii = begin; ii < end; ++ii) {
+      const auto &input_unit = input[ii];
+
+      if (input_unit.source_id == -1) {
+        continue;
+      }
+
+      const auto &last_object = input_unit.child_state.object_states().back();
+      GraphState s_new_obj;
+      s_new_obj.AppendObject(ObjectState(last_object.id(),
+                                         obj_models_[last_object.id()].symmetric(),
+                                         last_object.cont_pose()));
+
+      // Already rendered when the input was set.
+      if (depth_patch_library_.find(s_new_obj) != depth_patch_library_.end()) {
+        continue;
+      }
+
+      batch_index[ii - begin] = static_cast<int>(last_object_states.size());
+      last_object_states.push_back(s_new_obj);
+    }
+
+    vector<int> num_occluders_unused;
+
+    if (perch_params_.use_batch_rendering) {
+      GetDepthImages(last_object_states, &last_object_depth_images,
+                     &num_occluders_unused);
+    } else {
+      GetDepthImagesPipelined(last_object_states, &last_object_depth_images,
+                              &num_occluders_unused);
+    }
+  }
 
-  std::vector<CostComputationInput> input_partition(recvcount);
-  std::vector<CostComputationOutput> output_partition(recvcount);
-  boost::mpi::scatter(*mpi_comm_, appended_input, &input_partition[0], recvcount,
-                      kMasterRank);
+  // Depth images are cached as patches; expand them here. All inputs of a
+  // batch usually share the same source, so its full image is reused.
+  int expanded_source_id = -1;
+  vector<unsigned short> source_depth_image;
+  vector<unsigned short> depth_image, unadjusted_depth_image;
+  vector<unsigned short> unadjusted_last_object_depth_image,
+         adjusted_last_object_depth_image;
 
-  for (int ii = 0; ii < recvcount; ++ii) {
-    const auto &input_unit = input_partition[ii];
-    auto &output_unit = output_partition[ii];
+  for (int ii = begin; ii < end; ++ii) {
+    const auto &input_unit = input[ii];
+    auto &output_unit = (*output)[ii];
 
     // If this is a dummy input, skip computation.
     if (input_unit.source_id == -1) {
@@ -633,36 +1075,63 @@ void EnvObjectRecognition::ComputeCostsInParallel(const
       continue;
     }
 
+    const SourceImage *source_image = source_images_.Find(input_unit.source_id);
+    assert(source_image != nullptr);
+    const SingleObjectRender *last_object_render = input_unit.last_object_id ==
+                                                   -1 ? nullptr : single_object_renders_.Find(input_unit.last_object_id);
+
+    if (lazy && (last_object_render == nullptr ||
+                 last_object_render->unadjusted_depth_image.empty() ||
+                 last_object_render->unadjusted_depth_image.Occludes(
+                   source_image->depth_image))) {
+      // Either there is no cached render of the last object, or it would
+      // occlude an existing object, in which case GetLazyCost returns -1
+      // anyway.
+      output_unit.cost = -1;
+      continue;
+    }
+
+    if (input_unit.source_id != expanded_source_id) {
+      source_image->depth_image.GetDepthImage(&source_depth_image);
+      expanded_source_id = input_unit.source_id;
+    }
+
     if (!lazy) {
       output_unit.cost = GetCost(input_unit.source_state, input_unit.child_state,
-                                 input_unit.source_depth_image,
-                                 input_unit.source_counted_pixels,
+                                 source_depth_image,
+                                 source_image->counted_pixels,
                                  &output_unit.child_counted_pixels, &output_unit.adjusted_state,
-                                 &output_unit.state_properties, &output_unit.depth_image,
-                                 &output_unit.unadjusted_depth_image);
-    } else {
-      if (input_unit.unadjusted_last_object_depth_image.empty()) {
-        output_unit.cost = -1;
-      } else {
-        output_unit.cost = GetLazyCost(input_unit.source_state, input_unit.child_state,
-                                       input_unit.source_depth_image,
-                                       input_unit.unadjusted_last_object_depth_image,
-                                       input_unit.adjusted_last_object_depth_image,
-                                       input_unit.adjusted_last_object_state,
-                                       input_unit.source_counted_pixels,
-                                       &output_unit.adjusted_state,
-                                       &output_unit.state_properties,
-                                       &output_unit.depth_image);
+                                 &output_unit.state_properties, &depth_image,
+                                 &unadjusted_depth_image,
+                                 batch_index[ii - begin] == -1 ? nullptr :
+                                 &last_object_depth_images[batch_index[ii - begin]]);
+
+      if (output_unit.cost != -1) {
+        output_unit.unadjusted_depth_image = DepthPatch(unadjusted_depth_image);
       }
+    } else {
+      last_object_render->unadjusted_depth_image.GetDepthImage(
+        &unadjusted_last_object_depth_image);
+      last_object_render->adjusted_depth_image.GetDepthImage(
+        &adjusted_last_object_depth_image);
+      output_unit.cost = GetLazyCost(input_unit.source_state, input_unit.child_state,
+                                     source_depth_image,
+                                     unadjusted_last_object_depth_image,
+                                     adjusted_last_object_depth_image,
+                                     input_unit.adjusted_last_object_state,
+                                     source_image->counted_pixels,
+                                     &output_unit.adjusted_state,
+                                     &output_unit.state_properties,
+                                     &depth_image);
     }
-  }
-
-  boost::mpi::gather(*mpi_comm_, &output_partition[0], recvcount, *output,
-                     kMasterRank);
 
-  if (mpi_comm_->rank() == kMasterRank) {
-    output->resize(original_count);
+    if (output_unit.cost != -1) {
+      output_unit.depth_image = DepthPatch(depth_image);
+    }
   }
+
+  *busy_time += chrono::duration<double>(chrono::high_resolution_clock::now() -
+                                         start_time).count();
 }
 
 
@@ -702,16 +1171,17 @@ void EnvObjectRecognition::GetLazySuccs(int source_state_id,
   }
 
   // If in cache, return
-  auto it = succ_cache.find(source_state_id);
+  const CachedSuccessors *cached_successors = successor_cache_.Find(
+                                                source_state_id);
 
-  if (it != succ_cache.end()) {
-    *costs = cost_cache[source_state_id];
+  if (cached_successors != nullptr) {
+    *costs = cached_successors->costs;
 
     if (static_cast<int>(source_state.NumObjects()) == env_params_.num_objects -
         1) {
       succ_ids->resize(costs->size(), env_params_.goal_state_id);
     } else {
-      *succ_ids = succ_cache[source_state_id];
+      *succ_ids = cached_successors->succ_ids;
     }
 
     printf("Lazily expanding cached state: %d with %zu objects\n",
@@ -739,8 +1209,8 @@ void EnvObjectRecognition::GetLazySuccs(int source_state_id,
   // We don't need IDs for the candidate succs at all.
   candidate_succ_ids.resize(candidate_succs.size(), 0);
 
-  vector<unsigned short> source_depth_image;
-  GetDepthImage(source_state, &source_depth_image);
+  CostComputationImages cost_computation_images;
+  AddSourceImage(source_state_id, source_state, &cost_computation_images);
 
   // Prepare the cost computation input vector.
   vector<CostComputationInput> cost_computation_input(candidate_succ_ids.size());
@@ -751,31 +1221,47 @@ void EnvObjectRecognition::GetLazySuccs(int source_state_id,
     input_unit.child_state = candidate_succs[ii];
     input_unit.source_id = source_state_id;
     input_unit.child_id = candidate_succ_ids[ii];
-    input_unit.source_depth_image = source_depth_image;
-    input_unit.source_counted_pixels = counted_pixels_map_[source_state_id];
+    input_unit.last_object_id = -1;
 
     const ObjectState &last_object_state =
       candidate_succs[ii].object_states().back();
     GraphState single_object_graph_state;
     single_object_graph_state.AppendObject(last_object_state);
 
-    const bool valid_state = GetSingleObjectDepthImage(single_object_graph_state,
-                                                       &input_unit.unadjusted_last_object_depth_image, false);
+    SingleObjectEntry single_object_entry;
+    const bool valid_state = GetSingleObjectEntry(single_object_graph_state,
+                                                  &single_object_entry);
 
     if (!valid_state) {
       continue;
     }
 
-    GetSingleObjectDepthImage(single_object_graph_state,
-                              &input_unit.adjusted_last_object_depth_image, true);
-    assert(adjusted_single_object_state_cache_.find(single_object_graph_state) !=
-           adjusted_single_object_state_cache_.end());
-    input_unit.adjusted_last_object_state =
-      adjusted_single_object_state_cache_[single_object_graph_state];
+    input_unit.adjusted_last_object_state = single_object_entry.adjusted_state;
+    input_unit.last_object_id = hash_manager_.GetStateIDForceful(
+                                  single_object_graph_state);
+
+    // Siblings often share the last object's pose, and the renders usually
+    // are on the other processors already from earlier expansions.
+    if (!single_object_renders_.Contains(input_unit.last_object_id) &&
+        std::find(cost_computation_images.new_single_object_ids.begin(),
+                  cost_computation_images.new_single_object_ids.end(),
+                  input_unit.last_object_id) ==
+        cost_computation_images.new_single_object_ids.end()) {
+      cost_computation_images.new_single_object_ids.push_back(
+        input_unit.last_object_id);
+      cost_computation_images.new_single_object_renders.push_back(std::move(
+                                                                    single_object_entry.render));
+    }
+
+    cost_computation_images.single_object_ids.push_back(
+      input_unit.last_object_id);
   }
 
   vector<CostComputationOutput> cost_computation_output;
-  ComputeCostsInParallel(cost_computation_input, &cost_computation_output, true);
+  ComputeCostsInParallel(cost_computation_input, &cost_computation_images,
+                         &cost_computation_output, true);
+
+  CachedSuccessors successors;
 
   //---- PARALLELIZE THIS LOOP-----------//
   for (size_t ii = 0; ii < candidate_succ_ids.size(); ++ii) {
@@ -800,14 +1286,16 @@ void EnvObjectRecognition::GetLazySuccs(int source_state_id,
       succ_ids->push_back(candidate_succ_ids[ii]);
     }
 
-    succ_cache[source_state_id].push_back(candidate_succ_ids[ii]);
+    successors.succ_ids.push_back(candidate_succ_ids[ii]);
     costs->push_back(output_unit.cost);
 
     if (image_debug_) {
       std::stringstream ss;
       ss.precision(20);
       ss << debug_dir_ + "succ_" << candidate_succ_ids[ii] << "_lazy.png";
-      PrintImage(ss.str(), output_unit.depth_image);
+      vector<unsigned short> depth_image;
+      output_unit.depth_image.GetDepthImage(&depth_image);
+      PrintImage(ss.str(), depth_image);
       // printf("State %d,       %d\n", candidate_succ_ids[ii],
       //        output_unit.cost);
       // printf("State %d,       %d      %d      %d      %d\n", candidate_succ_ids[ii],
@@ -829,7 +1317,9 @@ void EnvObjectRecognition::GetLazySuccs(int source_state_id,
   true_costs->resize(succ_ids->size(), false);
 
   // cache succs and costs
-  cost_cache[source_state_id] = *costs;
+  successors.costs = *costs;
+  successor_cache_.Insert(source_state_id, std::move(successors),
+                          static_cast<double>(candidate_succs.size()));
 
   if (perch_params_.debug_verbose) {
     printf("Lazy succs for %d\n", source_state_id);
@@ -870,15 +1360,16 @@ int EnvObjectRecognition::GetTrueCost(int source_state_id,
   GraphState child_state = hash_manager_.GetState(child_state_id);
   vector<unsigned short> source_depth_image;
   GetDepthImage(source_state, &source_depth_image);
-  vector<int> source_counted_pixels = counted_pixels_map_[source_state_id];
+  const PixelSet source_counted_pixels = GetCountedPixels(source_state_id);
 
   CostComputationOutput output_unit;
+  vector<unsigned short> depth_image, unadjusted_depth_image;
   output_unit.cost = GetCost(source_state, child_state,
                              source_depth_image,
                              source_counted_pixels,
                              &output_unit.child_counted_pixels, &output_unit.adjusted_state,
-                             &output_unit.state_properties, &output_unit.depth_image,
-                             &output_unit.unadjusted_depth_image);
+                             &output_unit.state_properties, &depth_image,
+                             &unadjusted_depth_image);
 
   bool invalid_state = output_unit.cost == -1;
 
@@ -887,27 +1378,24 @@ int EnvObjectRecognition::GetTrueCost(int source_state_id,
   }
 
   adjusted_states_[child_state_id] = output_unit.adjusted_state;
+  parent_ids_[child_state_id] = source_state_id;
 
-  assert(output_unit.depth_image.size() != 0);
+  assert(depth_image.size() != 0);
   minz_map_[child_state_id] =
     output_unit.state_properties.last_min_depth;
   maxz_map_[child_state_id] =
     output_unit.state_properties.last_max_depth;
-  counted_pixels_map_[child_state_id] = output_unit.child_counted_pixels;
+  counted_pixels_cache_.Insert(child_state_id,
+                               output_unit.child_counted_pixels);
   g_value_map_[child_state_id] = g_value_map_[source_state_id] +
                                  output_unit.cost;
 
-  // Cache the depth image only for single object renderings.
-  if (source_state.NumObjects() == 0) {
-    depth_image_cache_[child_state_id] = output_unit.depth_image;
-  }
-
   //--------------------------------------//
   if (image_debug_) {
     std::stringstream ss;
     ss.precision(20);
     ss << debug_dir_ + "succ_" << child_state_id << ".png";
-    PrintImage(ss.str(), output_unit.depth_image);
+    PrintImage(ss.str(), depth_image);
     printf("State %d,       %d      %d      %d      %d\n", child_state_id,
            output_unit.state_properties.target_cost,
            output_unit.state_properties.source_cost,
@@ -996,7 +1484,7 @@ int EnvObjectRecognition::GetLazyCost(const GraphState &source_state,
                                       const std::vector<unsigned short> &unadjusted_last_object_depth_image,
                                       const std::vector<unsigned short> &adjusted_last_object_depth_image,
                                       const GraphState &adjusted_last_object_state,
-                                      const std::vector<int> &parent_counted_pixels,
+                                      const PixelSet &parent_counted_pixels,
                                       GraphState *adjusted_child_state,
                                       GraphStateProperties *child_properties,
                                       vector<unsigned short> *final_depth_image) {
@@ -1020,13 +1508,12 @@ int EnvObjectRecognition::GetLazyCost(const GraphState &source_state,
   unsigned short succ_min_depth, succ_max_depth;
   vector<int> new_pixel_indices;
 
-  vector<unsigned short> child_depth_image;
-  GetComposedDepthImage(source_depth_image, unadjusted_last_object_depth_image,
-                        &child_depth_image);
+  vector<unsigned short> child_depth_image(kNumPixels);
 
-  if (IsOccluded(source_depth_image, child_depth_image, &new_pixel_indices,
-                 &succ_min_depth,
-                 &succ_max_depth)) {
+  if (ComposeAndFindNewPixels(source_depth_image.data(),
+                              unadjusted_last_object_depth_image.data(), kNumPixels,
+                              child_depth_image.data(), &new_pixel_indices, &succ_min_depth,
+                              &succ_max_depth)) {
     return -1;
   }
 
@@ -1049,7 +1536,7 @@ int EnvObjectRecognition::GetLazyCost(const GraphState &source_state,
 
     // Begin ICP Adjustment
     GetICPAdjustedPose(cloud_in, pose_in, cloud_out, &pose_out,
-                       parent_counted_pixels);
+                       &parent_counted_pixels);
 
     if (cloud_in->size() != 0 && cloud_out->size() == 0) {
       printf("Error in ICP adjustment\n");
@@ -1130,8 +1617,11 @@ int EnvObjectRecognition::GetLazyCost(const GraphState &source_state,
   int target_cost = 0, source_cost = 0, last_level_cost = 0, total_cost = 0;
   target_cost = GetTargetCost(cloud_out);
 
-  vector<int> child_counted_pixels;
-  source_cost = GetSourceCost(cloud_out,
+  PixelSet child_counted_pixels;
+  const PointCloudPtr source_cost_cloud =
+    perch_params_.use_projective_association ?
+    GetRenderedCloudForAssociation(new_obj_depth_image) : cloud_out;
+  source_cost = GetSourceCost(source_cost_cloud,
                               adjusted_child_state->object_states().back(),
                               last_level, parent_counted_pixels, &child_counted_pixels);
 
@@ -1169,10 +1659,11 @@ int EnvObjectRecognition::GetLazyCost(const GraphState &source_state,
 int EnvObjectRecognition::GetCost(const GraphState &source_state,
                                   const GraphState &child_state,
                                   const vector<unsigned short> &source_depth_image,
-                                  const vector<int> &parent_counted_pixels, vector<int> *child_counted_pixels,
+                                  const PixelSet &parent_counted_pixels, PixelSet *child_counted_pixels,
                                   GraphState *adjusted_child_state, GraphStateProperties *child_properties,
                                   vector<unsigned short> *final_depth_image,
-                                  vector<unsigned short> *unadjusted_depth_image) {
+                                  vector<unsigned short> *unadjusted_depth_image,
+                                  const vector<unsigned short> *last_object_depth_image) {
 
   assert(child_state.NumObjects() > 0);
 
@@ -1196,18 +1687,29 @@ int EnvObjectRecognition::GetCost(const GraphState &source_state,
   GraphState s_new_obj;
   s_new_obj.AppendObject(ObjectState(last_object_id,
                                      obj_models_[last_object_id].symmetric(), child_pose));
-  succ_depth_buffer = GetDepthImage(s_new_obj, &last_obj_depth_image);
 
-  unadjusted_depth_image->clear();
-  GetComposedDepthImage(source_depth_image, last_obj_depth_image,
-                        unadjusted_depth_image);
+  if (last_object_depth_image != nullptr) {
+    last_obj_depth_image = *last_object_depth_image;
+  } else if (!GetDepthPatchLibraryImage(s_new_obj, &last_obj_depth_image)) {
+    if (perch_params_.use_cropped_rendering) {
+      int num_occluders_unused = 0;
+      GetDepthPatch(s_new_obj, &num_occluders_unused).GetDepthImage(
+        &last_obj_depth_image);
+    } else {
+      succ_depth_buffer = GetDepthImage(s_new_obj, &last_obj_depth_image);
+    }
+  }
+
+  unadjusted_depth_image->resize(kNumPixels);
 
   unsigned short succ_min_depth_unused, succ_max_depth_unused;
   vector<int> new_pixel_indices;
 
-  if (IsOccluded(source_depth_image, *unadjusted_depth_image, &new_pixel_indices,
-                 &succ_min_depth_unused,
-                 &succ_max_depth_unused)) {
+  if (ComposeAndFindNewPixels(source_depth_image.data(),
+                              last_obj_depth_image.data(), kNumPixels,
+                              unadjusted_depth_image->data(), &new_pixel_indices,
+                              &succ_min_depth_unused,
+                              &succ_max_depth_unused)) {
     // final_depth_image->clear();
     // *final_depth_image = *unadjusted_depth_image;
     return -1;
@@ -1231,7 +1733,7 @@ int EnvObjectRecognition::GetCost(const GraphState &source_state,
   // Only non-occluded points
 
   GetICPAdjustedPose(cloud_in, pose_in, cloud_out, &pose_out,
-                     parent_counted_pixels);
+                     &parent_counted_pixels);
   // icp_cost = static_cast<int>(kICPCostMultiplier * icp_fitness_score);
   int last_idx = child_state.NumObjects() - 1;
 
@@ -1256,7 +1758,7 @@ int EnvObjectRecognition::GetCost(const GraphState &source_state,
   int num_occluders = 0;
   succ_depth_buffer = GetDepthImage(*adjusted_child_state, &depth_image, &num_occluders);
   // All points
-  succ_cloud = GetGravityAlignedPointCloud(depth_image);
+  succ_cloud = GetRenderedCloudForAssociation(depth_image);
 
   unsigned short succ_min_depth, succ_max_depth;
   new_pixel_indices.clear();
@@ -1297,14 +1799,14 @@ int EnvObjectRecognition::GetCost(const GraphState &source_state,
                               false, parent_counted_pixels, child_counted_pixels);
 
   if (last_level) {
-    vector<int> updated_counted_pixels;
+    PixelSet updated_counted_pixels;
     last_level_cost = GetLastLevelCost(succ_cloud,
                                        adjusted_child_state->object_states().back(), *child_counted_pixels,
                                        &updated_counted_pixels);
     // // NOTE: we won't include the points that lie outside the union of volumes.
     // // Refer to the header for documentation on child_counted_pixels.
     // *child_counted_pixels = updated_counted_pixels;
-    *child_counted_pixels = updated_counted_pixels;
+    *child_counted_pixels = std::move(updated_counted_pixels);
   }
 
   total_cost = source_cost + target_cost + last_level_cost;
@@ -1350,67 +1852,20 @@ bool EnvObjectRecognition::IsOccluded(const vector<unsigned short>
   assert(static_cast<int>(parent_depth_image.size()) == kNumPixels);
   assert(static_cast<int>(succ_depth_image.size()) == kNumPixels);
 
-  new_pixel_indices->clear();
-  *min_succ_depth = kKinectMaxDepth;
-  *max_succ_depth = 0;
-
-  bool is_occluded = false;
-
-  for (int jj = 0; jj < kNumPixels; ++jj) {
-
-    if (succ_depth_image[jj] != kKinectMaxDepth &&
-        parent_depth_image[jj] == kKinectMaxDepth) {
-      new_pixel_indices->push_back(jj);
-
-      // Find mininum depth of new pixels
-      if (succ_depth_image[jj] != kKinectMaxDepth &&
-          succ_depth_image[jj] < *min_succ_depth) {
-        *min_succ_depth = succ_depth_image[jj];
-      }
-
-      // Find maximum depth of new pixels
-      if (succ_depth_image[jj] != kKinectMaxDepth &&
-          succ_depth_image[jj] > *max_succ_depth) {
-        *max_succ_depth = succ_depth_image[jj];
-      }
-    }
-
-    // Occlusion
-    if (succ_depth_image[jj] != kKinectMaxDepth &&
-        parent_depth_image[jj] != kKinectMaxDepth &&
-        succ_depth_image[jj] < parent_depth_image[jj]) {
-      is_occluded = true;
-      break;
-    }
-
-    // if (succ_depth_image[jj] == kKinectMaxDepth && observed_depth_image_[jj] != kKinectMaxDepth) {
-    //   obs_pixels.push_back(jj);
-    // }
-  }
-
-  if (is_occluded) {
-    new_pixel_indices->clear();
-    *min_succ_depth = kKinectMaxDepth;
-    *max_succ_depth = 0;
-  }
-
-  return is_occluded;
+  return FindNewPixels(parent_depth_image.data(), succ_depth_image.data(),
+                       kNumPixels, new_pixel_indices, min_succ_depth, max_succ_depth);
 }
 
 int EnvObjectRecognition::GetTargetCost(const PointCloudPtr
                                         partial_rendered_cloud) {
   // Nearest-neighbor cost
   double nn_score = 0;
+  vector<unsigned char> explained;
+  observed_grid_.HasPointsWithinRadius(*partial_rendered_cloud, &explained);
 
   for (size_t ii = 0; ii < partial_rendered_cloud->points.size(); ++ii) {
-    vector<int> indices;
-    vector<float> sqr_dists;
     PointT point = partial_rendered_cloud->points[ii];
-    int num_neighbors_found = knn->radiusSearch(point,
-                                                perch_params_.sensor_resolution,
-                                                indices,
-                                                sqr_dists, 1);
-    const bool point_unexplained = num_neighbors_found == 0;
+    const bool point_unexplained = explained[ii] == 0;
 
 
     double cost = 0;
@@ -1456,18 +1911,20 @@ int EnvObjectRecognition::GetTargetCost(const PointCloudPtr
 
 int EnvObjectRecognition::GetSourceCost(const PointCloudPtr
                                         full_rendered_cloud, const ObjectState &last_object, const bool last_level,
-                                        const std::vector<int> &parent_counted_pixels,
-                                        std::vector<int> *child_counted_pixels) {
+                                        const PixelSet &parent_counted_pixels,
+                                        PixelSet *child_counted_pixels) {
 
   //TODO: TESTING
   assert(!last_level);
 
   // Compute the cost of points made infeasible in the observed point cloud.
   pcl::search::KdTree<PointT>::Ptr knn_reverse;
-  knn_reverse.reset(new pcl::search::KdTree<PointT>(true));
-  knn_reverse->setInputCloud(full_rendered_cloud);
 
-  child_counted_pixels->clear();
+  if (!perch_params_.use_projective_association) {
+    knn_reverse.reset(new pcl::search::KdTree<PointT>(true));
+    knn_reverse->setInputCloud(full_rendered_cloud);
+  }
+
   *child_counted_pixels = parent_counted_pixels;
 
   // TODO: make principled
@@ -1479,19 +1936,16 @@ int EnvObjectRecognition::GetSourceCost(const PointCloudPtr
     return 100000;
   }
 
-  std::sort(child_counted_pixels->begin(), child_counted_pixels->end());
-
   vector<int> indices_to_consider;
   // Indices of points within the circumscribed cylinder, but outside the
   // inscribed cylinder.
   vector<int> indices_circumscribed;
 
   if (last_level) {
-    indices_to_consider.resize(valid_indices_.size());
-    auto it = std::set_difference(valid_indices_.begin(), valid_indices_.end(),
-                                  child_counted_pixels->begin(), child_counted_pixels->end(),
-                                  indices_to_consider.begin());
-    indices_to_consider.resize(it - indices_to_consider.begin());
+    PixelSet::ForEachInDifference(valid_pixels_, *child_counted_pixels,
+    [&indices_to_consider](int index) {
+      indices_to_consider.push_back(index);
+    });
   } else {
     ContPose last_obj_pose = last_object.cont_pose();
     int last_obj_id = last_object.id();
@@ -1517,16 +1971,10 @@ int EnvObjectRecognition::GetSourceCost(const PointCloudPtr
            perch_params_.min_neighbor_points_for_valid_pose);
 
     // Remove the points already counted.
-    vector<int> filtered_validation_points;
-    filtered_validation_points.resize(validation_points.size());
-    std::sort(validation_points.begin(), validation_points.end());
-    auto filter_it = std::set_difference(validation_points.begin(),
-                                         validation_points.end(),
-                                         child_counted_pixels->begin(), child_counted_pixels->end(),
-                                         filtered_validation_points.begin());
-    filtered_validation_points.resize(filter_it -
-                                      filtered_validation_points.begin());
-    validation_points = filtered_validation_points;
+    validation_points.erase(std::remove_if(validation_points.begin(),
+                                           validation_points.end(), [child_counted_pixels](int index) {
+      return child_counted_pixels->Test(index);
+    }), validation_points.end());
 
     vector<Eigen::Vector3d> eig_points(validation_points.size());
     vector<Eigen::Vector2d> eig2d_points(validation_points.size());
@@ -1575,16 +2023,11 @@ int EnvObjectRecognition::GetSourceCost(const PointCloudPtr
   double nn_score = 0.0;
 
   for (const int ii : indices_to_consider) {
-    child_counted_pixels->push_back(ii);
+    child_counted_pixels->Set(ii);
 
     PointT point = observed_cloud_->points[ii];
-    vector<float> sqr_dists;
-    vector<int> indices;
-    int num_neighbors_found = knn_reverse->radiusSearch(point,
-                                                        perch_params_.sensor_resolution,
-                                                        indices,
-                                                        sqr_dists, 1);
-    bool point_unexplained = num_neighbors_found == 0;
+    bool point_unexplained = !HasRenderedNeighbor(full_rendered_cloud,
+                                                  knn_reverse, ii);
 
     if (point_unexplained) {
       if (kUseDepthSensitiveCost) {
@@ -1620,9 +2063,6 @@ int EnvObjectRecognition::GetSourceCost(const PointCloudPtr
   //   }
   // }
 
-  // Counted pixels always need to be sorted.
-  std::sort(child_counted_pixels->begin(), child_counted_pixels->end());
-
   int source_cost = 0;
 
   if (kNormalizeCost) {
@@ -1643,8 +2083,8 @@ int EnvObjectRecognition::GetSourceCost(const PointCloudPtr
 int EnvObjectRecognition::GetLastLevelCost(const PointCloudPtr
                                            full_rendered_cloud,
                                            const ObjectState &last_object,
-                                           const std::vector<int> &counted_pixels,
-                                           std::vector<int> *updated_counted_pixels) {
+                                           const PixelSet &counted_pixels,
+                                           PixelSet *updated_counted_pixels) {
   // There is no residual cost when we operate with the clutter mode.
   if (perch_params_.use_clutter_mode) {
     return 0;
@@ -1652,10 +2092,12 @@ int EnvObjectRecognition::GetLastLevelCost(const PointCloudPtr
 
   // Compute the cost of points made infeasible in the observed point cloud.
   pcl::search::KdTree<PointT>::Ptr knn_reverse;
-  knn_reverse.reset(new pcl::search::KdTree<PointT>(true));
-  knn_reverse->setInputCloud(full_rendered_cloud);
 
-  updated_counted_pixels->clear();
+  if (!perch_params_.use_projective_association) {
+    knn_reverse.reset(new pcl::search::KdTree<PointT>(true));
+    knn_reverse->setInputCloud(full_rendered_cloud);
+  }
+
   *updated_counted_pixels = counted_pixels;
 
   // TODO: make principled
@@ -1663,29 +2105,12 @@ int EnvObjectRecognition::GetLastLevelCost(const PointCloudPtr
     return 100000;
   }
 
-  std::sort(updated_counted_pixels->begin(), updated_counted_pixels->end());
-
-  vector<int> indices_to_consider;
-
-  indices_to_consider.resize(valid_indices_.size());
-  auto it = std::set_difference(valid_indices_.begin(), valid_indices_.end(),
-                                updated_counted_pixels->begin(), updated_counted_pixels->end(),
-                                indices_to_consider.begin());
-  indices_to_consider.resize(it - indices_to_consider.begin());
-
   double nn_score = 0.0;
 
-  for (const int ii : indices_to_consider) {
-    updated_counted_pixels->push_back(ii);
-
+  PixelSet::ForEachInDifference(valid_pixels_, counted_pixels, [&](int ii) {
     PointT point = observed_cloud_->points[ii];
-    vector<float> sqr_dists;
-    vector<int> indices;
-    int num_neighbors_found = knn_reverse->radiusSearch(point,
-                                                        perch_params_.sensor_resolution,
-                                                        indices,
-                                                        sqr_dists, 1);
-    bool point_unexplained = num_neighbors_found == 0;
+    bool point_unexplained = !HasRenderedNeighbor(full_rendered_cloud,
+                                                  knn_reverse, ii);
 
     if (point_unexplained) {
       if (kUseDepthSensitiveCost) {
@@ -1700,9 +2125,10 @@ int EnvObjectRecognition::GetLastLevelCost(const PointCloudPtr
         nn_score += 1.0;
       }
     }
-  }
+  });
 
-  assert(updated_counted_pixels->size() == valid_indices_.size());
+  *updated_counted_pixels |= valid_pixels_;
+  assert(updated_counted_pixels->Count() == num_valid_pixels_);
 
   int last_level_cost = static_cast<int>(nn_score);
   return last_level_cost;
@@ -1785,42 +2211,150 @@ PointCloudPtr EnvObjectRecognition::GetGravityAlignedOrganizedPointCloud(
   return cloud;
 }
 
-vector<unsigned short> EnvObjectRecognition::GetDepthImageFromPointCloud(
-  const PointCloudPtr &cloud) {
-  vector<unsigned short> depth_image(kNumPixels, kKinectMaxDepth);
+PointCloudPtr EnvObjectRecognition::GetRenderedCloudForAssociation(
+  const vector<unsigned short> &depth_image) {
+  if (!perch_params_.use_projective_association) {
+    return GetGravityAlignedPointCloud(depth_image);
+  }
 
-  for (size_t ii = 0; ii < cloud->size(); ++ii) {
-    PointT point = cloud->points[ii];
-    Eigen::Vector3f world_point(point.x, point.y, point.z);
-    int u = 0;
-    int v = 0;
-    float range = 0.0;
-    kinect_simulator_->rl_->getCameraCoordinate(cam_to_world_, world_point, u, v,
-                                                range);
-    v = kDepthImageHeight - 1 - v;
+  // An image without valid pixels maps to an empty cloud, as in the
+  // unorganized case, so that callers can tell there is nothing rendered.
+  const bool no_valid_pixels = std::all_of(depth_image.begin(),
+                                           depth_image.end(), [](unsigned short depth) {
+    return depth == kKinectMaxDepth;
+  });
 
-    if (v < 0 || u < 0 || v >= kDepthImageHeight || u >= kDepthImageWidth) {
-      continue;
-    }
+  if (no_valid_pixels) {
+    return PointCloudPtr(new PointCloud);
+  }
 
-    const int idx = v * kDepthImageWidth + u;
-    assert(idx >= 0 && idx < kNumPixels);
-    depth_image[idx] = std::min(static_cast<unsigned short>(1000.0 * range),
-                                depth_image[idx]);
+  return GetGravityAlignedOrganizedPointCloud(depth_image);
+}
+
+bool EnvObjectRecognition::HasRenderedNeighbor(const PointCloudPtr
+                                               &full_rendered_cloud,
+                                               const pcl::search::KdTree<PointT>::Ptr &knn_reverse,
+                                               int observed_index) const {
+  if (perch_params_.use_projective_association) {
+    return HasProjectiveNeighbor(full_rendered_cloud, observed_index);
   }
 
-  return depth_image;
+  vector<float> sqr_dists;
+  vector<int> indices;
+  int num_neighbors_found = knn_reverse->radiusSearch(
+                              observed_cloud_->points[observed_index],
+                              perch_params_.sensor_resolution,
+                              indices,
+                              sqr_dists, 1);
+  return num_neighbors_found != 0;
 }
 
-void EnvObjectRecognition::PrintValidStates() {
-  GraphState source_state;
-  pcl::PCDWriter writer;
+bool EnvObjectRecognition::HasProjectiveNeighbor(const PointCloudPtr
+                                                 &organized_rendered_cloud,
+                                                 int observed_index) const {
+  assert(static_cast<int>(organized_rendered_cloud->points.size()) ==
+         kNumPixels);
+  assert(observed_index < static_cast<int>
+         (observed_projective_windows_.size()));
 
-  for (int ii = 0; ii < env_params_.num_models; ++ii) {
-    PointCloudPtr cloud(new PointCloud);
+  const ProjectiveWindow &window = observed_projective_windows_[observed_index];
 
-    for (double x = env_params_.x_min; x <= env_params_.x_max;
-         x += env_params_.res) {
+  if (window.half_width < 0) {
+    return false;
+  }
+
+  const PointT &point = observed_cloud_->points[observed_index];
+  const float sqr_radius = static_cast<float>(perch_params_.sensor_resolution *
+                                              perch_params_.sensor_resolution);
+  const int row_min = std::max(0, window.v - window.half_width);
+  const int row_max = std::min(kDepthImageHeight - 1,
+                               window.v + window.half_width);
+  const int col_min = std::max(0, window.u - window.half_width);
+  const int col_max = std::min(kDepthImageWidth - 1,
+                               window.u + window.half_width);
+
+  for (int row = row_min; row <= row_max; ++row) {
+    for (int col = col_min; col <= col_max; ++col) {
+      const PointT &rendered_point = organized_rendered_cloud->points[row *
+                                                                      kDepthImageWidth + col];
+
+      // NaN for pixels without a return.
+      if (!pcl::isFinite(rendered_point)) {
+        continue;
+      }
+
+      const float dx = rendered_point.x - point.x;
+      const float dy = rendered_point.y - point.y;
+      const float dz = rendered_point.z - point.z;
+
+      if (dx * dx + dy * dy + dz * dz <= sqr_radius) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+void EnvObjectRecognition::ComputeObservedProjectiveWindows() {
+  observed_projective_windows_.resize(observed_cloud_->points.size());
+
+  // Same camera model as RangeLikelihood::getCameraCoordinate.
+  Eigen::Affine3f world_to_camera;
+  world_to_camera.matrix() = cam_to_world_.matrix().cast<float>() *
+                             gl_inverse_transform_;
+  world_to_camera = world_to_camera.inverse();
+
+  for (size_t ii = 0; ii < observed_cloud_->points.size(); ++ii) {
+    const PointT &point = observed_cloud_->points[ii];
+
+    if (!pcl::isFinite(point)) {
+      observed_projective_windows_[ii].half_width = -1;
+      continue;
+    }
+
+    observed_projective_windows_[ii] = ComputeProjectiveWindow(
+                                         world_to_camera * Eigen::Vector3f(point.x, point.y, point.z),
+                                         perch_params_.sensor_resolution);
+  }
+}
+
+vector<unsigned short> EnvObjectRecognition::GetDepthImageFromPointCloud(
+  const PointCloudPtr &cloud) {
+  vector<unsigned short> depth_image(kNumPixels, kKinectMaxDepth);
+
+  for (size_t ii = 0; ii < cloud->size(); ++ii) {
+    PointT point = cloud->points[ii];
+    Eigen::Vector3f world_point(point.x, point.y, point.z);
+    int u = 0;
+    int v = 0;
+    float range = 0.0;
+    kinect_simulator_->rl_->getCameraCoordinate(cam_to_world_, world_point, u, v,
+                                                range);
+    v = kDepthImageHeight - 1 - v;
+
+    if (v < 0 || u < 0 || v >= kDepthImageHeight || u >= kDepthImageWidth) {
+      continue;
+    }
+
+    const int idx = v * kDepthImageWidth + u;
+    assert(idx >= 0 && idx < kNumPixels);
+    depth_image[idx] = std::min(static_cast<unsigned short>(1000.0 * range),
+                                depth_image[idx]);
+  }
+
+  return depth_image;
+}
+
+void EnvObjectRecognition::PrintValidStates() {
+  GraphState source_state;
+  pcl::PCDWriter writer;
+
+  for (int ii = 0; ii < env_params_.num_models; ++ii) {
+    PointCloudPtr cloud(new PointCloud);
+
+    for (double x = env_params_.x_min; x <= env_params_.x_max;
+         x += env_params_.res) {
       for (double y = env_params_.y_min; y <= env_params_.y_max;
            y += env_params_.res) {
         for (double theta = 0; theta < 2 * M_PI; theta += env_params_.theta_res) {
@@ -1951,29 +2485,28 @@ const float *EnvObjectRecognition::GetDepthImage(GraphState s,
                              std::vector<unsigned short> *depth_image, int* num_occluders_in_input_cloud) {
 
   *num_occluders_in_input_cloud = 0;
-  if (scene_ == NULL) {
+  const SimExample::Ptr &simulator = GetSimulator();
+  const Scene::Ptr &scene = simulator->scene_;
+
+  if (scene == NULL) {
     printf("ERROR: Scene is not set\n");
   }
 
-  scene_->clear();
+  scene->clear();
 
   const auto &object_states = s.object_states();
 
   for (size_t ii = 0; ii < object_states.size(); ++ii) {
     const auto &object_state = object_states[ii];
-    ObjectModel obj_model = obj_models_[object_state.id()];
-    ContPose p = object_state.cont_pose();
-
-    auto transformed_mesh = obj_model.GetTransformedMesh(p);
-
-    PolygonMeshModel::Ptr model = PolygonMeshModel::Ptr (new PolygonMeshModel (
-                                                           GL_POLYGON, transformed_mesh));
-    scene_->add (model);
+    const ObjectModel &obj_model = obj_models_[object_state.id()];
+    scene->add(obj_model.GetRenderModel(object_state.cont_pose()));
   }
 
-  kinect_simulator_->doSim(env_params_.camera_pose);
-  const float *depth_buffer = kinect_simulator_->rl_->getDepthBuffer();
-  kinect_simulator_->get_depth_image_uint(depth_buffer, depth_image);
+  simulator->doSim(env_params_.camera_pose);
+  // With linear depth, the float depth buffer is not needed and not read.
+  const float *depth_buffer = simulator->rl_->getUseLinearDepth() ? NULL :
+                              simulator->rl_->getDepthBuffer();
+  simulator->get_depth_image_uint(depth_image);
 
   // kinect_simulator_->get_depth_image_cv(depth_buffer, depth_image);
   // cv_depth_image = cv::Mat(kDepthImageHeight, kDepthImageWidth, CV_16UC1, depth_image->data());
@@ -1985,18 +2518,154 @@ const float *EnvObjectRecognition::GetDepthImage(GraphState s,
   // }
 
   // Consider occlusions from non-modeled objects.
-  if (perch_params_.use_clutter_mode) {
-    for (size_t ii = 0; ii < depth_image->size(); ++ii) {
-      if (observed_depth_image_[ii] < (depth_image->at(ii) - kOcclusionThreshold) &&
-          depth_image->at(ii) != kKinectMaxDepth) {
-        depth_image->at(ii) = kKinectMaxDepth;
-        (*num_occluders_in_input_cloud)++;
+  *num_occluders_in_input_cloud = MaskInputOccluders(depth_image);
+
+  return depth_buffer;
+};
+
+const SimExample::Ptr &EnvObjectRecognition::GetSimulator() const {
+  if (computing_with_threads_) {
+    const int thread_num = omp_get_thread_num();
+    assert(thread_num < static_cast<int>(thread_simulators_.size()));
+    return thread_simulators_[thread_num];
+  }
+
+  return kinect_simulator_;
+}
+
+void EnvObjectRecognition::GetDepthImages(const vector<GraphState> &states,
+                                          vector<vector<unsigned short>> *depth_images,
+                                          vector<int> *num_occluders_in_input_cloud) {
+  depth_images->clear();
+  num_occluders_in_input_cloud->clear();
+
+  const SimExample::Ptr &simulator = GetSimulator();
+  const int batch_size = simulator->get_batch_size();
+  vector<pcl::simulation::Scene::Ptr> scenes;
+  vector<vector<unsigned short>> batch_depth_images;
+
+  for (size_t batch_start = 0; batch_start < states.size();
+       batch_start += batch_size) {
+    const size_t batch_end = std::min(states.size(),
+                                      batch_start + batch_size);
+    scenes.clear();
+
+    for (size_t ii = batch_start; ii < batch_end; ++ii) {
+      pcl::simulation::Scene::Ptr scene(new pcl::simulation::Scene);
+
+      for (const auto &object_state : states[ii].object_states()) {
+        const ObjectModel &obj_model = obj_models_[object_state.id()];
+        scene->add(obj_model.GetRenderModel(object_state.cont_pose()));
       }
+
+      scenes.push_back(scene);
+    }
+
+    simulator->doSimBatch(scenes, env_params_.camera_pose);
+    simulator->get_depth_images_uint(static_cast<int>(scenes.size()),
+                                     &batch_depth_images);
+
+    for (auto &depth_image : batch_depth_images) {
+      num_occluders_in_input_cloud->push_back(MaskInputOccluders(&depth_image));
+      depth_images->push_back(std::move(depth_image));
     }
   }
+}
 
-  return depth_buffer;
-};
+void EnvObjectRecognition::GetDepthImagesPipelined(const vector<GraphState>
+                                                   &states,
+                                                   vector<vector<unsigned short>> *depth_images,
+                                                   vector<int> *num_occluders_in_input_cloud) {
+  depth_images->assign(states.size(), vector<unsigned short>());
+  num_occluders_in_input_cloud->assign(states.size(), 0);
+
+  const SimExample::Ptr &simulator = GetSimulator();
+  const Scene::Ptr &scene = simulator->scene_;
+  const int num_buffers = simulator->get_num_readback_buffers();
+  vector<int> tickets(states.size());
+
+  auto retrieve = [&](int index) {
+    simulator->retrieve_depth_image_uint(tickets[index],
+                                         &(*depth_images)[index]);
+    (*num_occluders_in_input_cloud)[index] = MaskInputOccluders(
+                                               &(*depth_images)[index]);
+  };
+
+  for (int ii = 0; ii < static_cast<int>(states.size()); ++ii) {
+    scene->clear();
+
+    for (const auto &object_state : states[ii].object_states()) {
+      const ObjectModel &obj_model = obj_models_[object_state.id()];
+      scene->add(obj_model.GetRenderModel(object_state.cont_pose()));
+    }
+
+    tickets[ii] = simulator->submitSim(env_params_.camera_pose);
+
+    // Keep num_buffers readbacks in flight.
+    if (ii + 1 >= num_buffers) {
+      retrieve(ii + 1 - num_buffers);
+    }
+  }
+
+  for (int ii = std::max(0, static_cast<int>(states.size()) + 1 - num_buffers);
+       ii < static_cast<int>(states.size()); ++ii) {
+    retrieve(ii);
+  }
+}
+
+DepthPatch EnvObjectRecognition::GetDepthPatch(const GraphState &s,
+                                               int *num_occluders_in_input_cloud) {
+  const SimExample::Ptr &simulator = GetSimulator();
+  const Scene::Ptr &scene = simulator->scene_;
+  scene->clear();
+
+  for (const auto &object_state : s.object_states()) {
+    const ObjectModel &obj_model = obj_models_[object_state.id()];
+    scene->add(obj_model.GetRenderModel(object_state.cont_pose()));
+  }
+
+  int x_min = 0;
+  int y_min = 0;
+  int width = 0;
+  int height = 0;
+  vector<unsigned short> depths;
+  simulator->doSimCropped(env_params_.camera_pose, &x_min, &y_min, &width,
+                          &height, &depths);
+  *num_occluders_in_input_cloud = MaskInputOccluders(x_min, y_min, width,
+                                                     height, &depths);
+  return DepthPatch(x_min, y_min, width, height, depths);
+}
+
+int EnvObjectRecognition::MaskInputOccluders(vector<unsigned short>
+                                             *depth_image) {
+  return MaskInputOccluders(0, 0, kDepthImageWidth, kDepthImageHeight,
+                            depth_image);
+}
+
+int EnvObjectRecognition::MaskInputOccluders(int x_min, int y_min, int width,
+                                             int height, vector<unsigned short> *depths) {
+  int num_occluders = 0;
+
+  if (!perch_params_.use_clutter_mode) {
+    return num_occluders;
+  }
+
+  for (int ii = 0; ii < height; ++ii) {
+    const int image_row_start = (y_min + ii) * kDepthImageWidth + x_min;
+
+    for (int jj = 0; jj < width; ++jj) {
+      unsigned short &depth = (*depths)[ii * width + jj];
+
+      if (observed_depth_image_[image_row_start + jj] < (depth - kOcclusionThreshold)
+          && depth != kKinectMaxDepth) {
+        depth = kKinectMaxDepth;
+        num_occluders++;
+      }
+    }
+  }
+
+  return num_occluders;
+}
 
 void EnvObjectRecognition::SetCameraPose(Eigen::Isometry3d camera_pose) {
   env_params_.camera_pose = camera_pose;
@@ -2063,10 +2732,9 @@ void EnvObjectRecognition::SetObservation(int num_objects,
   }
 
   vector<int> nan_indices;
-  downsampled_observed_cloud_ = DownsamplePointCloud(observed_cloud_);
+  DownsampleObservedCloud();
 
-  knn.reset(new pcl::search::KdTree<PointT>(true));
-  knn->setInputCloud(observed_cloud_);
+  observed_grid_.SetInputCloud(observed_cloud_, perch_params_.sensor_resolution);
 
   if (mpi_comm_->rank() == kMasterRank) {
     LabelEuclideanClusters();
@@ -2075,13 +2743,20 @@ void EnvObjectRecognition::SetObservation(int num_objects,
   // Project point cloud to table.
   *projected_cloud_ = *observed_cloud_;
 
-  valid_indices_.clear();
-  valid_indices_.reserve(projected_cloud_->size());
+  // Counted pixels are indices of observed points.
+  if (static_cast<int>(projected_cloud_->size()) > kNumPixels) {
+    printf("ERROR: Observed cloud has more than %d points\n", kNumPixels);
+  }
+
+  valid_pixels_.Clear();
+  num_valid_pixels_ = 0;
 
   for (size_t ii = 0; ii < projected_cloud_->size(); ++ii) {
     if (!(std::isnan(projected_cloud_->points[ii].z) ||
-          std::isinf(projected_cloud_->points[ii].z))) {
-      valid_indices_.push_back(static_cast<int>(ii));
+          std::isinf(projected_cloud_->points[ii].z)) &&
+        static_cast<int>(ii) < kNumPixels) {
+      valid_pixels_.Set(static_cast<int>(ii));
+      ++num_valid_pixels_;
     }
 
     projected_cloud_->points[ii].z = env_params_.table_height;
@@ -2096,6 +2771,11 @@ void EnvObjectRecognition::SetObservation(int num_objects,
 
   projected_knn_.reset(new pcl::search::KdTree<PointT>(true));
   projected_knn_->setInputCloud(projected_cloud_);
+  ComputeValidPoseGrids();
+
+  if (perch_params_.use_projective_association) {
+    ComputeObservedProjectiveWindows();
+  }
 
   min_observed_depth_ = kKinectMaxDepth;
   max_observed_depth_ = 0;
@@ -2150,8 +2830,16 @@ void EnvObjectRecognition::ResetEnvironmentState() {
 
   hash_manager_.Reset();
   adjusted_states_.clear();
+  parent_ids_.clear();
+  // State IDs are reused after the reset.
+  source_images_.clear();
+  single_object_renders_.clear();
   env_stats_.scenes_rendered = 0;
   env_stats_.scenes_valid = 0;
+  env_stats_.rank_busy_time.clear();
+  env_stats_.cost_computation_time = 0;
+  env_stats_.wire_raw_bytes = 0;
+  env_stats_.wire_encoded_bytes = 0;
 
   const ObjectState special_goal_object_state(-1, false, DiscPose(0, 0, 0, 0, 0,
                                                                   0));
@@ -2173,15 +2861,17 @@ void EnvObjectRecognition::ResetEnvironmentState() {
   minz_map_.clear();
   maxz_map_.clear();
   g_value_map_.clear();
-  succ_cache.clear();
-  cost_cache.clear();
   last_object_rendering_cost_.clear();
-  depth_image_cache_.clear();
-  counted_pixels_map_.clear();
-  adjusted_single_object_depth_image_cache_.clear();
-  unadjusted_single_object_depth_image_cache_.clear();
-  adjusted_single_object_state_cache_.clear();
-  valid_indices_.clear();
+  successor_cache_.clear();
+  successor_cache_.ResetStats();
+  counted_pixels_cache_.clear();
+  counted_pixels_cache_.ResetStats();
+  single_object_cache_.clear();
+  single_object_cache_.ResetStats();
+  depth_patch_library_.clear();
+  valid_pose_grids_.clear();
+  valid_pixels_.Clear();
+  num_valid_pixels_ = 0;
 
   minz_map_[env_params_.start_state_id] = 0;
   maxz_map_[env_params_.start_state_id] = 0;
@@ -2192,6 +2882,9 @@ void EnvObjectRecognition::ResetEnvironmentState() {
   projected_cloud_.reset(new PointCloud);
   observed_organized_cloud_.reset(new PointCloud);
   downsampled_observed_cloud_.reset(new PointCloud);
+  downsampled_observed_knn_.reset();
+  observed_downsampled_indices_.clear();
+  downsampled_voxel_sizes_.clear();
 }
 
 void EnvObjectRecognition::SetObservation(vector<int> object_ids,
@@ -2265,6 +2958,10 @@ void EnvObjectRecognition::SetInput(const RecognitionInput &input) {
 
   SetObservation(input.model_names.size(), depth_image);
 
+  if (perch_params_.use_depth_patch_library) {
+    ComputeDepthPatchLibrary();
+  }
+
   // Precompute RCNN heuristics.
   rcnn_heuristic_factory_.reset(new RCNNHeuristicFactory(input,
                                                          kinect_simulator_));
@@ -2296,9 +2993,91 @@ void EnvObjectRecognition::Initialize(const EnvConfig &env_config) {
 
 double EnvObjectRecognition::GetICPAdjustedPose(const PointCloudPtr cloud_in,
                                                 const ContPose &pose_in, PointCloudPtr &cloud_out, ContPose *pose_out,
-                                                const std::vector<int> counted_indices /*= std::vector<int>(0)*/) {
+                                                const PixelSet *counted_pixels /*= nullptr*/) {
   *pose_out = pose_in;
 
+  bool converged = false;
+  double score = 100.0;
+  Eigen::Matrix4f transformation = Eigen::Matrix4f::Identity();
+
+  if (perch_params_.use_planar_icp) {
+    // Rather than downsampling the uncounted observed points, mask out the
+    // points of the shared downsampled cloud that have been fully counted.
+    vector<bool> counted_downsampled_points(
+      downsampled_observed_cloud_->points.size(), false);
+
+    if (counted_pixels != nullptr) {
+      GetCountedDownsampledPoints(*counted_pixels, &counted_downsampled_points);
+    }
+
+    PlanarICP icp;
+    icp.SetInputTarget(downsampled_observed_cloud_, downsampled_observed_knn_);
+    icp.SetTargetMask(&counted_downsampled_points);
+    icp.SetMaxCorrespondenceDistance(perch_params_.icp_max_correspondence);
+    icp.SetMaximumIterations(perch_params_.max_icp_iterations);
+    icp.SetTransformationEpsilon(1e-8);
+    icp.SetEuclideanFitnessEpsilon(perch_params_.sensor_resolution);
+    converged = icp.Align(*cloud_in, cloud_out.get());
+
+    if (converged) {
+      score = icp.GetFitnessScore();
+      transformation = icp.GetFinalTransformation();
+    }
+  } else {
+    vector<int> counted_indices;
+
+    if (counted_pixels != nullptr) {
+      counted_pixels->ForEach([&counted_indices](int index) {
+        counted_indices.push_back(index);
+      });
+    }
+    const PointCloudPtr remaining_observed_cloud = perception_utils::IndexFilter(
+                                                     observed_cloud_, counted_indices, true);
+    const PointCloudPtr remaining_downsampled_observed_cloud =
+      DownsamplePointCloud(remaining_observed_cloud);
+    converged = GetPCLICPTransformation(cloud_in,
+                                        remaining_downsampled_observed_cloud, cloud_out, &transformation,
+                                        &score);
+  }
+
+  if (converged) {
+    Eigen::Vector4f vec_in, vec_out;
+    vec_in << pose_in.x(), pose_in.y(), pose_in.z(), 1.0;
+    vec_out = transformation * vec_in;
+    double yaw = atan2(transformation(1, 0), transformation(0, 0));
+
+    double yaw1 = pose_in.yaw();
+    double yaw2 = yaw;
+    double cos_term = cos(yaw1 + yaw2);
+    double sin_term = sin(yaw1 + yaw2);
+    double total_yaw = atan2(sin_term, cos_term);
+
+    *pose_out = ContPose(vec_out[0], vec_out[1], vec_out[2], 0.0, 0.0, total_yaw);
+    // printf("Old yaw: %f, New yaw: %f\n", pose_in.theta, pose_out->theta);
+    // printf("Old xy: %f %f, New xy: %f %f\n", pose_in.x, pose_in.y, pose_out->x, pose_out->y);
+
+
+    // static int i = 0;
+    // std::stringstream ss1, ss2;
+    // ss1.precision(20);
+    // ss2.precision(20);
+    // ss1 << debug_dir_ + "sim_cloud_" << i << ".pcd";
+    // ss2 << debug_dir_ + "sim_cloud_aligned_" << i << ".pcd";
+    // pcl::PCDWriter writer;
+    // writer.writeBinary (ss1.str()  , *cloud_in);
+    // writer.writeBinary (ss2.str()  , *cloud_out);
+    // i++;
+  } else {
+    cloud_out = cloud_in;
+    *pose_out = pose_in;
+  }
+
+  return score;
+}
+
+bool EnvObjectRecognition::GetPCLICPTransformation(const PointCloudPtr
+                                                   cloud_in, const PointCloudPtr target_cloud, PointCloudPtr &cloud_out,
+                                                   Eigen::Matrix4f *transformation, double *score) {
   pcl::IterativeClosestPointNonLinear<PointT, PointT> icp;
 
   // int num_points_original = cloud_in->points.size();
@@ -2311,11 +3090,7 @@ double EnvObjectRecognition::GetICPAdjustedPose(const PointCloudPtr cloud_in,
     icp.setInputSource(cloud_in);
   }
 
-  const PointCloudPtr remaining_observed_cloud = perception_utils::IndexFilter(
-                                                   observed_cloud_, counted_indices, true);
-  const PointCloudPtr remaining_downsampled_observed_cloud =
-    DownsamplePointCloud(remaining_observed_cloud);
-  icp.setInputTarget(remaining_downsampled_observed_cloud);
+  icp.setInputTarget(target_cloud);
   // icp.setInputTarget(downsampled_observed_cloud_);
   // icp.setInputTarget(observed_cloud_);
 
@@ -2349,43 +3124,66 @@ double EnvObjectRecognition::GetICPAdjustedPose(const PointCloudPtr cloud_in,
   icp.setEuclideanFitnessEpsilon(perch_params_.sensor_resolution);  // 1e-5
 
   icp.align(*cloud_out);
-  double score = 100.0;
 
-  if (icp.hasConverged()) {
-    score = icp.getFitnessScore();
-    Eigen::Matrix4f transformation = icp.getFinalTransformation();
-    Eigen::Vector4f vec_in, vec_out;
-    vec_in << pose_in.x(), pose_in.y(), pose_in.z(), 1.0;
-    vec_out = transformation * vec_in;
-    double yaw = atan2(transformation(1, 0), transformation(0, 0));
+  if (!icp.hasConverged()) {
+    return false;
+  }
 
-    double yaw1 = pose_in.yaw();
-    double yaw2 = yaw;
-    double cos_term = cos(yaw1 + yaw2);
-    double sin_term = sin(yaw1 + yaw2);
-    double total_yaw = atan2(sin_term, cos_term);
+  *score = icp.getFitnessScore();
+  *transformation = icp.getFinalTransformation();
+  return true;
+}
 
-    *pose_out = ContPose(vec_out[0], vec_out[1], vec_out[2], 0.0, 0.0, total_yaw);
-    // printf("Old yaw: %f, New yaw: %f\n", pose_in.theta, pose_out->theta);
-    // printf("Old xy: %f %f, New xy: %f %f\n", pose_in.x, pose_in.y, pose_out->x, pose_out->y);
+void EnvObjectRecognition::DownsampleObservedCloud() {
+  downsampled_observed_cloud_.reset(new PointCloud);
+  pcl::VoxelGrid<PointT> voxel_grid;
+  voxel_grid.setInputCloud(observed_cloud_);
+  voxel_grid.setLeafSize(perception_utils::kVoxelLeafSize,
+                         perception_utils::kVoxelLeafSize, perception_utils::kVoxelLeafSize);
+  voxel_grid.setSaveLeafLayout(true);
+  voxel_grid.filter(*downsampled_observed_cloud_);
 
+  observed_downsampled_indices_.assign(observed_cloud_->points.size(), -1);
+  downsampled_voxel_sizes_.assign(downsampled_observed_cloud_->points.size(), 0);
 
-    // static int i = 0;
-    // std::stringstream ss1, ss2;
-    // ss1.precision(20);
-    // ss2.precision(20);
-    // ss1 << debug_dir_ + "sim_cloud_" << i << ".pcd";
-    // ss2 << debug_dir_ + "sim_cloud_aligned_" << i << ".pcd";
-    // pcl::PCDWriter writer;
-    // writer.writeBinary (ss1.str()  , *cloud_in);
-    // writer.writeBinary (ss2.str()  , *cloud_out);
-    // i++;
-  } else {
-    cloud_out = cloud_in;
-    *pose_out = pose_in;
+  for (size_t ii = 0; ii < observed_cloud_->points.size(); ++ii) {
+    const PointT &point = observed_cloud_->points[ii];
+
+    if (!pcl::isFinite(point)) {
+      continue;
+    }
+
+    const int downsampled_index = voxel_grid.getCentroidIndex(point);
+
+    if (downsampled_index < 0) {
+      continue;
+    }
+
+    observed_downsampled_indices_[ii] = downsampled_index;
+    ++downsampled_voxel_sizes_[downsampled_index];
   }
 
-  return score;
+  downsampled_observed_knn_.reset(new pcl::search::KdTree<PointT>(true));
+
+  if (!downsampled_observed_cloud_->points.empty()) {
+    downsampled_observed_knn_->setInputCloud(downsampled_observed_cloud_);
+  }
+}
+
+void EnvObjectRecognition::GetCountedDownsampledPoints(
+  const PixelSet &counted_pixels, vector<bool> *counted_downsampled_points) {
+  counted_downsampled_points->assign(downsampled_observed_cloud_->points.size(),
+                                     false);
+
+  vector<int> num_uncounted = downsampled_voxel_sizes_;
+
+  counted_pixels.ForEach([&](int observed_index) {
+    const int downsampled_index = observed_downsampled_indices_[observed_index];
+
+    if (downsampled_index >= 0 && --num_uncounted[downsampled_index] == 0) {
+      (*counted_downsampled_points)[downsampled_index] = true;
+    }
+  });
 }
 
 // Feature-based and ICP Planners
@@ -2458,14 +3256,9 @@ GraphState EnvObjectRecognition::ComputeGreedyICPPoses() {
               continue;
             }
 
-            auto transformed_mesh = obj_models_[model_id].GetTransformedMesh(p_in);
             PointCloudPtr cloud_in(new PointCloud);
             PointCloudPtr cloud_aligned(new PointCloud);
-            pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_in_xyz (new
-                                                              pcl::PointCloud<pcl::PointXYZ>);
-
-            pcl::fromPCLPointCloud2(transformed_mesh->cloud, *cloud_in_xyz);
-            copyPointCloud(*cloud_in_xyz, *cloud_in);
+            obj_models_[model_id].GetTransformedVertices(p_in, cloud_in.get());
 
             double icp_fitness_score = GetICPAdjustedPose(cloud_in, p_in,
                                                           cloud_aligned, &p_out);
@@ -2543,6 +3336,9 @@ void EnvObjectRecognition::SetDebugDir(const string &debug_dir) {
 
 const EnvStats &EnvObjectRecognition::GetEnvStats() {
   env_stats_.scenes_valid = hash_manager_.Size() - 1; // Ignore the start state
+  env_stats_.cache_stats["successors"] = successor_cache_.stats();
+  env_stats_.cache_stats["counted pixels"] = counted_pixels_cache_.stats();
+  env_stats_.cache_stats["single objects"] = single_object_cache_.stats();
   return env_stats_;
 }
 
@@ -2635,24 +3431,15 @@ vector<PointCloudPtr> EnvObjectRecognition::GetObjectPointClouds(
   return object_point_clouds;
 }
 
-void EnvObjectRecognition::GenerateSuccessorStates(const GraphState
-                                                   &source_state, std::vector<GraphState> *succ_states) const {
-
-  assert(succ_states != nullptr);
-  succ_states->clear();
+void EnvObjectRecognition::ComputeValidPoseGrids() {
+  const auto start_time = chrono::high_resolution_clock::now();
 
-  const auto &source_object_states = source_state.object_states();
+  // One task per model and x, so that the rows of all models are shared out
+  // together.
+  vector<std::pair<int, double>> rows;
+  vector<double> model_res(env_params_.num_models);
 
   for (int ii = 0; ii < env_params_.num_models; ++ii) {
-    auto it = std::find_if(source_object_states.begin(),
-    source_object_states.end(), [ii](const ObjectState & object_state) {
-      return object_state.id() == ii;
-    });
-
-    if (it != source_object_states.end()) {
-      continue;
-    }
-
     auto model_bank_it = model_bank_.find(obj_models_[ii].name());
     assert (model_bank_it != model_bank_.end());
     const auto &model_meta_data = model_bank_it->second;
@@ -2664,42 +3451,129 @@ void EnvObjectRecognition::GenerateSuccessorStates(const GraphState
       search_resolution = env_params_.res;
     }
 
-    const double res = perch_params_.use_adaptive_resolution ?
-                       obj_models_[ii].GetInscribedRadius() : search_resolution;
+    model_res[ii] = perch_params_.use_adaptive_resolution ?
+                    obj_models_[ii].GetInscribedRadius() : search_resolution;
 
     for (double x = env_params_.x_min; x <= env_params_.x_max;
-         x += res) {
-      for (double y = env_params_.y_min; y <= env_params_.y_max;
-           y += res) {
-        // for (double pitch = 0; pitch < M_PI; pitch+=M_PI/2) {
-        for (double theta = 0; theta < 2 * M_PI; theta += env_params_.theta_res) {
-          // ContPose p(x, y, env_params_.table_height, 0.0, pitch, theta);
-          ContPose p(x, y, env_params_.table_height, 0.0, 0.0, theta);
+         x += model_res[ii]) {
+      rows.push_back(std::make_pair(ii, x));
+    }
+  }
 
-          if (!IsValidPose(source_state, ii, p)) {
-            continue;
-          }
+  vector<ValidPoseGrid> row_grids(rows.size());
 
+  #pragma omp parallel for schedule(dynamic, 1)
 
-          GraphState s = source_state; // Can only add objects, not remove them
-          const ObjectState new_object(ii, obj_models_[ii].symmetric(), p);
-          s.AppendObject(new_object);
+  for (size_t row = 0; row < rows.size(); ++row) {
+    const int ii = rows[row].first;
+    const double x = rows[row].second;
+    const auto &model_meta_data = model_bank_.find(obj_models_[ii].name())->second;
+    auto &row_grid = row_grids[row];
 
-          succ_states->push_back(s);
+    for (double y = env_params_.y_min; y <= env_params_.y_max;
+         y += model_res[ii]) {
+      ValidPoseGrid::Cell cell;
+      cell.poses_begin = static_cast<int>(row_grid.poses.size());
+      // The neighbor search does not depend on theta.
+      cell.num_neighbors = CountNeighborPoints(ii, ContPose(x, y,
+                                                            env_params_.table_height, 0.0, 0.0, 0.0), false);
 
-          // If symmetric object, don't iterate over all thetas
-          if (obj_models_[ii].symmetric() || model_meta_data.symmetry_mode == 2) {
-            break;
-          }
+      if (cell.num_neighbors < perch_params_.min_neighbor_points_for_valid_pose) {
+        continue;
+      }
 
-          // If 180 degree symmetric, then iterate only between 0 and 180.
-          if (model_meta_data.symmetry_mode == 1 &&
-              theta > (M_PI + env_params_.theta_res)) {
-            break;
-          }
+      // for (double pitch = 0; pitch < M_PI; pitch+=M_PI/2) {
+      for (double theta = 0; theta < 2 * M_PI; theta += env_params_.theta_res) {
+        // ContPose p(x, y, env_params_.table_height, 0.0, pitch, theta);
+        ContPose p(x, y, env_params_.table_height, 0.0, 0.0, theta);
+
+        if (!IsValidFootprint(ii, p)) {
+          continue;
+        }
+
+        row_grid.poses.push_back(p);
 
-          // }
+        // If symmetric object, don't iterate over all thetas
+        if (obj_models_[ii].symmetric() || model_meta_data.symmetry_mode == 2) {
+          break;
         }
+
+        // If 180 degree symmetric, then iterate only between 0 and 180.
+        if (model_meta_data.symmetry_mode == 1 &&
+            theta > (M_PI + env_params_.theta_res)) {
+          break;
+        }
+
+        // }
+      }
+
+      cell.poses_end = static_cast<int>(row_grid.poses.size());
+
+      if (cell.poses_end > cell.poses_begin) {
+        row_grid.cells.push_back(cell);
+      }
+    }
+  }
+
+  valid_pose_grids_.assign(env_params_.num_models, ValidPoseGrid());
+
+  for (size_t row = 0; row < rows.size(); ++row) {
+    auto &grid = valid_pose_grids_[rows[row].first];
+    const int offset = static_cast<int>(grid.poses.size());
+
+    for (auto cell : row_grids[row].cells) {
+      cell.poses_begin += offset;
+      cell.poses_end += offset;
+      grid.cells.push_back(cell);
+    }
+
+    grid.poses.insert(grid.poses.end(), row_grids[row].poses.begin(),
+                      row_grids[row].poses.end());
+  }
+
+  if (IsMaster(mpi_comm_)) {
+    printf("Computed valid pose grids in %f s\n", chrono::duration<double>
+           (chrono::high_resolution_clock::now() - start_time).count());
+
+    for (int ii = 0; ii < env_params_.num_models; ++ii) {
+      printf("Model %d: %zu valid poses in %zu cells\n", ii,
+             valid_pose_grids_[ii].poses.size(), valid_pose_grids_[ii].cells.size());
+    }
+  }
+}
+
+void EnvObjectRecognition::GenerateSuccessorStates(const GraphState
+                                                   &source_state, std::vector<GraphState> *succ_states) const {
+
+  assert(succ_states != nullptr);
+  succ_states->clear();
+
+  const auto &source_object_states = source_state.object_states();
+
+  for (int ii = 0; ii < env_params_.num_models; ++ii) {
+    auto it = std::find_if(source_object_states.begin(),
+    source_object_states.end(), [ii](const ObjectState & object_state) {
+      return object_state.id() == ii;
+    });
+
+    if (it != source_object_states.end()) {
+      continue;
+    }
+
+    // Everything in IsValidPose but the overlap with the objects already
+    // placed is in the grid, and all poses in a cell share x and y.
+    const auto &grid = valid_pose_grids_[ii];
+
+    for (const auto &cell : grid.cells) {
+      if (OverlapsObjects(source_state, ii, grid.poses[cell.poses_begin])) {
+        continue;
+      }
+
+      for (int jj = cell.poses_begin; jj < cell.poses_end; ++jj) {
+        // Can only add objects, not remove them. Built in place, and
+        // without allocating for scenes that fit inline in a GraphState.
+        succ_states->emplace_back(source_state, ObjectState(ii,
+                                                            obj_models_[ii].symmetric(), grid.poses[jj]));
       }
     }
   }
@@ -2709,53 +3583,197 @@ bool EnvObjectRecognition::GetComposedDepthImage(const vector<unsigned short>
                                                  &source_depth_image, const vector<unsigned short> &last_object_depth_image,
                                                  vector<unsigned short> *composed_depth_image) {
 
-  composed_depth_image->clear();
-  composed_depth_image->resize(source_depth_image.size(), kKinectMaxDepth);
   assert(source_depth_image.size() == last_object_depth_image.size());
+  composed_depth_image->resize(source_depth_image.size());
+  ComposeDepthImages(source_depth_image.data(), last_object_depth_image.data(),
+                     composed_depth_image->data(),
+                     static_cast<int>(source_depth_image.size()));
+  return true;
+}
 
-  #pragma omp parallel for
+bool EnvObjectRecognition::GetSingleObjectEntry(const GraphState
+                                                &single_object_graph_state, SingleObjectEntry *entry) {
+  assert(single_object_graph_state.NumObjects() == 1);
 
-  for (size_t ii = 0; ii < source_depth_image.size(); ++ii) {
-    composed_depth_image->at(ii) = std::min(source_depth_image[ii],
-                                            last_object_depth_image[ii]);
+  const SingleObjectEntry *cached_entry = single_object_cache_.Find(
+                                            single_object_graph_state);
+
+  if (cached_entry != nullptr) {
+    *entry = *cached_entry;
+    return entry->valid;
   }
 
-  return true;
+  // Evaluate the state as a successor of the start state again.
+  const GraphState empty_state;
+  vector<unsigned short> source_depth_image;
+  GetDepthImage(empty_state, &source_depth_image);
+
+  PixelSet child_counted_pixels_unused;
+  GraphStateProperties state_properties_unused;
+  vector<unsigned short> depth_image, unadjusted_depth_image;
+  *entry = SingleObjectEntry();
+  entry->valid = GetCost(empty_state, single_object_graph_state,
+                         source_depth_image, PixelSet(), &child_counted_pixels_unused,
+                         &entry->adjusted_state, &state_properties_unused, &depth_image,
+                         &unadjusted_depth_image) != -1;
+  ++env_stats_.scenes_rendered;
+
+  if (entry->valid) {
+    entry->render.unadjusted_depth_image = DepthPatch(unadjusted_depth_image);
+    entry->render.adjusted_depth_image = DepthPatch(depth_image);
+  } else {
+    entry->adjusted_state = GraphState();
+  }
+
+  single_object_cache_.Insert(single_object_graph_state, *entry);
+  return entry->valid;
 }
 
-bool EnvObjectRecognition::GetSingleObjectDepthImage(const GraphState
-                                                     &single_object_graph_state, vector<unsigned short> *single_object_depth_image,
-                                                     bool after_refinement) {
+PixelSet EnvObjectRecognition::GetCountedPixels(int state_id) {
+  if (state_id == env_params_.start_state_id) {
+    return PixelSet();
+  }
 
-  single_object_depth_image->clear();
+  const PixelSet *cached_pixels = counted_pixels_cache_.Find(state_id);
 
-  assert(single_object_graph_state.NumObjects() == 1);
+  if (cached_pixels != nullptr) {
+    return *cached_pixels;
+  }
 
-  auto &cache = after_refinement ? adjusted_single_object_depth_image_cache_ :
-                unadjusted_single_object_depth_image_cache_;
+  // States that were never evaluated have counted nothing.
+  const auto parent_it = parent_ids_.find(state_id);
 
-  // TODO: Verify there are no cases where this will fail.
-  if (cache.find(single_object_graph_state) ==
-      cache.end()) {
-    return false;
+  if (parent_it == parent_ids_.end()) {
+    return PixelSet();
   }
 
-  *single_object_depth_image =
-    cache[single_object_graph_state];
+  // Evaluate the edge from the parent again, as GetTrueCost does.
+  const int parent_id = parent_it->second;
+  GraphState parent_state;
 
-  return true;
+  if (adjusted_states_.find(parent_id) != adjusted_states_.end()) {
+    parent_state = adjusted_states_[parent_id];
+  } else {
+    parent_state = hash_manager_.GetState(parent_id);
+  }
+
+  const PixelSet parent_counted_pixels = GetCountedPixels(parent_id);
+  vector<unsigned short> parent_depth_image;
+  GetDepthImage(parent_state, &parent_depth_image);
+
+  CostComputationOutput output_unit;
+  vector<unsigned short> depth_image, unadjusted_depth_image;
+  GetCost(parent_state, hash_manager_.GetState(state_id), parent_depth_image,
+          parent_counted_pixels, &output_unit.child_counted_pixels,
+          &output_unit.adjusted_state, &output_unit.state_properties, &depth_image,
+          &unadjusted_depth_image);
+  ++env_stats_.scenes_rendered;
+
+  counted_pixels_cache_.Insert(state_id, output_unit.child_counted_pixels);
+  return output_unit.child_counted_pixels;
 }
 
-vector<unsigned short> EnvObjectRecognition::ApplyOcclusionMask(
-  const vector<unsigned short> input_depth_image,
-  const vector<unsigned short> masking_depth_image) {
-  vector<unsigned short> masked_depth_image(kNumPixels, kKinectMaxDepth);
+void EnvObjectRecognition::SetCacheBudgets() {
+  const double budget = static_cast<double>
+                        (perch_params_.cache_memory_budget_mb) * 1024 * 1024;
+  counted_pixels_cache_.set_byte_budget(static_cast<size_t>(budget *
+                                                            kCountedPixelsCacheShare));
+  single_object_cache_.set_byte_budget(static_cast<size_t>(budget *
+                                                           kSingleObjectCacheShare));
+  successor_cache_.set_byte_budget(static_cast<size_t>(budget *
+                                                       kSuccessorCacheShare));
+}
 
-  for (int ii = 0; ii < kNumPixels; ++ii) {
-    masked_depth_image[ii] = masking_depth_image[ii] > input_depth_image[ii] ?
-                             input_depth_image[ii] : kKinectMaxDepth;
+void EnvObjectRecognition::ComputeDepthPatchLibrary() {
+  depth_patch_library_.clear();
+
+  // Single-object states are valid in a non-empty scene only if they are
+  // valid in the empty one, so this covers every state GetCost may need.
+  const GraphState empty_state;
+  vector<GraphState> single_object_states;
+  GenerateSuccessorStates(empty_state, &single_object_states);
+
+  const int num_processors = static_cast<int>(mpi_comm_->size());
+  const int rank = static_cast<int>(mpi_comm_->rank());
+
+  // Every rank enumerates the same states, so it is enough to exchange the
+  // patches in order.
+  vector<GraphState> rank_states;
+
+  for (size_t ii = rank; ii < single_object_states.size();
+       ii += num_processors) {
+    rank_states.push_back(single_object_states[ii]);
+  }
+
+  vector<vector<unsigned short>> depth_images;
+  vector<DepthPatch> rank_patches;
+  rank_patches.reserve(rank_states.size());
+
+  if (perch_params_.use_batch_rendering) {
+    vector<int> num_occluders_unused;
+    GetDepthImages(rank_states, &depth_images, &num_occluders_unused);
+  } else if (perch_params_.use_pipelined_rendering) {
+    vector<int> num_occluders_unused;
+    GetDepthImagesPipelined(rank_states, &depth_images, &num_occluders_unused);
+  } else if (perch_params_.use_cropped_rendering) {
+    int num_occluders_unused = 0;
+
+    for (size_t ii = 0; ii < rank_states.size(); ++ii) {
+      rank_patches.push_back(GetDepthPatch(rank_states[ii],
+                                           &num_occluders_unused));
+    }
+  } else {
+    depth_images.resize(rank_states.size());
+
+    for (size_t ii = 0; ii < rank_states.size(); ++ii) {
+      GetDepthImage(rank_states[ii], &depth_images[ii]);
+    }
   }
 
+  for (const auto &depth_image : depth_images) {
+    rank_patches.emplace_back(depth_image);
+  }
+
+  vector<vector<DepthPatch>> all_patches;
+  boost::mpi::all_gather(*mpi_comm_, rank_patches, all_patches);
+
+  for (size_t ii = 0; ii < single_object_states.size(); ++ii) {
+    depth_patch_library_[single_object_states[ii]] =
+      all_patches[ii % num_processors][ii / num_processors];
+  }
+
+  if (IsMaster(mpi_comm_)) {
+    size_t num_bytes = 0;
+
+    for (const auto &entry : depth_patch_library_) {
+      num_bytes += entry.second.depths().size() * sizeof(unsigned short);
+    }
+
+    printf("Depth patch library: %zu states, %f MB\n",
+           depth_patch_library_.size(), num_bytes / (1024.0 * 1024.0));
+  }
+}
+
+bool EnvObjectRecognition::GetDepthPatchLibraryImage(const GraphState
+                                                     &single_object_graph_state,
+                                                     vector<unsigned short> *single_object_depth_image) const {
+  assert(single_object_graph_state.NumObjects() == 1);
+  auto it = depth_patch_library_.find(single_object_graph_state);
+
+  if (it == depth_patch_library_.end()) {
+    return false;
+  }
+
+  it->second.GetDepthImage(single_object_depth_image);
+  return true;
+}
+
+vector<unsigned short> EnvObjectRecognition::ApplyOcclusionMask(
+  const vector<unsigned short> &input_depth_image,
+  const vector<unsigned short> &masking_depth_image) {
+  vector<unsigned short> masked_depth_image(kNumPixels);
+  sbpl_perception::ApplyOcclusionMask(input_depth_image.data(),
+                                      masking_depth_image.data(), masked_depth_image.data(), kNumPixels);
   return masked_depth_image;
 }
 }  // namespace
@@ -0,0 +1,244 @@
+/**
+ * @file voxel_hash_grid.cpp
+ * @brief Fixed-radius neighbor queries on a static point cloud
+ * @author Venkatraman Narayanan
+ * Carnegie Mellon University, 2015
+ */
+
+#include <sbpl_perception/voxel_hash_grid.h>
+
+#include <pcl/common/point_tests.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace sbpl_perception {
+
+namespace {
+
+// True if any of the n points (xs, ys, zs) is strictly within sqr_radius of
+// (x, y, z). Each lane computes exactly what the scalar tail does (no fused
+// multiply-adds), so the answer does not depend on the instruction set.
+bool AnyWithinRadius(const float *xs, const float *ys, const float *zs, int n,
+                     float x, float y, float z, float sqr_radius) {
+  int ii = 0;
+
+#if defined(__AVX__)
+  const __m256 x8 = _mm256_set1_ps(x);
+  const __m256 y8 = _mm256_set1_ps(y);
+  const __m256 z8 = _mm256_set1_ps(z);
+  const __m256 sqr_radius8 = _mm256_set1_ps(sqr_radius);
+
+  for (; ii + 8 <= n; ii += 8) {
+    const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(xs + ii), x8);
+    const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(ys + ii), y8);
+    const __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(zs + ii), z8);
+    const __m256 sqr_dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx),
+                                                        _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+
+    if (_mm256_movemask_ps(_mm256_cmp_ps(sqr_dist, sqr_radius8,
+                                         _CMP_LT_OQ)) != 0) {
+      return true;
+    }
+  }
+
+#endif
+
+#if defined(__SSE2__)
+  const __m128 x4 = _mm_set1_ps(x);
+  const __m128 y4 = _mm_set1_ps(y);
+  const __m128 z4 = _mm_set1_ps(z);
+  const __m128 sqr_radius4 = _mm_set1_ps(sqr_radius);
+
+  for (; ii + 4 <= n; ii += 4) {
+    const __m128 dx = _mm_sub_ps(_mm_loadu_ps(xs + ii), x4);
+    const __m128 dy = _mm_sub_ps(_mm_loadu_ps(ys + ii), y4);
+    const __m128 dz = _mm_sub_ps(_mm_loadu_ps(zs + ii), z4);
+    const __m128 sqr_dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx),
+                                                  _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+    if (_mm_movemask_ps(_mm_cmplt_ps(sqr_dist, sqr_radius4)) != 0) {
+      return true;
+    }
+  }
+
+#endif
+
+  for (; ii < n; ++ii) {
+    const float dx = xs[ii] - x;
+    const float dy = ys[ii] - y;
+    const float dz = zs[ii] - z;
+
+    if (dx * dx + dy * dy + dz * dz < sqr_radius) {
+      return true;
+    }
+  }
+
+  return false;
+}
+}  // namespace
+
+VoxelHashGrid::VoxelHashGrid() : radius_(0), sqr_radius_(0),
+  inv_cell_size_(0), origin_x_(0), origin_y_(0), origin_z_(0), dim_x_(0),
+  dim_y_(0), dim_z_(0) {}
+
+void VoxelHashGrid::SetInputCloud(const PointCloudPtr &cloud, double radius) {
+  assert(radius > 0);
+  radius_ = static_cast<float>(radius);
+  sqr_radius_ = radius_ * radius_;
+  inv_cell_size_ = 1.0f / radius_;
+  xs_.clear();
+  ys_.clear();
+  zs_.clear();
+  voxels_.clear();
+  dim_x_ = dim_y_ = dim_z_ = 0;
+
+  std::vector<int> indices;
+  indices.reserve(cloud->points.size());
+  float max_x = -std::numeric_limits<float>::max();
+  float max_y = max_x, max_z = max_x;
+  origin_x_ = origin_y_ = origin_z_ = std::numeric_limits<float>::max();
+
+  for (size_t ii = 0; ii < cloud->points.size(); ++ii) {
+    const PointT &point = cloud->points[ii];
+
+    if (!pcl::isFinite(point)) {
+      continue;
+    }
+
+    indices.push_back(static_cast<int>(ii));
+    origin_x_ = std::min(origin_x_, point.x);
+    origin_y_ = std::min(origin_y_, point.y);
+    origin_z_ = std::min(origin_z_, point.z);
+    max_x = std::max(max_x, point.x);
+    max_y = std::max(max_y, point.y);
+    max_z = std::max(max_z, point.z);
+  }
+
+  if (indices.empty()) {
+    return;
+  }
+
+  // Pad by one voxel so that the neighbors of every indexed voxel are inside
+  // the volume.
+  origin_x_ -= radius_;
+  origin_y_ -= radius_;
+  origin_z_ -= radius_;
+  dim_x_ = static_cast<int>((max_x - origin_x_) * inv_cell_size_) + 2;
+  dim_y_ = static_cast<int>((max_y - origin_y_) * inv_cell_size_) + 2;
+  dim_z_ = static_cast<int>((max_z - origin_z_) * inv_cell_size_) + 2;
+
+  std::vector<std::pair<uint64_t, int>> keyed_indices;
+  keyed_indices.reserve(indices.size());
+
+  for (const int index : indices) {
+    const PointT &point = cloud->points[index];
+    int ix = 0, iy = 0, iz = 0;
+    const bool inside = GetVoxel(point.x, point.y, point.z, &ix, &iy, &iz);
+    assert(inside);
+    (void)inside;
+    keyed_indices.push_back(std::make_pair(GetKey(ix, iy, iz), index));
+  }
+
+  std::sort(keyed_indices.begin(), keyed_indices.end());
+  xs_.resize(keyed_indices.size());
+  ys_.resize(keyed_indices.size());
+  zs_.resize(keyed_indices.size());
+  voxels_.reserve(keyed_indices.size());
+
+  for (size_t ii = 0; ii < keyed_indices.size(); ++ii) {
+    const PointT &point = cloud->points[keyed_indices[ii].second];
+    xs_[ii] = point.x;
+    ys_[ii] = point.y;
+    zs_[ii] = point.z;
+
+    auto &range = voxels_[keyed_indices[ii].first];
+
+    if (ii == 0 || keyed_indices[ii - 1].first != keyed_indices[ii].first) {
+      range.first = static_cast<int>(ii);
+    }
+
+    range.second = static_cast<int>(ii) + 1;
+  }
+}
+
+bool VoxelHashGrid::GetVoxel(float x, float y, float z, int *ix, int *iy,
+                             int *iz) const {
+  const float fx = (x - origin_x_) * inv_cell_size_;
+  const float fy = (y - origin_y_) * inv_cell_size_;
+  const float fz = (z - origin_z_) * inv_cell_size_;
+
+  if (!(fx >= 0 && fy >= 0 && fz >= 0 && fx < dim_x_ && fy < dim_y_ &&
+        fz < dim_z_)) {
+    return false;
+  }
+
+  *ix = static_cast<int>(fx);
+  *iy = static_cast<int>(fy);
+  *iz = static_cast<int>(fz);
+  return true;
+}
+
+bool VoxelHashGrid::HasPointWithinRadius(const PointT &point) const {
+  if (voxels_.empty() || !pcl::isFinite(point)) {
+    return false;
+  }
+
+  // Points outside the padded volume are more than radius away from every
+  // indexed point.
+  int ix = 0, iy = 0, iz = 0;
+
+  if (!GetVoxel(point.x, point.y, point.z, &ix, &iy, &iz)) {
+    return false;
+  }
+
+  // The three voxels of a row along x have consecutive keys, so their points
+  // are contiguous and are tested in one pass.
+  for (int z = std::max(0, iz - 1); z <= std::min(dim_z_ - 1, iz + 1); ++z) {
+    for (int y = std::max(0, iy - 1); y <= std::min(dim_y_ - 1, iy + 1); ++y) {
+      int begin = -1, end = -1;
+
+      for (int x = std::max(0, ix - 1); x <= std::min(dim_x_ - 1, ix + 1); ++x) {
+        auto it = voxels_.find(GetKey(x, y, z));
+
+        if (it == voxels_.end()) {
+          continue;
+        }
+
+        if (begin < 0) {
+          begin = it->second.first;
+        }
+
+        end = it->second.second;
+      }
+
+      if (begin >= 0 &&
+          AnyWithinRadius(xs_.data() + begin, ys_.data() + begin,
+                          zs_.data() + begin, end - begin, point.x, point.y, point.z,
+                          sqr_radius_)) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+void VoxelHashGrid::HasPointsWithinRadius(const PointCloud &cloud,
+                                          std::vector<unsigned char> *has_neighbor) const {
+  const int num_points = static_cast<int>(cloud.points.size());
+  has_neighbor->resize(num_points);
+
+  #pragma omp parallel for
+
+  for (int ii = 0; ii < num_points; ++ii) {
+    (*has_neighbor)[ii] = HasPointWithinRadius(cloud.points[ii]) ? 1 : 0;
+  }
+}
+}  // namespace sbpl_perception
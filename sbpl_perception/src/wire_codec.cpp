@@ -0,0 +1,238 @@
+/**
+ * @file wire_codec.cpp
+ * @brief Compact encodings for depth images and pixel index lists sent over MPI
+ * @author Venkatraman Narayanan
+ * Carnegie Mellon University, 2015
+ */
+
+#include <sbpl_perception/wire_codec.h>
+
+#include <sbpl_perception/pixel_set.h>
+#include <sbpl_perception/utils/utils.h>
+
+#include <atomic>
+
+namespace {
+// Depth token tags, in the low two bits of every token.
+constexpr uint32_t kDeltaTag = 0;
+constexpr uint32_t kNoReturnRunTag = 1;
+constexpr uint32_t kRepeatRunTag = 2;
+
+// First byte of encoded pixel indices.
+constexpr uint8_t kDeltaFormat = 0;
+constexpr uint8_t kBitsetFormat = 1;
+constexpr size_t kBitsetBytes = (sbpl_perception::kNumPixels + 7) / 8;
+static_assert(sbpl_perception::kNumPixels % 64 == 0,
+              "the bitset format covers whole words");
+
+std::atomic<uint64_t> raw_bytes(0);
+std::atomic<uint64_t> encoded_bytes(0);
+
+void PutVarint(uint32_t value, std::vector<uint8_t> *bytes) {
+  while (value >= 0x80) {
+    bytes->push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+
+  bytes->push_back(static_cast<uint8_t>(value));
+}
+
+bool GetVarint(const std::vector<uint8_t> &bytes, size_t *pos,
+               uint32_t *value) {
+  *value = 0;
+
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (*pos >= bytes.size()) {
+      return false;
+    }
+
+    const uint8_t byte = bytes[(*pos)++];
+    *value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+uint32_t ZigZag(int value) {
+  return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>
+         (value >> 31);
+}
+
+int UnZigZag(uint32_t value) {
+  return static_cast<int>(value >> 1) ^ -static_cast<int>(value & 1);
+}
+}  // namespace
+
+namespace sbpl_perception {
+
+void EncodeDepths(const std::vector<unsigned short> &depths,
+                  std::vector<uint8_t> *bytes) {
+  bytes->clear();
+  const size_t num_depths = depths.size();
+  PutVarint(static_cast<uint32_t>(num_depths), bytes);
+
+  int previous = 0;
+  size_t ii = 0;
+
+  while (ii < num_depths) {
+    const unsigned short depth = depths[ii];
+
+    if (depth == kKinectMaxDepth || depth == previous) {
+      size_t run_end = ii + 1;
+
+      while (run_end < num_depths && depths[run_end] == depth) {
+        ++run_end;
+      }
+
+      const uint32_t tag = depth == kKinectMaxDepth ? kNoReturnRunTag :
+                           kRepeatRunTag;
+      PutVarint(static_cast<uint32_t>(run_end - ii - 1) << 2 | tag, bytes);
+      ii = run_end;
+      continue;
+    }
+
+    PutVarint(ZigZag(depth - previous) << 2 | kDeltaTag, bytes);
+    previous = depth;
+    ++ii;
+  }
+
+  raw_bytes += num_depths * sizeof(unsigned short);
+  encoded_bytes += bytes->size();
+}
+
+bool DecodeDepths(const std::vector<uint8_t> &bytes,
+                  std::vector<unsigned short> *depths) {
+  depths->clear();
+  size_t pos = 0;
+  uint32_t num_depths = 0;
+
+  if (!GetVarint(bytes, &pos, &num_depths) ||
+      num_depths > static_cast<uint32_t>(kNumPixels)) {
+    return false;
+  }
+
+  depths->reserve(num_depths);
+  int previous = 0;
+
+  while (depths->size() < num_depths) {
+    uint32_t token = 0;
+
+    if (!GetVarint(bytes, &pos, &token)) {
+      return false;
+    }
+
+    const uint32_t payload = token >> 2;
+
+    switch (token & 3) {
+    case kDeltaTag:
+      previous += UnZigZag(payload);
+      depths->push_back(static_cast<unsigned short>(previous));
+      break;
+
+    case kNoReturnRunTag:
+    case kRepeatRunTag: {
+      if (payload >= num_depths - depths->size()) {
+        return false;
+      }
+
+      const unsigned short depth = (token & 3) == kNoReturnRunTag ?
+                                   kKinectMaxDepth : static_cast<unsigned short>(previous);
+      depths->insert(depths->end(), payload + 1, depth);
+      break;
+    }
+
+    default:
+      return false;
+    }
+  }
+
+  return pos == bytes.size();
+}
+
+void EncodePixelSet(const PixelSet &pixels, std::vector<uint8_t> *bytes) {
+  bytes->clear();
+  bytes->push_back(kDeltaFormat);
+  PutVarint(static_cast<uint32_t>(pixels.Count()), bytes);
+  int previous = 0;
+
+  pixels.ForEach([&](int index) {
+    PutVarint(static_cast<uint32_t>(index - previous), bytes);
+    previous = index;
+  });
+
+  if (bytes->size() > 1 + kBitsetBytes) {
+    bytes->assign(1 + kBitsetBytes, 0);
+    (*bytes)[0] = kBitsetFormat;
+    const auto &words = pixels.words();
+
+    for (size_t ii = 0; ii < kBitsetBytes; ++ii) {
+      (*bytes)[1 + ii] = static_cast<uint8_t>(words[ii / 8] >> (8 * (ii % 8)));
+    }
+  }
+
+  raw_bytes += pixels.words().size() * sizeof(uint64_t);
+  encoded_bytes += bytes->size();
+}
+
+bool DecodePixelSet(const std::vector<uint8_t> &bytes, PixelSet *pixels) {
+  pixels->Clear();
+
+  if (bytes.empty()) {
+    return false;
+  }
+
+  if (bytes[0] == kBitsetFormat) {
+    if (bytes.size() != 1 + kBitsetBytes) {
+      return false;
+    }
+
+    for (size_t ii = 1; ii < bytes.size(); ++ii) {
+      for (uint8_t bits = bytes[ii]; bits != 0; bits &= bits - 1) {
+        pixels->Set(static_cast<int>(ii - 1) * 8 + __builtin_ctz(bits));
+      }
+    }
+
+    return true;
+  }
+
+  if (bytes[0] != kDeltaFormat) {
+    return false;
+  }
+
+  size_t pos = 1;
+  uint32_t num_indices = 0;
+
+  if (!GetVarint(bytes, &pos, &num_indices) ||
+      num_indices > bytes.size() - pos) {
+    return false;
+  }
+
+  int previous = 0;
+
+  for (uint32_t ii = 0; ii < num_indices; ++ii) {
+    uint32_t delta = 0;
+
+    if (!GetVarint(bytes, &pos, &delta) ||
+        delta >= static_cast<uint32_t>(kNumPixels - previous)) {
+      return false;
+    }
+
+    previous += static_cast<int>(delta);
+
+    pixels->Set(previous);
+  }
+
+  return pos == bytes.size();
+}
+
+WireCodecBytes GetWireCodecBytes() {
+  WireCodecBytes bytes;
+  bytes.raw_bytes = raw_bytes;
+  bytes.encoded_bytes = encoded_bytes;
+  return bytes;
+}
+}  // namespace sbpl_perception
@@ -0,0 +1,104 @@
+#include <sbpl_perception/bounded_cache.h>
+
+#include "gtest/gtest.h"
+
+#include <vector>
+
+using namespace std;
+using namespace sbpl_perception;
+
+namespace {
+typedef BoundedCache<int, vector<int>> IntVectorCache;
+
+IntVectorCache MakeCache() {
+  return IntVectorCache([](const vector<int> &value) {
+    return value.size() * sizeof(int);
+  });
+}
+
+// Bytes charged for an entry holding num_ints ints.
+uint64_t EntryBytes(int num_ints) {
+  IntVectorCache cache = MakeCache();
+  cache.Insert(0, vector<int>(num_ints));
+  return cache.stats().bytes;
+}
+}
+
+TEST(BoundedCacheTest, FindTest) {
+  IntVectorCache cache = MakeCache();
+  EXPECT_TRUE(cache.empty());
+  EXPECT_EQ(cache.Find(1), nullptr);
+
+  cache.Insert(1, vector<int>(10, 1));
+  cache.Insert(2, vector<int>(20, 2));
+  ASSERT_NE(cache.Find(1), nullptr);
+  EXPECT_EQ(cache.Find(1)->size(), 10u);
+  EXPECT_TRUE(cache.Contains(2));
+  EXPECT_EQ(cache.stats().bytes, EntryBytes(10) + EntryBytes(20));
+
+  // Replacing a value recharges its size.
+  cache.Insert(2, vector<int>(5, 2));
+  EXPECT_EQ(cache.size(), 2u);
+  EXPECT_EQ(cache.stats().bytes, EntryBytes(10) + EntryBytes(5));
+  EXPECT_EQ(cache.stats().peak_bytes, EntryBytes(10) + EntryBytes(20));
+
+  EXPECT_EQ(cache.stats().hits, 2u);
+  EXPECT_EQ(cache.stats().misses, 1u);
+  EXPECT_EQ(cache.stats().evictions, 0u);
+
+  cache.clear();
+  EXPECT_TRUE(cache.empty());
+  EXPECT_EQ(cache.stats().bytes, 0u);
+  EXPECT_EQ(cache.stats().hits, 2u);
+
+  cache.ResetStats();
+  EXPECT_EQ(cache.stats().hits, 0u);
+  EXPECT_EQ(cache.stats().peak_bytes, 0u);
+}
+
+TEST(BoundedCacheTest, LRUEvictionTest) {
+  IntVectorCache cache = MakeCache();
+  cache.set_byte_budget(3 * EntryBytes(10));
+
+  for (int ii = 0; ii < 3; ++ii) {
+    cache.Insert(ii, vector<int>(10, ii));
+  }
+
+  // With equal costs and sizes, the least recently found entry goes first.
+  cache.Find(0);
+  cache.Insert(3, vector<int>(10, 3));
+  EXPECT_TRUE(cache.Contains(0));
+  EXPECT_FALSE(cache.Contains(1));
+  EXPECT_TRUE(cache.Contains(2));
+  EXPECT_TRUE(cache.Contains(3));
+  EXPECT_EQ(cache.stats().evictions, 1u);
+  EXPECT_LE(cache.stats().bytes, cache.byte_budget());
+
+  // Shrinking the budget evicts right away.
+  cache.set_byte_budget(EntryBytes(10));
+  EXPECT_EQ(cache.size(), 1u);
+  EXPECT_TRUE(cache.Contains(3));
+}
+
+TEST(BoundedCacheTest, CostAwareEvictionTest) {
+  IntVectorCache cache = MakeCache();
+  cache.set_byte_budget(2 * EntryBytes(10));
+
+  // The expensive entry outlives a cheaper, more recent one.
+  cache.Insert(0, vector<int>(10), 100.0);
+  cache.Insert(1, vector<int>(10), 1.0);
+  cache.Insert(2, vector<int>(10), 1.0);
+  EXPECT_TRUE(cache.Contains(0));
+  EXPECT_FALSE(cache.Contains(1));
+  EXPECT_TRUE(cache.Contains(2));
+
+  // An entry larger than the whole budget still goes in, alone.
+  cache.Insert(3, vector<int>(100));
+  EXPECT_EQ(cache.size(), 1u);
+  EXPECT_TRUE(cache.Contains(3));
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,194 @@
+#include <sbpl_perception/depth_image_kernels.h>
+
+#include <sbpl_perception/utils/utils.h>
+
+#include "gtest/gtest.h"
+
+#include <random>
+#include <vector>
+
+using namespace std;
+using namespace sbpl_perception;
+
+namespace {
+typedef vector<unsigned short> DepthImage;
+
+// Lengths around the 8- and 16-lane vector widths, so that the scalar tail is
+// exercised, and a full image.
+const int kLengths[] = {0, 1, 7, 8, 9, 15, 16, 17, 31, 33, 100, 1001,
+                        kNumPixels
+                       };
+
+// Mostly no-returns and ordinary depths, with some depths at and beyond
+// kKinectMaxDepth.
+unsigned short RandomDepth(std::mt19937 *rng) {
+  std::uniform_int_distribution<int> kind_dist(0, 9);
+  std::uniform_int_distribution<int> depth_dist(500, 3000);
+  std::uniform_int_distribution<int> any_dist(0, 65535);
+
+  switch (kind_dist(*rng)) {
+  case 0:
+  case 1:
+  case 2:
+    return kKinectMaxDepth;
+
+  case 3:
+    return kKinectMaxDepth - 1;
+
+  case 4:
+    return kKinectMaxDepth + 1;
+
+  case 5:
+    return static_cast<unsigned short>(any_dist(*rng));
+
+  default:
+    return static_cast<unsigned short>(depth_dist(*rng));
+  }
+}
+
+// A parent image and a successor that does not occlude it: wherever both are
+// valid, succ is no closer than parent.
+void MakeUnoccludedPair(int num_pixels, std::mt19937 *rng, DepthImage *parent,
+                        DepthImage *succ) {
+  parent->resize(num_pixels);
+  succ->resize(num_pixels);
+
+  for (int ii = 0; ii < num_pixels; ++ii) {
+    (*parent)[ii] = RandomDepth(rng);
+    (*succ)[ii] = RandomDepth(rng);
+
+    if ((*parent)[ii] != kKinectMaxDepth && (*succ)[ii] != kKinectMaxDepth &&
+        (*succ)[ii] < (*parent)[ii]) {
+      (*succ)[ii] = (*parent)[ii];
+    }
+  }
+}
+
+void ExpectFindNewPixelsMatches(const DepthImage &parent,
+                                const DepthImage &succ) {
+  const int num_pixels = static_cast<int>(parent.size());
+  vector<int> indices, expected_indices;
+  unsigned short min_depth = 0, max_depth = 0;
+  unsigned short expected_min_depth = 0, expected_max_depth = 0;
+
+  const bool expected_occluded = FindNewPixelsScalar(parent.data(),
+                                                     succ.data(), num_pixels, &expected_indices, &expected_min_depth,
+                                                     &expected_max_depth);
+  EXPECT_EQ(FindNewPixels(parent.data(), succ.data(), num_pixels, &indices,
+                          &min_depth, &max_depth), expected_occluded);
+  EXPECT_EQ(indices, expected_indices);
+  EXPECT_EQ(min_depth, expected_min_depth);
+  EXPECT_EQ(max_depth, expected_max_depth);
+
+  // The same images as parent and (uncomposed) object.
+  DepthImage composed(num_pixels), expected_composed(num_pixels);
+  ComposeDepthImagesScalar(parent.data(), succ.data(),
+                           expected_composed.data(), num_pixels);
+  const bool expected_composed_occluded = FindNewPixelsScalar(parent.data(),
+                                                              expected_composed.data(), num_pixels, &expected_indices,
+                                                              &expected_min_depth, &expected_max_depth);
+  EXPECT_EQ(ComposeAndFindNewPixels(parent.data(), succ.data(), num_pixels,
+                                    composed.data(), &indices, &min_depth, &max_depth),
+            expected_composed_occluded);
+  EXPECT_EQ(composed, expected_composed);
+  EXPECT_EQ(indices, expected_indices);
+  EXPECT_EQ(min_depth, expected_min_depth);
+  EXPECT_EQ(max_depth, expected_max_depth);
+}
+}
+
+TEST(DepthImageKernelsTest, ComposeMatchesScalar) {
+  std::mt19937 rng(0);
+
+  for (int num_pixels : kLengths) {
+    DepthImage first(num_pixels), second(num_pixels);
+
+    for (int ii = 0; ii < num_pixels; ++ii) {
+      first[ii] = RandomDepth(&rng);
+      second[ii] = RandomDepth(&rng);
+    }
+
+    DepthImage composed(num_pixels), expected(num_pixels);
+    ComposeDepthImages(first.data(), second.data(), composed.data(),
+                       num_pixels);
+    ComposeDepthImagesScalar(first.data(), second.data(), expected.data(),
+                             num_pixels);
+    EXPECT_EQ(composed, expected) << "num_pixels: " << num_pixels;
+  }
+}
+
+TEST(DepthImageKernelsTest, FindNewPixelsUnoccluded) {
+  std::mt19937 rng(1);
+
+  for (int num_pixels : kLengths) {
+    SCOPED_TRACE(num_pixels);
+    DepthImage parent, succ;
+    MakeUnoccludedPair(num_pixels, &rng, &parent, &succ);
+    ExpectFindNewPixelsMatches(parent, succ);
+  }
+}
+
+TEST(DepthImageKernelsTest, FindNewPixelsOccluded) {
+  std::mt19937 rng(2);
+
+  for (int num_pixels : kLengths) {
+    if (num_pixels == 0) {
+      continue;
+    }
+
+    // One occluding pixel at the start, in the middle, and in the last
+    // (possibly partial) vector.
+    const int positions[] = {0, num_pixels / 2, num_pixels - 1};
+
+    for (int position : positions) {
+      SCOPED_TRACE(testing::Message() << num_pixels << " " << position);
+      DepthImage parent, succ;
+      MakeUnoccludedPair(num_pixels, &rng, &parent, &succ);
+      parent[position] = 1500;
+      succ[position] = 1000;
+      ExpectFindNewPixelsMatches(parent, succ);
+    }
+  }
+}
+
+// A no-return succ pixel over a parent depth beyond kKinectMaxDepth is
+// neither new nor closer.
+TEST(DepthImageKernelsTest, FindNewPixelsBeyondMaxDepth) {
+  for (int num_pixels : kLengths) {
+    SCOPED_TRACE(num_pixels);
+    DepthImage parent(num_pixels, kKinectMaxDepth + 1);
+    DepthImage succ(num_pixels, kKinectMaxDepth);
+    ExpectFindNewPixelsMatches(parent, succ);
+
+    vector<int> indices;
+    unsigned short min_depth = 0, max_depth = 0;
+    EXPECT_FALSE(FindNewPixels(parent.data(), succ.data(), num_pixels,
+                               &indices, &min_depth, &max_depth));
+    EXPECT_TRUE(indices.empty());
+  }
+}
+
+TEST(DepthImageKernelsTest, ApplyOcclusionMaskMatchesScalar) {
+  std::mt19937 rng(3);
+
+  for (int num_pixels : kLengths) {
+    DepthImage input(num_pixels), mask(num_pixels);
+
+    for (int ii = 0; ii < num_pixels; ++ii) {
+      input[ii] = RandomDepth(&rng);
+      // Equal depths half of the time, to cover the boundary.
+      mask[ii] = ii % 2 == 0 ? input[ii] : RandomDepth(&rng);
+    }
+
+    DepthImage masked(num_pixels), expected(num_pixels);
+    ApplyOcclusionMask(input.data(), mask.data(), masked.data(), num_pixels);
+    ApplyOcclusionMaskScalar(input.data(), mask.data(), expected.data(),
+                             num_pixels);
+    EXPECT_EQ(masked, expected) << "num_pixels: " << num_pixels;
+  }
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
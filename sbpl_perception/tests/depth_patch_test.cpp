@@ -0,0 +1,126 @@
+#include <sbpl_perception/depth_patch.h>
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace sbpl_perception;
+
+namespace {
+// Fills a width x height rectangle with top left corner at (x, y).
+void FillRectangle(int x, int y, int width, int height, unsigned short depth,
+                   vector<unsigned short> *depth_image) {
+  for (int ii = y; ii < y + height; ++ii) {
+    for (int jj = x; jj < x + width; ++jj) {
+      depth_image->at(ii * kDepthImageWidth + jj) = depth;
+    }
+  }
+}
+}
+
+class DepthPatchTest : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    image_1_.resize(kNumPixels, kKinectMaxDepth);
+    image_2_.resize(kNumPixels, kKinectMaxDepth);
+    FillRectangle(10, 20, 30, 40, 1000, &image_1_);
+    FillRectangle(30, 50, 20, 20, 900, &image_2_);
+  }
+
+  vector<unsigned short> image_1_;
+  vector<unsigned short> image_2_;
+};
+
+TEST_F(DepthPatchTest, CropTest) {
+  DepthPatch patch(image_1_);
+  EXPECT_EQ(patch.x_min(), 10);
+  EXPECT_EQ(patch.y_min(), 20);
+  EXPECT_EQ(patch.width(), 30);
+  EXPECT_EQ(patch.height(), 40);
+
+  vector<unsigned short> depth_image;
+  patch.GetDepthImage(&depth_image);
+  EXPECT_EQ(depth_image, image_1_);
+
+  for (int ii = 0; ii < kNumPixels; ++ii) {
+    ASSERT_EQ(patch.GetDepth(ii), image_1_[ii]);
+  }
+
+  int num_pixels = 0;
+  patch.ForEachPixel([&](int index, unsigned short depth) {
+    EXPECT_EQ(depth, image_1_[index]);
+    ++num_pixels;
+  });
+  EXPECT_EQ(num_pixels, 30 * 40);
+
+  DepthPatch empty_patch(vector<unsigned short>(kNumPixels, kKinectMaxDepth));
+  EXPECT_TRUE(empty_patch.empty());
+  empty_patch.GetDepthImage(&depth_image);
+  EXPECT_EQ(depth_image, vector<unsigned short>(kNumPixels, kKinectMaxDepth));
+}
+
+TEST_F(DepthPatchTest, CropRectangleTest) {
+  // A rectangle with a margin of empty pixels around the valid ones, as a
+  // cropped render returns it.
+  const int x_min = 5;
+  const int y_min = 12;
+  const int width = 50;
+  const int height = 60;
+  vector<unsigned short> depths(width * height);
+
+  for (int ii = 0; ii < height; ++ii) {
+    for (int jj = 0; jj < width; ++jj) {
+      depths[ii * width + jj] = image_1_[(y_min + ii) * kDepthImageWidth + x_min
+                                         + jj];
+    }
+  }
+
+  DepthPatch patch(x_min, y_min, width, height, depths);
+  DepthPatch expected_patch(image_1_);
+  EXPECT_EQ(patch.x_min(), expected_patch.x_min());
+  EXPECT_EQ(patch.y_min(), expected_patch.y_min());
+  EXPECT_EQ(patch.width(), expected_patch.width());
+  EXPECT_EQ(patch.height(), expected_patch.height());
+  EXPECT_EQ(patch.depths(), expected_patch.depths());
+
+  DepthPatch empty_patch(x_min, y_min, width, height,
+                         vector<unsigned short>(width * height, kKinectMaxDepth));
+  EXPECT_TRUE(empty_patch.empty());
+  EXPECT_TRUE(DepthPatch(0, 0, 0, 0, vector<unsigned short>()).empty());
+}
+
+TEST_F(DepthPatchTest, ComposeTest) {
+  vector<unsigned short> expected_image(kNumPixels);
+
+  for (int ii = 0; ii < kNumPixels; ++ii) {
+    expected_image[ii] = std::min(image_1_[ii], image_2_[ii]);
+  }
+
+  DepthPatch composed = DepthPatch::Compose(DepthPatch(image_1_),
+                                            DepthPatch(image_2_));
+  vector<unsigned short> depth_image;
+  composed.GetDepthImage(&depth_image);
+  EXPECT_EQ(depth_image, expected_image);
+
+  depth_image = image_1_;
+  DepthPatch(image_2_).ComposeInto(&depth_image);
+  EXPECT_EQ(depth_image, expected_image);
+}
+
+TEST_F(DepthPatchTest, OcclusionTest) {
+  DepthPatch patch_1(image_1_);
+  DepthPatch patch_2(image_2_);
+  EXPECT_TRUE(patch_2.Occludes(patch_1));
+  EXPECT_FALSE(patch_1.Occludes(patch_2));
+
+  // Disjoint patches do not occlude each other.
+  vector<unsigned short> image_3(kNumPixels, kKinectMaxDepth);
+  FillRectangle(100, 100, 10, 10, 500, &image_3);
+  EXPECT_FALSE(DepthPatch(image_3).Occludes(patch_1));
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
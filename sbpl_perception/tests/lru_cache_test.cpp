@@ -0,0 +1,69 @@
+#include <sbpl_perception/lru_cache.h>
+
+#include "gtest/gtest.h"
+
+#include <string>
+
+using namespace std;
+using namespace sbpl_perception;
+
+TEST(LRUCacheTest, FindTest) {
+  LRUCache<int, string> cache;
+  EXPECT_TRUE(cache.empty());
+  EXPECT_EQ(cache.Find(1), nullptr);
+
+  cache.Insert(1, "one");
+  cache.Insert(2, "two");
+  ASSERT_NE(cache.Find(1), nullptr);
+  EXPECT_EQ(*cache.Find(1), "one");
+  EXPECT_TRUE(cache.Contains(2));
+  EXPECT_EQ(cache.size(), 2u);
+
+  cache.Insert(1, "uno");
+  EXPECT_EQ(*cache.Find(1), "uno");
+  EXPECT_EQ(cache.size(), 2u);
+
+  cache.clear();
+  EXPECT_FALSE(cache.Contains(1));
+  EXPECT_TRUE(cache.empty());
+}
+
+TEST(LRUCacheTest, EvictTest) {
+  LRUCache<int, int> cache;
+
+  for (int ii = 0; ii < 5; ++ii) {
+    cache.Insert(ii, ii);
+  }
+
+  // Find must not change the order, Touch must.
+  cache.Find(0);
+  EXPECT_TRUE(cache.Touch(1));
+  EXPECT_FALSE(cache.Touch(5));
+
+  cache.Evict(3);
+  EXPECT_EQ(cache.size(), 3u);
+  EXPECT_TRUE(cache.Contains(1));
+  EXPECT_TRUE(cache.Contains(3));
+  EXPECT_TRUE(cache.Contains(4));
+  EXPECT_FALSE(cache.Contains(0));
+  EXPECT_FALSE(cache.Contains(2));
+
+  // Caches with the same history hold the same keys.
+  LRUCache<int, int> mirror;
+
+  for (int ii = 0; ii < 5; ++ii) {
+    mirror.Insert(ii, 0);
+  }
+
+  mirror.Touch(1);
+  mirror.Evict(3);
+
+  for (int ii = 0; ii < 5; ++ii) {
+    EXPECT_EQ(cache.Contains(ii), mirror.Contains(ii));
+  }
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,85 @@
+#include <sbpl_perception/pixel_set.h>
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <random>
+#include <set>
+#include <vector>
+
+using namespace std;
+using namespace sbpl_perception;
+
+namespace {
+vector<int> Indices(const PixelSet &pixels) {
+  vector<int> indices;
+  pixels.ForEach([&indices](int index) {
+    indices.push_back(index);
+  });
+  return indices;
+}
+}
+
+TEST(PixelSetTest, SetTest) {
+  PixelSet pixels;
+  EXPECT_EQ(pixels.Count(), 0);
+
+  pixels.Set(0);
+  pixels.Set(63);
+  pixels.Set(64);
+  pixels.Set(kNumPixels - 1);
+  pixels.Set(64);
+  EXPECT_EQ(pixels.Count(), 4);
+  EXPECT_TRUE(pixels.Test(63));
+  EXPECT_FALSE(pixels.Test(62));
+  EXPECT_EQ(Indices(pixels), vector<int>({0, 63, 64, kNumPixels - 1}));
+
+  pixels.Clear();
+  EXPECT_EQ(pixels.Count(), 0);
+  EXPECT_EQ(pixels, PixelSet());
+}
+
+TEST(PixelSetTest, SetOperationsTest) {
+  std::mt19937 rng(0);
+  PixelSet first, second;
+  set<int> first_indices, second_indices;
+
+  for (int ii = 0; ii < 5000; ++ii) {
+    const int index = static_cast<int>(rng() % kNumPixels);
+    first.Set(index);
+    first_indices.insert(index);
+
+    const int other_index = static_cast<int>(rng() % kNumPixels);
+    second.Set(other_index);
+    second_indices.insert(other_index);
+  }
+
+  vector<int> difference;
+  std::set_difference(first_indices.begin(), first_indices.end(),
+                      second_indices.begin(), second_indices.end(),
+                      std::back_inserter(difference));
+  vector<int> set_union;
+  std::set_union(first_indices.begin(), first_indices.end(),
+                 second_indices.begin(), second_indices.end(),
+                 std::back_inserter(set_union));
+
+  vector<int> visited;
+  PixelSet::ForEachInDifference(first, second, [&visited](int index) {
+    visited.push_back(index);
+  });
+  EXPECT_EQ(visited, difference);
+
+  PixelSet and_not = first;
+  and_not.AndNot(second);
+  EXPECT_EQ(Indices(and_not), difference);
+
+  PixelSet combined = first;
+  combined |= second;
+  EXPECT_EQ(Indices(combined), set_union);
+  EXPECT_EQ(combined.Count(), static_cast<int>(set_union.size()));
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
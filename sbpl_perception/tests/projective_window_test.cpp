@@ -0,0 +1,154 @@
+#include <sbpl_perception/projective_window.h>
+
+#include <kinect_sim/camera_constants.h>
+#include <sbpl_perception/utils/utils.h>
+
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace std;
+using namespace sbpl_perception;
+
+namespace {
+// The camera-frame point rendered at depth image pixel (col, row), as in
+// RangeLikelihood::getGlobalPoint.
+Eigen::Vector3f BackProject(int col, int row, float depth) {
+  const int gl_row = kDepthImageHeight - 1 - row;
+  return Eigen::Vector3f((col - kCameraCX) * depth / kCameraFX,
+                         (gl_row - kCameraCY) * depth / kCameraFY, -depth);
+}
+
+bool InWindow(const ProjectiveWindow &window, int col, int row) {
+  return abs(col - window.u) <= window.half_width &&
+         abs(row - window.v) <= window.half_width;
+}
+
+// Depth (m) of a synthetic scene at a pixel: a tilted table with a
+// hemisphere on it. kinect no-return elsewhere is not needed for the test.
+float SceneDepth(int col, int row, float bump_shift) {
+  const float table = 1.0f + 0.002f * row;
+  const float dx = col - 320.0f - bump_shift;
+  const float dy = row - 240.0f;
+  const float bump = 60.0f * 60.0f - dx * dx - dy * dy;
+  return bump > 0 ? table - 0.0005f * sqrt(bump) : table;
+}
+}
+
+TEST(ProjectiveWindowTest, PixelCentersMapToTheirPixel) {
+  for (int row = 0; row < kDepthImageHeight; row += 7) {
+    for (int col = 0; col < kDepthImageWidth; col += 11) {
+      const ProjectiveWindow window = ComputeProjectiveWindow(BackProject(col,
+                                                                          row, 1.5f), 0.01);
+      EXPECT_EQ(window.u, col);
+      EXPECT_EQ(window.v, row);
+    }
+  }
+}
+
+TEST(ProjectiveWindowTest, ContainsAllPointsWithinRadius) {
+  std::mt19937 rng(0);
+  std::uniform_int_distribution<int> col_dist(0, kDepthImageWidth - 1);
+  std::uniform_int_distribution<int> row_dist(0, kDepthImageHeight - 1);
+  std::uniform_real_distribution<float> depth_dist(0.3f, 4.0f);
+  std::uniform_real_distribution<float> unit_dist(0.0f, 1.0f);
+  std::normal_distribution<float> normal_dist;
+  const double radii[] = {0.005, 0.01, 0.02, 0.05};
+  int num_missed = 0;
+
+  for (int ii = 0; ii < 200000; ++ii) {
+    const int col = col_dist(rng);
+    const int row = row_dist(rng);
+    const Eigen::Vector3f rendered = BackProject(col, row, depth_dist(rng));
+    const double radius = radii[ii % 4];
+
+    // Offsets up to and including the radius.
+    Eigen::Vector3f offset(normal_dist(rng), normal_dist(rng), normal_dist(rng));
+    const float scale = ii % 8 == 0 ? 1.0f : cbrt(unit_dist(rng));
+    offset *= static_cast<float>(radius) * scale / offset.norm();
+
+    if (!InWindow(ComputeProjectiveWindow(rendered + offset, radius), col,
+                  row)) {
+      ++num_missed;
+    }
+  }
+
+  EXPECT_EQ(num_missed, 0);
+}
+
+TEST(ProjectiveWindowTest, CoversImageNearCamera) {
+  const ProjectiveWindow window = ComputeProjectiveWindow(Eigen::Vector3f(
+                                                            0.3f, 0, -0.005f), 0.01);
+  EXPECT_TRUE(InWindow(window, 0, 0));
+  EXPECT_TRUE(InWindow(window, kDepthImageWidth - 1, kDepthImageHeight - 1));
+}
+
+// A scan of the window around each observed point finds a rendered neighbor
+// exactly when a brute-force radius search does, so the source and last-level
+// costs agree.
+TEST(ProjectiveWindowTest, MatchesRadiusSearch) {
+  const double radius = 0.01;
+  vector<Eigen::Vector3f> rendered(kNumPixels);
+
+  for (int row = 0; row < kDepthImageHeight; ++row) {
+    for (int col = 0; col < kDepthImageWidth; ++col) {
+      rendered[row * kDepthImageWidth + col] = BackProject(col, row,
+                                                           SceneDepth(col, row, 0));
+    }
+  }
+
+  // Observed points from the same scene with the hemisphere shifted, plus
+  // noise, concentrated around the hemisphere where the answers differ.
+  std::mt19937 rng(0);
+  std::uniform_int_distribution<int> col_dist(240, 400);
+  std::uniform_int_distribution<int> row_dist(160, 320);
+  std::normal_distribution<float> noise_dist(0.0f, 0.004f);
+  int num_explained = 0;
+
+  for (int ii = 0; ii < 1000; ++ii) {
+    const int col = col_dist(rng);
+    const int row = row_dist(rng);
+    const Eigen::Vector3f observed = BackProject(col, row, SceneDepth(col, row,
+                                                                      8.0f)) +
+                                     Eigen::Vector3f(noise_dist(rng), noise_dist(rng), noise_dist(rng));
+    const float sqr_radius = static_cast<float>(radius * radius);
+
+    bool found_brute_force = false;
+
+    for (const Eigen::Vector3f &point : rendered) {
+      if ((point - observed).squaredNorm() <= sqr_radius) {
+        found_brute_force = true;
+        break;
+      }
+    }
+
+    const ProjectiveWindow window = ComputeProjectiveWindow(observed, radius);
+    bool found_in_window = false;
+
+    for (int r = max(0, window.v - window.half_width);
+         r <= min(kDepthImageHeight - 1, window.v + window.half_width); ++r) {
+      for (int c = max(0, window.u - window.half_width);
+           c <= min(kDepthImageWidth - 1, window.u + window.half_width); ++c) {
+        if ((rendered[r * kDepthImageWidth + c] - observed).squaredNorm() <=
+            sqr_radius) {
+          found_in_window = true;
+        }
+      }
+    }
+
+    EXPECT_EQ(found_in_window, found_brute_force);
+    num_explained += found_brute_force;
+  }
+
+  // Both outcomes occur.
+  EXPECT_GT(num_explained, 0);
+  EXPECT_LT(num_explained, 1000);
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
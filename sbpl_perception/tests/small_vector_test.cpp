@@ -0,0 +1,88 @@
+#include <sbpl_perception/small_vector.h>
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+using namespace std;
+using namespace sbpl_perception;
+
+namespace {
+typedef SmallVector<string, 2> StringVector;
+}
+
+TEST(SmallVectorTest, InlineTest) {
+  StringVector strings;
+  EXPECT_TRUE(strings.empty());
+  EXPECT_TRUE(strings.is_inline());
+
+  strings.push_back("a");
+  strings.emplace_back(3, 'b');
+  EXPECT_EQ(strings.size(), 2u);
+  EXPECT_TRUE(strings.is_inline());
+  EXPECT_EQ(strings.NumHeapBytes(), 0u);
+  EXPECT_EQ(strings.front(), "a");
+  EXPECT_EQ(strings.back(), "bbb");
+
+  StringVector copy(strings);
+  EXPECT_TRUE(copy.is_inline());
+  EXPECT_TRUE(equal(copy.begin(), copy.end(), strings.begin()));
+
+  copy.pop_back();
+  EXPECT_EQ(copy.size(), 1u);
+  EXPECT_EQ(strings.size(), 2u);
+}
+
+TEST(SmallVectorTest, SpillTest) {
+  StringVector strings = {"c", "a", "b"};
+  EXPECT_FALSE(strings.is_inline());
+  EXPECT_GE(strings.capacity(), 3u);
+  EXPECT_EQ(strings.NumHeapBytes(), strings.capacity() * sizeof(string));
+
+  sort(strings.begin(), strings.end());
+  EXPECT_EQ(strings[0], "a");
+  EXPECT_EQ(strings[2], "c");
+
+  // Moving takes the heap buffer, and leaves the source empty and inline.
+  const string *data = strings.data();
+  StringVector moved(std::move(strings));
+  EXPECT_EQ(moved.data(), data);
+  EXPECT_TRUE(strings.empty());
+  EXPECT_TRUE(strings.is_inline());
+
+  // Clearing keeps the storage.
+  moved.clear();
+  EXPECT_TRUE(moved.empty());
+  EXPECT_FALSE(moved.is_inline());
+
+  moved = {"d"};
+  EXPECT_EQ(moved.size(), 1u);
+  EXPECT_EQ(moved[0], "d");
+}
+
+TEST(SmallVectorTest, MoveInlineTest) {
+  StringVector strings = {string(100, 'x')};
+  StringVector moved;
+  moved = std::move(strings);
+  EXPECT_TRUE(moved.is_inline());
+  EXPECT_TRUE(strings.empty());
+  ASSERT_EQ(moved.size(), 1u);
+  EXPECT_EQ(moved[0], string(100, 'x'));
+}
+
+TEST(SmallVectorTest, PushBackAliasTest) {
+  StringVector strings = {string(100, 'a'), string(100, 'b')};
+  ASSERT_EQ(strings.size(), strings.capacity());
+  strings.push_back(strings[0]);
+  strings.push_back(strings[1]);
+  ASSERT_EQ(strings.size(), 4u);
+  EXPECT_EQ(strings[2], string(100, 'a'));
+  EXPECT_EQ(strings[3], string(100, 'b'));
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
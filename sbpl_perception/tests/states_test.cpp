@@ -118,6 +118,59 @@ TEST_F(StatesTest, GraphStateTest) {
   EXPECT_NE(g1, g4);
 }
 
+TEST_F(StatesTest, GraphStateHashTest) {
+  // Swapped x and y, and swapped poses between objects, used to collide.
+  ObjectState o1(1, false, DiscPose(1, 2, 0, 0, 0, 3));
+  ObjectState o2(1, false, DiscPose(2, 1, 0, 0, 0, 3));
+  ObjectState o3(2, false, DiscPose(1, 2, 0, 0, 0, 3));
+  ObjectState o4(2, false, DiscPose(2, 1, 0, 0, 0, 3));
+  EXPECT_NE(o1.PackedKey(), o2.PackedKey());
+  EXPECT_NE(o1.PackedKey(), o3.PackedKey());
+
+  GraphState g1, g2, g3;
+  g1.mutable_object_states() = {o1, o4};
+  g2.mutable_object_states() = {o4, o1};
+  g3.mutable_object_states() = {o2, o3};
+  EXPECT_EQ(g1, g2);
+  EXPECT_EQ(g1.GetHash(), g2.GetHash());
+  EXPECT_NE(g1, g3);
+  EXPECT_NE(g1.GetHash(), g3.GetHash());
+
+  // Yaw does not matter for symmetric objects.
+  ObjectState o5(3, true, DiscPose(4, 4, 0, 0, 0, 1));
+  ObjectState o6(3, true, DiscPose(4, 4, 0, 0, 0, 5));
+  EXPECT_EQ(o5.PackedKey(), o6.PackedKey());
+
+  // Keys omit z, so states that differ only in z hash alike but differ.
+  ObjectState o7(4, false, DiscPose(1, 2, 1, 0, 0, 3));
+  ObjectState o8(4, false, DiscPose(1, 2, 2, 0, 0, 3));
+  GraphState g4, g5;
+  g4.mutable_object_states() = {o1, o7};
+  g5.mutable_object_states() = {o1, o8};
+  EXPECT_EQ(g4.GetHash(), g5.GetHash());
+  EXPECT_NE(g4, g5);
+}
+
+TEST_F(StatesTest, GraphStateInlineStorageTest) {
+  GraphState g1;
+
+  for (int ii = 0; ii < static_cast<int>(GraphState::kNumInlineObjects); ++ii) {
+    g1 = GraphState(g1, ObjectState(ii, false, DiscPose(ii, 0, 0, 0, 0, 0)));
+    EXPECT_TRUE(g1.object_states().is_inline());
+  }
+
+  // Beyond the inline capacity, objects spill to the heap.
+  const ObjectState last(GraphState::kNumInlineObjects, false, DiscPose());
+  GraphState g2(g1, last);
+  EXPECT_FALSE(g2.object_states().is_inline());
+  EXPECT_EQ(g2.NumObjects(), GraphState::kNumInlineObjects + 1);
+  EXPECT_EQ(g2.object_states().back(), last);
+
+  g1.AppendObject(last);
+  EXPECT_EQ(g1, g2);
+  EXPECT_EQ(g1.GetHash(), g2.GetHash());
+}
+
 int main(int argc, char **argv) {
   SetWorldResolutionParams(0.1, 0.1, M_PI / 18.0, 0.0, 0.0, params);
   DiscretizationManager::Initialize(params);
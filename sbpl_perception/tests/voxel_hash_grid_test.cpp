@@ -0,0 +1,121 @@
+#include <sbpl_perception/voxel_hash_grid.h>
+
+#include "gtest/gtest.h"
+
+#include <limits>
+#include <random>
+
+using namespace std;
+using namespace sbpl_perception;
+
+namespace {
+constexpr double kRadius = 0.02;
+
+PointT MakePoint(float x, float y, float z) {
+  PointT point;
+  point.x = x;
+  point.y = y;
+  point.z = z;
+  return point;
+}
+
+void ExpectMatchesBruteForce(const PointCloudPtr &cloud,
+                             const PointCloud &queries) {
+  VoxelHashGrid grid;
+  grid.SetInputCloud(cloud, kRadius);
+
+  vector<unsigned char> has_neighbor;
+  grid.HasPointsWithinRadius(queries, &has_neighbor);
+  ASSERT_EQ(has_neighbor.size(), queries.points.size());
+
+  for (size_t ii = 0; ii < queries.points.size(); ++ii) {
+    const PointT &query = queries.points[ii];
+    bool expected = false;
+
+    for (size_t jj = 0; jj < cloud->points.size(); ++jj) {
+      const PointT &point = cloud->points[jj];
+      const float dx = point.x - query.x;
+      const float dy = point.y - query.y;
+      const float dz = point.z - query.z;
+
+      if (dx * dx + dy * dy + dz * dz < kRadius * kRadius) {
+        expected = true;
+        break;
+      }
+    }
+
+    EXPECT_EQ(expected, has_neighbor[ii] != 0);
+    EXPECT_EQ(expected, grid.HasPointWithinRadius(query));
+  }
+}
+}
+
+TEST(VoxelHashGridTest, MatchesBruteForce) {
+  std::mt19937 rng(0);
+  std::uniform_real_distribution<float> dist(-0.5, 0.5);
+  PointCloudPtr cloud(new PointCloud);
+
+  for (int ii = 0; ii < 2000; ++ii) {
+    cloud->points.push_back(MakePoint(dist(rng), dist(rng), 1.0 + 0.1 * dist(rng)));
+  }
+
+  cloud->points.push_back(MakePoint(std::numeric_limits<float>::quiet_NaN(), 0,
+                                    0));
+
+  PointCloud queries;
+
+  for (int ii = 0; ii < 2000; ++ii) {
+    queries.points.push_back(MakePoint(1.1 * dist(rng), 1.1 * dist(rng),
+                                       1.0 + 0.2 * dist(rng)));
+  }
+
+  ExpectMatchesBruteForce(cloud, queries);
+}
+
+// Dozens of points per voxel, so that the distance tests run over full
+// vectors, with queries near the radius boundary.
+TEST(VoxelHashGridTest, DenseCloudMatchesBruteForce) {
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> dist(-0.05, 0.05);
+  std::normal_distribution<float> normal_dist;
+  PointCloudPtr cloud(new PointCloud);
+
+  for (int ii = 0; ii < 5000; ++ii) {
+    cloud->points.push_back(MakePoint(dist(rng), dist(rng), 1.0 + dist(rng)));
+  }
+
+  PointCloud queries;
+
+  for (int ii = 0; ii < 2000; ++ii) {
+    if (ii % 2 == 0) {
+      queries.points.push_back(MakePoint(2 * dist(rng), 2 * dist(rng),
+                                         1.0 + 2 * dist(rng)));
+      continue;
+    }
+
+    // Just inside or outside the radius of an indexed point.
+    const PointT &point = cloud->points[ii % cloud->points.size()];
+    const float offset_x = normal_dist(rng);
+    const float offset_y = normal_dist(rng);
+    const float offset_z = normal_dist(rng);
+    const float scale = static_cast<float>(kRadius) * (ii % 4 == 1 ? 0.999f :
+                                                       1.001f) / sqrt(offset_x * offset_x + offset_y * offset_y +
+                                                                      offset_z * offset_z);
+    queries.points.push_back(MakePoint(point.x + scale * offset_x,
+                                       point.y + scale * offset_y, point.z + scale * offset_z));
+  }
+
+  ExpectMatchesBruteForce(cloud, queries);
+}
+
+TEST(VoxelHashGridTest, EmptyCloud) {
+  PointCloudPtr cloud(new PointCloud);
+  VoxelHashGrid grid;
+  grid.SetInputCloud(cloud, kRadius);
+  EXPECT_FALSE(grid.HasPointWithinRadius(MakePoint(0, 0, 0)));
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,229 @@
+#include <sbpl_perception/depth_patch.h>
+#include <sbpl_perception/pixel_set.h>
+#include <sbpl_perception/wire_codec.h>
+
+#include "gtest/gtest.h"
+
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+
+#include <random>
+#include <sstream>
+
+using namespace std;
+using namespace sbpl_perception;
+
+namespace {
+// Serialized like DepthPatch and PixelSet, but with arbitrary contents.
+struct RawDepthPatch {
+  int x_min, y_min, width, height;
+  vector<uint8_t> bytes;
+
+  template <typename Ar> void serialize(Ar &ar, const unsigned int) {
+    ar &x_min;
+    ar &y_min;
+    ar &width;
+    ar &height;
+    ar &bytes;
+  }
+};
+
+struct RawPixelSet {
+  vector<uint8_t> bytes;
+
+  template <typename Ar> void serialize(Ar &ar, const unsigned int) {
+    ar &bytes;
+  }
+};
+
+template <typename T>
+string Serialize(const T &value) {
+  stringstream stream;
+  {
+    boost::archive::binary_oarchive oarchive(stream);
+    oarchive << value;
+  }
+  return stream.str();
+}
+
+template <typename T>
+void Deserialize(const string &message, T *value) {
+  stringstream stream(message);
+  boost::archive::binary_iarchive iarchive(stream);
+  iarchive >> *value;
+}
+
+DepthPatch MakePatch() {
+  vector<unsigned short> depth_image(kNumPixels, kKinectMaxDepth);
+
+  for (int ii = 100; ii < 200; ++ii) {
+    for (int jj = 50; jj < 120; ++jj) {
+      depth_image[ii * kDepthImageWidth + jj] = static_cast<unsigned short>(1000 + ii);
+    }
+  }
+
+  return DepthPatch(depth_image);
+}
+}
+
+TEST(WireCodecTest, DepthsTest) {
+  // A sloped surface with holes, as rendered objects look.
+  vector<unsigned short> depths(kDepthImageWidth * 100, kKinectMaxDepth);
+
+  for (int ii = 10; ii < 90; ++ii) {
+    for (int jj = 100; jj < 300; ++jj) {
+      if ((ii + jj) % 37 != 0) {
+        depths[ii * kDepthImageWidth + jj] = static_cast<unsigned short>(800 + ii / 4
+                                                                         + jj / 8);
+      }
+    }
+  }
+
+  depths[5] = 0;
+  depths[6] = 19999;
+
+  vector<uint8_t> bytes;
+  EncodeDepths(depths, &bytes);
+  EXPECT_LT(bytes.size(), depths.size() * sizeof(unsigned short) / 2);
+
+  vector<unsigned short> decoded;
+  ASSERT_TRUE(DecodeDepths(bytes, &decoded));
+  EXPECT_EQ(decoded, depths);
+
+  EncodeDepths(vector<unsigned short>(), &bytes);
+  ASSERT_TRUE(DecodeDepths(bytes, &decoded));
+  EXPECT_TRUE(decoded.empty());
+
+  bytes.pop_back();
+  EXPECT_FALSE(DecodeDepths(bytes, &decoded));
+}
+
+TEST(WireCodecTest, PixelSetTest) {
+  std::mt19937 rng(0);
+
+  // Sparse sets use the delta format, dense ones the bitset.
+  for (int num_indices : {0, 100, kNumPixels / 2}) {
+    PixelSet pixels;
+
+    for (int ii = 0; ii < num_indices; ++ii) {
+      pixels.Set(static_cast<int>(rng() % kNumPixels));
+    }
+
+    pixels.Set(kNumPixels - 1);
+
+    vector<uint8_t> bytes;
+    EncodePixelSet(pixels, &bytes);
+    EXPECT_LE(bytes.size(), 1 + kNumPixels / 8);
+
+    PixelSet decoded;
+    decoded.Set(7);
+    ASSERT_TRUE(DecodePixelSet(bytes, &decoded));
+    EXPECT_EQ(decoded, pixels);
+  }
+}
+
+TEST(WireCodecTest, DepthPatchSerializationTest) {
+  vector<unsigned short> depth_image(kNumPixels, kKinectMaxDepth);
+
+  for (int ii = 100; ii < 200; ++ii) {
+    for (int jj = 50; jj < 120; ++jj) {
+      depth_image[ii * kDepthImageWidth + jj] = static_cast<unsigned short>(1000 + ii);
+    }
+  }
+
+  const DepthPatch patch(depth_image);
+  stringstream stream;
+  {
+    boost::archive::binary_oarchive oarchive(stream);
+    oarchive << patch;
+  }
+
+  DepthPatch received;
+  {
+    boost::archive::binary_iarchive iarchive(stream);
+    iarchive >> received;
+  }
+
+  EXPECT_EQ(received.x_min(), patch.x_min());
+  EXPECT_EQ(received.y_min(), patch.y_min());
+  EXPECT_EQ(received.width(), patch.width());
+  EXPECT_EQ(received.height(), patch.height());
+  EXPECT_EQ(received.depths(), patch.depths());
+}
+
+TEST(WireCodecTest, TruncatedMessageTest) {
+  const string patch_message = Serialize(MakePatch());
+  PixelSet pixels;
+  pixels.Set(3);
+  pixels.Set(kNumPixels - 1);
+  const string pixels_message = Serialize(pixels);
+
+  for (size_t size = 0; size < patch_message.size(); ++size) {
+    DepthPatch received;
+    EXPECT_THROW(Deserialize(patch_message.substr(0, size), &received),
+                 boost::archive::archive_exception);
+  }
+
+  for (size_t size = 0; size < pixels_message.size(); ++size) {
+    PixelSet received;
+    EXPECT_THROW(Deserialize(pixels_message.substr(0, size), &received),
+                 boost::archive::archive_exception);
+  }
+}
+
+TEST(WireCodecTest, CorruptMessageTest) {
+  const DepthPatch patch = MakePatch();
+  RawDepthPatch raw_patch = {patch.x_min(), patch.y_min(), patch.width(),
+                             patch.height(), {}
+                            };
+  EncodeDepths(patch.depths(), &raw_patch.bytes);
+
+  DepthPatch received_patch;
+  ASSERT_NO_THROW(Deserialize(Serialize(raw_patch), &received_patch));
+  EXPECT_EQ(received_patch.depths(), patch.depths());
+
+  // Codec bytes cut short.
+  RawDepthPatch corrupt_patch = raw_patch;
+  corrupt_patch.bytes.pop_back();
+  EXPECT_THROW(Deserialize(Serialize(corrupt_patch), &received_patch),
+               boost::archive::archive_exception);
+  EXPECT_TRUE(received_patch.empty());
+
+  // Depth count that does not match the rectangle.
+  corrupt_patch = raw_patch;
+  ++corrupt_patch.width;
+  EXPECT_THROW(Deserialize(Serialize(corrupt_patch), &received_patch),
+               boost::archive::archive_exception);
+
+  // Rectangle outside the image.
+  corrupt_patch = raw_patch;
+  corrupt_patch.x_min = kDepthImageWidth - patch.width() + 1;
+  EXPECT_THROW(Deserialize(Serialize(corrupt_patch), &received_patch),
+               boost::archive::archive_exception);
+
+  PixelSet pixels;
+  pixels.Set(3);
+  pixels.Set(1000);
+  RawPixelSet raw_pixels;
+  EncodePixelSet(pixels, &raw_pixels.bytes);
+
+  PixelSet received_pixels;
+  ASSERT_NO_THROW(Deserialize(Serialize(raw_pixels), &received_pixels));
+  EXPECT_EQ(received_pixels, pixels);
+
+  RawPixelSet corrupt_pixels = raw_pixels;
+  corrupt_pixels.bytes.pop_back();
+  EXPECT_THROW(Deserialize(Serialize(corrupt_pixels), &received_pixels),
+               boost::archive::archive_exception);
+  EXPECT_EQ(received_pixels.Count(), 0);
+
+  // An index delta that wraps around when added as an int.
+  corrupt_pixels.bytes = {0, 2, 3, 0xff, 0xff, 0xff, 0xff, 0x0f};
+  EXPECT_THROW(Deserialize(Serialize(corrupt_pixels), &received_pixels),
+               boost::archive::archive_exception);
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}